@@ -1,9 +1,23 @@
 from collections import OrderedDict
+from collections.abc import Mapping
 
-from cnamedtuple._namedtuple import namedtuple, _register_asdict
+from cnamedtuple._namedtuple import (
+    freelist_clear,
+    namedtuple,
+    set_asdict_factory,
+    set_freelist_limit,
+    type_cache_clear,
+    _register_asdict,
+    _type_cache_info,
+)
 
 __all__ = [
-    'namedtuple'
+    'freelist_clear',
+    'namedtuple',
+    'set_asdict_factory',
+    'set_freelist_limit',
+    'type_cache_clear',
+    'type_cache_info',
 ]
 
 __version__ = '0.1.6'
@@ -19,7 +33,27 @@ __version__ = '0.1.6'
 # a third-party project.
 _register_asdict(OrderedDict)
 
+
+# Private like `functools._CacheInfo`, only `type_cache_info` hands it out.
+_TypeCacheInfo = namedtuple(
+    'TypeCacheInfo',
+    'hits misses maxsize currsize',
+)
+
+
+def type_cache_info():
+    """Report the statistics of the cache used by
+    ``namedtuple(..., cache=True)``.
+    """
+    return _TypeCacheInfo._make(_type_cache_info())
+
+
+# `_asmapping()` views implement the read-only mapping protocol in C.
+Mapping.register(type(_TypeCacheInfo(0, 0, 0, 0)._asmapping()))
+
+
 # Clean up the namespace for this module, the only public api should be
-# `namedtuple`.
+# `namedtuple` and the cache helpers.
 del _register_asdict
 del OrderedDict
+del Mapping
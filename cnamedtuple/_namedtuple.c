@@ -1,98 +1,34 @@
+#include <float.h>
+
 #include "Python.h"
 #include "structmember.h"
 
+/* Critical sections only lock in free-threaded builds, which have them since
+   3.13. Elsewhere the GIL already serializes the code they guard. */
+#ifndef Py_BEGIN_CRITICAL_SECTION
+#define Py_BEGIN_CRITICAL_SECTION(op) {
+#define Py_END_CRITICAL_SECTION() }
+#define Py_BEGIN_CRITICAL_SECTION2(a, b) {
+#define Py_END_CRITICAL_SECTION2() }
+#endif
+
 /* The values that the module will hold. These are needed by various functions
    supporting the namedtuple type. */
 typedef struct{
-    PyObject *iskeyword;  /* `keywords.iskeyword` */
-    PyObject *asdict;     /* The constructor called from `_asdict`. */
+    PyObject *asdict;        /* The default constructor called from
+                                `_asdict`. */
+    PyObject *type_cache;    /* (module, typename, fields, rename) -> type */
+    Py_ssize_t cache_hits;   /* The number of type cache lookups that hit. */
+    Py_ssize_t cache_misses; /* The number of type cache lookups that
+                                missed. */
 }module_state;
 
-/* The type of the descriptors that access the named fields of the `namedtuple`
-   types. */
-typedef struct{
-    PyObject id_ob;
-    Py_ssize_t id_idx;  /* The index that this will access. */
-}namedtuple_indexer;
-
-/* Index a tuple at `self`'s index like a specialized `itemgetter`. */
-static PyObject *
-namedtuple_indexer_descr_get(PyObject *self,
-                             PyObject *instance,
-                             PyObject *owner)
-{
-    PyObject *ret;
-
-    if (!instance) {
-        /* If this is called on the owner, then just return this object. */
-        ret = self;
-    }
-    else {
-        /* Assert that this is a tuple subclass. */
-        if (!PyTuple_Check(instance)) {
-            PyErr_Format(PyExc_TypeError,
-                         "%s objects can only be used on tuple types",
-                         ((PyTypeObject*) self->ob_type)->tp_name);
-            return NULL;
-        }
-
-        if (!(ret = PyTuple_GetItem(instance,
-                                    ((namedtuple_indexer*) self)->id_idx))) {
-            return NULL;
-        }
-    }
-
-    Py_INCREF(ret);
-    return ret;
-}
-
-PyDoc_STRVAR(namedtuple_indexer_doc,
-"A specialized 'itemgetter' for tuples where the index is known to be valid.");
+/* The module, found through `PyState_FindModule` by methods which only have
+   the instance. */
+static struct PyModuleDef _namedtuplemodule;
 
-/* A specialized `itemgetter` for tuples where the index is known to be
-   valid. This cannot be constructed or subclassed from within python
-   because if the preconditions are not followed, you would get undefined
-   behaviour. */
-PyTypeObject namedtuple_indexer_type = {
-    PyVarObject_HEAD_INIT(&PyType_Type, 0)
-    "_collections.NamedTupleIndexerType",       /* tp_name */
-    sizeof(namedtuple_indexer),                 /* tp_basicsize */
-    0,                                          /* tp_itemsize */
-    0,                                          /* tp_dealloc */
-    0,                                          /* tp_print */
-    0,                                          /* tp_getattr */
-    0,                                          /* tp_setattr */
-    0,                                          /* tp_reserved */
-    0,                                          /* tp_repr */
-    0,                                          /* tp_as_number */
-    0,                                          /* tp_as_sequence */
-    0,                                          /* tp_as_mapping */
-    0,                                          /* tp_hash */
-    0,                                          /* tp_call */
-    0,                                          /* tp_str */
-    PyObject_GenericGetAttr,                    /* tp_getattro */
-    0,                                          /* tp_setattro */
-    0,                                          /* tp_as_buffer */
-    Py_TPFLAGS_DEFAULT,                         /* tp_flags */
-    namedtuple_indexer_doc,                     /* tp_doc */
-    0,                                          /* tp_traverse */
-    0,                                          /* tp_clear */
-    0,                                          /* tp_richcompare */
-    0,                                          /* tp_weaklistoffset */
-    0,                                          /* tp_iter */
-    0,                                          /* tp_iternext */
-    0,                                          /* tp_methods */
-    0,                                          /* tp_members */
-    0,                                          /* tp_getset */
-    0,                                          /* tp_base */
-    0,                                          /* tp_dict */
-    namedtuple_indexer_descr_get,               /* tp_descr_get */
-    0,                                          /* tp_descr_set */
-    0,                                          /* tp_dictoffset */
-    0,                                          /* tp_init */
-    0,                                          /* tp_alloc */
-    0,                                          /* tp_new */
-};
+/* The maximum number of types held by `namedtuple(..., cache=True)`. */
+#define TYPE_CACHE_SIZE 256
 
 /* A wrapper around an object to make read-only access to it. */
 typedef struct{
@@ -184,6 +120,322 @@ get_fields(PyObject *self) {
     return fields;
 }
 
+/* The field metadata for a namedtuple type. This is stored on the type as the
+   `_fields` descriptor so that the hot paths can read the fields without
+   going through attribute access. */
+typedef struct{
+    PyObject_VAR_HEAD
+    PyObject *fi_fields;        /* The tuple of field names. */
+    PyObject *fi_format;        /* The struct format of a typed namedtuple's
+                                   fields as bytes, NULL for tuple types. */
+    PyTypeObject *fi_owner;     /* The type this descriptor was installed on,
+                                   borrowed. NULL for metadata rebuilt from an
+                                   overridden `_fields`. */
+    PyMemberDef *fi_members;    /* The members that read the fields, owned by
+                                   the type. */
+    Py_ssize_t *fi_index;       /* Open addressed table from the hash of a
+                                   field name to its index, -1 if empty. */
+    size_t fi_mask;             /* The size of `fi_index` minus one. */
+    Py_hash_t fi_hashes[1];     /* The precomputed hash of each field name. */
+}namedtuple_fields;
+
+/* Types with at most this many fields look up keywords by scanning the names
+   for an identical object before using the hash table. */
+#define FIELDS_LINEAR_MAX 8
+
+#define FIELDS_COUNT(info) Py_SIZE(info)
+#define FIELDS_NAME(info, n) PyTuple_GET_ITEM((info)->fi_fields, n)
+
+static void
+namedtuple_fields_dealloc(PyObject *self)
+{
+    Py_CLEAR(((namedtuple_fields*) self)->fi_fields);
+    Py_CLEAR(((namedtuple_fields*) self)->fi_format);
+    PyMem_Free(((namedtuple_fields*) self)->fi_index);
+    PyObject_Del(self);
+}
+
+/* Return the field names on both the class and the instances. */
+static PyObject *
+namedtuple_fields_get(PyObject *self, PyObject *instance, PyObject *owner)
+{
+    PyObject *ret = ((namedtuple_fields*) self)->fi_fields;
+    Py_INCREF(ret);
+    return ret;
+}
+
+PyDoc_STRVAR(namedtuple_fields_doc,
+"The names of the fields of a namedtuple type.");
+
+PyTypeObject namedtuple_fields_type = {
+    PyVarObject_HEAD_INIT(&PyType_Type, 0)
+    "_collections.NamedTupleFields",            /* tp_name */
+    offsetof(namedtuple_fields, fi_hashes),     /* tp_basicsize */
+    sizeof(Py_hash_t),                          /* tp_itemsize */
+    (destructor) namedtuple_fields_dealloc,     /* tp_dealloc */
+    0,                                          /* tp_print */
+    0,                                          /* tp_getattr */
+    0,                                          /* tp_setattr */
+    0,                                          /* tp_reserved */
+    0,                                          /* tp_repr */
+    0,                                          /* tp_as_number */
+    0,                                          /* tp_as_sequence */
+    0,                                          /* tp_as_mapping */
+    0,                                          /* tp_hash */
+    0,                                          /* tp_call */
+    0,                                          /* tp_str */
+    PyObject_GenericGetAttr,                    /* tp_getattro */
+    0,                                          /* tp_setattro */
+    0,                                          /* tp_as_buffer */
+    Py_TPFLAGS_DEFAULT,                         /* tp_flags */
+    namedtuple_fields_doc,                      /* tp_doc */
+    0,                                          /* tp_traverse */
+    0,                                          /* tp_clear */
+    0,                                          /* tp_richcompare */
+    0,                                          /* tp_weaklistoffset */
+    0,                                          /* tp_iter */
+    0,                                          /* tp_iternext */
+    0,                                          /* tp_methods */
+    0,                                          /* tp_members */
+    0,                                          /* tp_getset */
+    0,                                          /* tp_base */
+    0,                                          /* tp_dict */
+    namedtuple_fields_get,                      /* tp_descr_get */
+    0,                                          /* tp_descr_set */
+    0,                                          /* tp_dictoffset */
+    0,                                          /* tp_init */
+    0,                                          /* tp_alloc */
+    0,                                          /* tp_new */
+};
+
+/* Build the field metadata for a tuple of field names.
+   return: A new reference or NULL */
+static namedtuple_fields *
+namedtuple_fields_new(PyObject *fields)
+{
+    Py_ssize_t fieldc = PyTuple_GET_SIZE(fields);
+    namedtuple_fields *info;
+    Py_ssize_t n;
+    size_t size;
+    size_t slot;
+
+    if (!(info = PyObject_NewVar(namedtuple_fields,
+                                 &namedtuple_fields_type,
+                                 fieldc))) {
+        return NULL;
+    }
+    Py_INCREF(fields);
+    info->fi_fields = fields;
+    info->fi_format = NULL;
+    info->fi_owner = NULL;
+    info->fi_members = NULL;
+
+    /* Keep the table at most half full so that probes stay short. */
+    for (size = 8;size < (size_t) fieldc * 2;size <<= 1);
+    info->fi_mask = size - 1;
+    if (!(info->fi_index = PyMem_New(Py_ssize_t, size))) {
+        Py_DECREF(info);
+        PyErr_NoMemory();
+        return NULL;
+    }
+    memset(info->fi_index, -1, sizeof(Py_ssize_t) * size);
+
+    for (n = 0;n < fieldc;++n) {
+        if ((info->fi_hashes[n] =
+             PyObject_Hash(PyTuple_GET_ITEM(fields, n))) == -1) {
+            Py_DECREF(info);
+            return NULL;
+        }
+        for (slot = (size_t) info->fi_hashes[n] & info->fi_mask;
+             info->fi_index[slot] != -1;
+             slot = (slot + 1) & info->fi_mask);
+        info->fi_index[slot] = n;
+    }
+    return info;
+}
+
+/* Find the index of `key` in the fields. Keyword names and attribute names
+   are almost always interned, so narrow types look for an identical object
+   first. Otherwise the key is hashed and looked up in the field index, so the
+   cost does not depend on the number of fields.
+   return: The index of the field, -1 if it is not a field or -2 on error. */
+static Py_ssize_t
+find_field(namedtuple_fields *info, PyObject *key)
+{
+    Py_ssize_t fieldc = FIELDS_COUNT(info);
+    Py_hash_t hash;
+    size_t slot;
+    Py_ssize_t n;
+    int cmp;
+
+    if (fieldc <= FIELDS_LINEAR_MAX) {
+        for (n = 0;n < fieldc;++n) {
+            if (FIELDS_NAME(info, n) == key) {
+                return n;
+            }
+        }
+    }
+
+    if ((hash = PyObject_Hash(key)) == -1) {
+        return -2;
+    }
+    for (slot = (size_t) hash & info->fi_mask;
+         (n = info->fi_index[slot]) != -1;
+         slot = (slot + 1) & info->fi_mask) {
+        if (FIELDS_NAME(info, n) == key) {
+            return n;
+        }
+        if (info->fi_hashes[n] == hash &&
+            (cmp = PyObject_RichCompareBool(key,
+                                            FIELDS_NAME(info, n),
+                                            Py_EQ))) {
+            return (cmp < 0) ? -2 : n;
+        }
+    }
+    return -1;
+}
+
+/* Like `find_field` but raise a `ValueError` if `key` is not a field.
+   return: The index of the field or -1 on error. */
+static Py_ssize_t
+require_field(namedtuple_fields *info, PyObject *key)
+{
+    Py_ssize_t ix = find_field(info, key);
+
+    if (ix == -1) {
+        PyErr_Format(PyExc_ValueError, "%R is not a field name", key);
+    }
+    return (ix < 0) ? -1 : ix;
+}
+
+/* Interned "_fields", set up in `PyInit__namedtuple`. */
+static PyObject *fields_str;
+
+/* Interned "__asdict__", set up in `PyInit__namedtuple`. */
+static PyObject *asdict_str;
+
+/* return: The number of items read by the members of the tuple subclass
+   `type`, which are fixed when the type is created, or zero if it has none
+   or is not a tuple subclass. */
+static Py_ssize_t
+members_width(PyTypeObject *type)
+{
+    PyMemberDef *member;
+    Py_ssize_t width = 0;
+    Py_ssize_t ix;
+
+    if (!PyType_FastSubclass(type, Py_TPFLAGS_TUPLE_SUBCLASS) ||
+        !type->tp_members) {
+        return 0;
+    }
+    for (member = type->tp_members;member->name;++member) {
+        if (member->type != T_OBJECT_EX ||
+            member->offset < (Py_ssize_t) offsetof(PyTupleObject, ob_item)) {
+            continue;
+        }
+        ix = (member->offset - offsetof(PyTupleObject, ob_item)) /
+            sizeof(PyObject*);
+        if (ix >= width) {
+            width = ix + 1;
+        }
+    }
+    return width;
+}
+
+/* The fields of a namedtuple type are read through members at fixed offsets
+   into the items, which are inherited by subclasses. A type whose `_fields`
+   was replaced, or a subclass that overrides `_fields` or combines several
+   namedtuple bases, must not build instances with fewer items than any of
+   those members read. The widths come from the members themselves because
+   `_fields` can be reassigned.
+   return: Zero if instances of `cls` with the fields of `info` are safe,
+   nonzero with a `TypeError` set otherwise. */
+static int
+check_fields_layout(PyTypeObject *cls, namedtuple_fields *info)
+{
+    PyObject *mro = cls->tp_mro;
+    PyTypeObject *base;
+    Py_ssize_t width;
+    Py_ssize_t n;
+
+    if (!mro) {
+        return 0;
+    }
+    /* With single inheritance the MRO is the chain of `tp_base`, and the type
+       that installed `info` is the only namedtuple type in it. */
+    if (info->fi_owner && PyType_IsSubtype(cls, info->fi_owner)) {
+        for (n = 0, base = cls;base;base = base->tp_base, ++n);
+        if (n == PyTuple_GET_SIZE(mro)) {
+            return 0;
+        }
+    }
+    for (n = 0;n < PyTuple_GET_SIZE(mro);++n) {
+        base = (PyTypeObject*) PyTuple_GET_ITEM(mro, n);
+        if ((width = members_width(base)) > FIELDS_COUNT(info)) {
+            PyErr_Format(PyExc_TypeError,
+                         "%s has fewer fields (%zd) than %s reads (%zd)",
+                         cls->tp_name,
+                         FIELDS_COUNT(info),
+                         base->tp_name,
+                         width);
+            return -1;
+        }
+    }
+    return 0;
+}
+
+/* Look up `name` in the MRO of `cls` like `_PyType_Lookup`. Without the GIL
+   another thread may replace the attribute, so the result is a strong
+   reference.
+   return: A new reference or NULL if `name` is not found. */
+static PyObject *
+type_lookup_ref(PyTypeObject *cls, PyObject *name)
+{
+#ifdef Py_GIL_DISABLED
+    return _PyType_LookupRef(cls, name);
+#else
+    PyObject *ret = _PyType_Lookup(cls, name);
+
+    Py_XINCREF(ret);
+    return ret;
+#endif
+}
+
+/* Gets the field metadata for `cls`. When `_fields` resolves to the metadata
+   installed by `namedtuple` this is a cache lookup on the type. If a subclass
+   overrides `_fields`, the metadata is rebuilt from `ob._fields`, where `ob`
+   is either `cls` or an instance of it. The layout of subclasses is checked
+   with `check_fields_layout`.
+   return: A new reference or NULL */
+static namedtuple_fields *
+get_fields_info(PyTypeObject *cls, PyObject *ob)
+{
+    PyObject *descr = type_lookup_ref(cls, fields_str);
+    PyObject *fields;
+    namedtuple_fields *info;
+
+    if (descr && Py_TYPE(descr) == &namedtuple_fields_type) {
+        info = (namedtuple_fields*) descr;
+    }
+    else {
+        Py_XDECREF(descr);
+        if (!(fields = get_fields(ob))) {
+            return NULL;
+        }
+        info = namedtuple_fields_new(fields);
+        Py_DECREF(fields);
+        if (!info) {
+            return NULL;
+        }
+    }
+
+    if (info->fi_owner != cls && check_fields_layout(cls, info)) {
+        Py_DECREF(info);
+        return NULL;
+    }
+    return info;
+}
+
 /* `__new__` for namedtuple types. This will reflect it's argument list
    off `cls`.
    return: A new instance of a namedtuple or NULL in case of error. */
@@ -191,28 +443,28 @@ static PyObject *
 namedtuple_new(PyTypeObject *cls, PyObject *args, PyObject *kwargs)
 {
     PyObject  *self;
+    namedtuple_fields *info;
     PyObject  *fields;
     Py_ssize_t fieldc;
-    PyObject  *keyword;
     Py_ssize_t n;
     Py_ssize_t pos;
     Py_ssize_t nargs;
     Py_ssize_t nkwargs;
     PyObject  *current_arg;
-    int        match;
     PyObject  *key;
     PyObject  *value;
 
-    if (!(fields = get_fields((PyObject*) cls))) {
+    if (!(info = get_fields_info(cls, (PyObject*) cls))) {
         return NULL;
     }
-    fieldc = PyTuple_GET_SIZE(fields);
+    fields = info->fi_fields;
+    fieldc = FIELDS_COUNT(info);
 
     nargs = PyTuple_GET_SIZE(args);
     nkwargs = (kwargs) ? PyDict_Size(kwargs) : 0;
 
     if (!(self = cls->tp_alloc(cls, fieldc))) {
-        Py_DECREF(fields);
+        Py_DECREF(info);
         return NULL;
     }
     /* zero the tuple so we can decref at any time */
@@ -230,628 +482,6049 @@ namedtuple_new(PyTypeObject *cls, PyObject *args, PyObject *kwargs)
         goto error;
     }
 
-    for (n = 0;n < fieldc;n++) {
-        keyword = PyTuple_GET_ITEM(fields, n);
-        current_arg = NULL;
-        if (nkwargs) {
-            current_arg = PyDict_GetItem(kwargs, keyword);
-        }
-        if (current_arg) {
-            --nkwargs;
-            if (n < nargs) {
-                /* Arg present in tuple and in dict. */
-                PyErr_Format(PyExc_TypeError,
-                             "Argument given by name ('%U') and position (%zd)",
-                             keyword,
-                             n + 1);
-                goto error;
-            }
-        }
-        else if (nkwargs && PyErr_Occurred()) {
+    for (n = 0;n < nargs;++n) {
+        current_arg = PyTuple_GET_ITEM(args, n);
+        Py_INCREF(current_arg);
+        PyTuple_SET_ITEM(self, n, current_arg);
+    }
+
+    /* Look up only the keywords that were given so that wide types do not
+       pay for the fields that were passed positionally. */
+    pos = 0;
+    while (nkwargs && PyDict_Next(kwargs, &pos, &key, &value)) {
+        if (!PyUnicode_Check(key)) {
+            PyErr_SetString(PyExc_TypeError, "keywords must be strings");
             goto error;
         }
-        else if (n < nargs) {
-            current_arg = PyTuple_GET_ITEM(args,n);
+        if ((n = find_field(info, key)) == -2) {
+            goto error;
         }
-
-        if (current_arg) {
-            /* This reference is stolen when we store it in self. */
-            Py_INCREF(current_arg);
-            PyTuple_SET_ITEM((PyTupleObject*) self, n, current_arg);
-            continue;
+        if (n == -1) {
+            PyErr_Format(PyExc_TypeError,
+                         "'%U' is an invalid keyword argument for this "
+                         "function",
+                         key);
+            goto error;
         }
-
-        if (n < fieldc) {
+        if (n < nargs) {
+            /* Arg present in tuple and in dict. */
             PyErr_Format(PyExc_TypeError,
-                         "Required argument '%U' (pos %zd) not found",
-                         keyword,
+                         "Argument given by name ('%U') and position (%zd)",
+                         key,
                          n + 1);
             goto error;
         }
+        Py_INCREF(value);
+        PyTuple_SET_ITEM(self, n, value);
     }
 
-    /* Check for extra kwargs. */
-    if (nkwargs > 0) {
-        pos = 0;
-        while (PyDict_Next(kwargs, &pos, &key, &value)) {
-            if (!PyUnicode_Check(key)) {
-                PyErr_SetString(PyExc_TypeError,
-                                "keywords must be strings");
-                goto error;
-            }
-            for (n = 0;n < fieldc;++n) {
-                if (!PyUnicode_Compare(key, PyTuple_GET_ITEM(fields, n))) {
-                    match = 1;
-                    break;
-                }
-            }
-            if (!match) {
+    /* Each keyword filled a distinct slot after the positional arguments, so
+       there is only something missing if too few arguments were given. */
+    if (nargs + nkwargs < fieldc) {
+        for (n = nargs;n < fieldc;++n) {
+            if (!PyTuple_GET_ITEM(self, n)) {
                 PyErr_Format(PyExc_TypeError,
-                             "'%U' is an invalid keyword argument for this "
-                             "function",
-                             key);
+                             "Required argument '%U' (pos %zd) not found",
+                             PyTuple_GET_ITEM(fields, n),
+                             n + 1);
                 goto error;
             }
         }
     }
 
-    Py_DECREF(fields);
+    Py_DECREF(info);
     return self;
 error:
 
-    Py_DECREF(fields);
+    Py_DECREF(info);
     Py_DECREF(self);
     return NULL;
 }
 
-/* Namedtuple class method for creating new instances from an iterable.
-   return `PyObject*` representing the new instance, or NULL to signal an
-   error. */
+#if PY_VERSION_HEX >= 0x03090000
+/* `tp_vectorcall` for namedtuple types. This fills the new instance directly
+   from the argument vector so calling the type does not need to pack an args
+   tuple or a kwargs dict.
+   return: A new instance of a namedtuple or NULL in case of error. */
 static PyObject *
-namedtuple__make(PyObject *cls, PyObject *args, PyObject *kwargs)
+namedtuple_vectorcall(PyObject *cls,
+                      PyObject *const *args,
+                      size_t nargsf,
+                      PyObject *kwnames)
 {
-    const char * const argnames[] = {"iterable", NULL};
-    PyObject *iterable;
-    PyObject *ret;
-
-    if (!PyArg_ParseTupleAndKeywords(args,
-                                     kwargs,
-                                     "O:_make",
-                                     (char**) argnames,
-                                     &iterable)) {
+    PyObject   *self;
+    PyObject  **items;
+    namedtuple_fields *info;
+    PyObject   *fields;
+    Py_ssize_t  fieldc;
+    Py_ssize_t  nargs = PyVectorcall_NARGS(nargsf);
+    Py_ssize_t  nkwargs = (kwnames) ? PyTuple_GET_SIZE(kwnames) : 0;
+    Py_ssize_t  n;
+    Py_ssize_t  ix;
+    PyObject   *key;
+
+    if (!(info = get_fields_info((PyTypeObject*) cls, cls))) {
         return NULL;
     }
+    fields = info->fi_fields;
+    fieldc = FIELDS_COUNT(info);
 
-    if (!(iterable = PySequence_Tuple(iterable))) {
-      PyErr_SetString(PyExc_ValueError, "iterable must be a sequence");
-      return NULL;
+    if (nargs + nkwargs > fieldc) {
+        PyErr_Format(PyExc_TypeError,
+                     "%U takes at most %zd argument%s (%zd given)",
+                     ((PyHeapTypeObject*) cls)->ht_name,
+                     fieldc,
+                     (fieldc == 1) ? "" : "s",
+                     nargs + nkwargs);
+        Py_DECREF(info);
+        return NULL;
     }
 
-    ret = ((PyTypeObject*) cls)->tp_new((PyTypeObject*) cls, iterable, NULL);
-    Py_DECREF(iterable);
-    return ret;
-}
-
-/* return:  new instance of `type(self)` with the kwargs
-   swapped out. On failure, returns NULL. */
-static PyObject *
-namedtuple__replace(PyObject *self, PyObject *args, PyObject *kwargs)
-{
-    PyObject *arg;
-    PyObject *items;
-    PyObject *item;
-    PyObject *ret;
-    PyObject *tkeys;
-    Py_ssize_t n;
-    PyObject *fields;
-    Py_ssize_t fieldc;
-
-    if (!(fields = get_fields(self))) {
+    /* `tp_alloc` hands back zeroed memory so we may decref at any time. */
+    if (!(self = ((PyTypeObject*) cls)->tp_alloc((PyTypeObject*) cls,
+                                                 fieldc))) {
+        Py_DECREF(info);
         return NULL;
     }
-    fieldc = PyTuple_GET_SIZE(fields);
+    items = ((PyTupleObject*) self)->ob_item;
+
+    /* Unrolled copies for the common small arities when everything is
+       passed positionally. */
+    if (nargs == fieldc) {
+        switch (fieldc) {
+        case 8: Py_INCREF(args[7]); items[7] = args[7]; /* fallthrough */
+        case 7: Py_INCREF(args[6]); items[6] = args[6]; /* fallthrough */
+        case 6: Py_INCREF(args[5]); items[5] = args[5]; /* fallthrough */
+        case 5: Py_INCREF(args[4]); items[4] = args[4]; /* fallthrough */
+        case 4: Py_INCREF(args[3]); items[3] = args[3]; /* fallthrough */
+        case 3: Py_INCREF(args[2]); items[2] = args[2]; /* fallthrough */
+        case 2: Py_INCREF(args[1]); items[1] = args[1]; /* fallthrough */
+        case 1: Py_INCREF(args[0]); items[0] = args[0]; /* fallthrough */
+        case 0:
+            Py_DECREF(info);
+            return self;
+        }
+    }
 
-    if (PyTuple_GET_SIZE(args)) {
-        /* No positional arguments allowed. */
-        PyErr_Format(PyExc_TypeError,
-                     "_replace takes no positional arguments (%zd given)",
-                     PyTuple_GET_SIZE(args));
-        Py_DECREF(fields);
-        return NULL;
+    for (n = 0;n < nargs;++n) {
+        Py_INCREF(args[n]);
+        items[n] = args[n];
     }
 
-    if (!kwargs) {
-        /* Fast path if nothing needs to be replaced, just copy. */
-        if (!(arg = PyTuple_Pack(1, self))) {
-            Py_DECREF(fields);
-            return NULL;
+    for (n = 0;n < nkwargs;++n) {
+        key = PyTuple_GET_ITEM(kwnames, n);
+        if ((ix = find_field(info, key)) == -2) {
+            goto error;
         }
-        ret = namedtuple__make((PyObject*) self->ob_type, arg, NULL);
-        Py_DECREF(arg);
-        return ret;
+        if (ix == -1) {
+            PyErr_Format(PyExc_TypeError,
+                         "'%U' is an invalid keyword argument for this "
+                         "function",
+                         key);
+            goto error;
+        }
+        if (items[ix]) {
+            /* Only positional arguments can precede a keyword here because
+               the interpreter rejects repeated keywords. */
+            PyErr_Format(PyExc_TypeError,
+                         "Argument given by name ('%U') and position (%zd)",
+                         key,
+                         ix + 1);
+            goto error;
+        }
+        Py_INCREF(args[nargs + n]);
+        items[ix] = args[nargs + n];
     }
 
-    if (!(items = PyTuple_New(fieldc))) {
-        Py_DECREF(fields);
-        return NULL;
+    if (nargs + nkwargs < fieldc) {
+        for (n = nargs;n < fieldc;++n) {
+            if (!items[n]) {
+                PyErr_Format(PyExc_TypeError,
+                             "Required argument '%U' (pos %zd) not found",
+                             PyTuple_GET_ITEM(fields, n),
+                             n + 1);
+                goto error;
+            }
+        }
     }
 
-    for (n = 0;n < fieldc;++n) {
-        if (!(item = PyDict_GetItem(kwargs, PyTuple_GET_ITEM(fields, n)))) {
-            item = PyTuple_GET_ITEM(self, n);
+    Py_DECREF(info);
+    return self;
+error:
+
+    Py_DECREF(info);
+    Py_DECREF(self);
+    return NULL;
+}
+#endif
+
+/* Create an instance of `cls` holding the `n` objects in `items`. The caller
+   must have already checked `n` against the number of fields. When `cls`
+   uses our `tp_new` the items are copied straight into the new instance,
+   otherwise they are packed into a tuple and passed to `cls.__new__`.
+   return: A new instance of `cls` or NULL in case of error. */
+static PyObject *
+namedtuple_from_array(PyTypeObject *cls, PyObject *const *items, Py_ssize_t n)
+{
+    PyObject *self;
+    PyObject *args;
+    Py_ssize_t ix;
+
+    if (cls->tp_new == namedtuple_new) {
+        if (!(self = cls->tp_alloc(cls, n))) {
+            return NULL;
         }
-        else {
-            PyDict_DelItem(kwargs, PyTuple_GET_ITEM(fields, n));
+        for (ix = 0;ix < n;++ix) {
+            Py_INCREF(items[ix]);
+            PyTuple_SET_ITEM(self, ix, items[ix]);
         }
-
-        Py_INCREF(item);
-        PyTuple_SET_ITEM(items, n, item);
+        return self;
     }
 
-    if (PyDict_Size(kwargs)) {
-        tkeys = PyDict_Keys(kwargs);
-        PyErr_Format(PyExc_ValueError, "Got unexpected field names: %R", tkeys);
-        Py_DECREF(tkeys);
-        Py_DECREF(fields);
-        Py_DECREF(items);
+    if (!(args = PyTuple_New(n))) {
         return NULL;
     }
+    for (ix = 0;ix < n;++ix) {
+        Py_INCREF(items[ix]);
+        PyTuple_SET_ITEM(args, ix, items[ix]);
+    }
+    self = cls->tp_new(cls, args, NULL);
+    Py_DECREF(args);
+    return self;
+}
 
-    Py_DECREF(fields);
+/* Namedtuple class method for creating new instances from an iterable.
+   return `PyObject*` representing the new instance, or NULL to signal an
+   error. */
+static PyObject *
+namedtuple__make(PyObject *cls,
+                 PyObject *const *args,
+                 Py_ssize_t nargs,
+                 PyObject *kwnames)
+{
+    Py_ssize_t nkwargs = (kwnames) ? PyTuple_GET_SIZE(kwnames) : 0;
+    PyObject *iterable;
+    namedtuple_fields *info;
+    Py_ssize_t fieldc;
+    PyObject *ret;
 
-    arg = PyTuple_Pack(1, items);
-    Py_DECREF(items);
-    if (!arg) {
+    if (nargs + nkwargs != 1) {
+        PyErr_Format(PyExc_TypeError,
+                     "_make() takes exactly one argument (%zd given)",
+                     nargs + nkwargs);
         return NULL;
     }
-    ret = namedtuple__make((PyObject*) self->ob_type, arg, NULL);
-    Py_DECREF(arg);
+    if (nkwargs &&
+        PyUnicode_CompareWithASCIIString(PyTuple_GET_ITEM(kwnames, 0),
+                                         "iterable")) {
+        PyErr_Format(PyExc_TypeError,
+                     "'%U' is an invalid keyword argument for _make()",
+                     PyTuple_GET_ITEM(kwnames, 0));
+        return NULL;
+    }
+    iterable = args[0];
+
+    /* Exact tuples and lists of the right length are copied straight into
+       the new instance. */
+    if (PyTuple_CheckExact(iterable) || PyList_CheckExact(iterable)) {
+        if (!(info = get_fields_info((PyTypeObject*) cls, cls))) {
+            return NULL;
+        }
+        fieldc = FIELDS_COUNT(info);
+        Py_DECREF(info);
+        if (PySequence_Fast_GET_SIZE(iterable) == fieldc) {
+            return namedtuple_from_array((PyTypeObject*) cls,
+                                         PySequence_Fast_ITEMS(iterable),
+                                         fieldc);
+        }
+    }
+
+    if (!(iterable = PySequence_Tuple(iterable))) {
+      PyErr_SetString(PyExc_ValueError, "iterable must be a sequence");
+      return NULL;
+    }
+
+    ret = ((PyTypeObject*) cls)->tp_new((PyTypeObject*) cls, iterable, NULL);
+    Py_DECREF(iterable);
     return ret;
 }
 
-/* The `__repr__` for `namedtuple` objects.
-   return: A str in the format `{typename}({f_1}={v_1}, ..., {f_n}={v_n})`
-   or NULL in case of an exception. */
+/* Namedtuple class method for creating a list of new instances from an
+   iterable of rows. Each row is checked once against the number of fields and
+   its items are copied directly into the new instance.
+   return: A new list or NULL in case of error. */
 static PyObject *
-namedtuple_repr(PyObject *self, PyObject *_)
+namedtuple__make_many(PyObject *cls, PyObject *rows)
 {
-    PyObject *reprfmt;
-    Py_ssize_t len;
-    Py_ssize_t n;
-    PyObject *field;
-    PyObject *args;
+    namedtuple_fields *info;
+    Py_ssize_t fieldc;
+    PyObject *it;
+    Py_ssize_t hint;
     PyObject *ret;
+    Py_ssize_t count = 0;
+    PyObject *row;
+    PyObject *seq;
+    PyObject *instance;
+    int err;
 
-    if (!(reprfmt = PyObject_GetAttrString(self, "__reprfmt__"))) {
+    if (!(info = get_fields_info((PyTypeObject*) cls, cls))) {
         return NULL;
     }
+    fieldc = FIELDS_COUNT(info);
+    Py_DECREF(info);
 
-    if (!PyUnicode_CheckExact(reprfmt)) {
-        PyErr_SetString(PyExc_TypeError,
-                        "__reprfmt__ must be an instance of 'str'");
-        Py_DECREF(reprfmt);
+    if ((hint = PyObject_LengthHint(rows, 0)) < 0) {
         return NULL;
     }
-
-    len = PyTuple_GET_SIZE(self);
-    if (!(args = PyTuple_New(len + 1))) {
-        Py_DECREF(reprfmt);
+    if (!(it = PyObject_GetIter(rows))) {
         return NULL;
     }
+    if (!(ret = PyList_New(hint))) {
+        Py_DECREF(it);
+        return NULL;
+    }
+    /* Hide the list from the gc while it still has empty slots, iterating
+       `rows` may run arbitrary code. */
+    PyObject_GC_UnTrack(ret);
+
+    while ((row = PyIter_Next(it))) {
+        if (PyTuple_CheckExact(row) || PyList_CheckExact(row)) {
+            seq = row;
+        }
+        else {
+            seq = PySequence_Fast(row, "rows must be iterables");
+            Py_DECREF(row);
+            if (!seq) {
+                goto error;
+            }
+        }
+
+        if (PySequence_Fast_GET_SIZE(seq) != fieldc) {
+            PyErr_Format(PyExc_TypeError,
+                         "Expected %zd arguments, got %zd (row %zd)",
+                         fieldc,
+                         PySequence_Fast_GET_SIZE(seq),
+                         count);
+            Py_DECREF(seq);
+            goto error;
+        }
 
-    PyTuple_SET_ITEM(args, 0, ((PyHeapTypeObject*) self->ob_type)->ht_name);
-    Py_INCREF(((PyHeapTypeObject*) self->ob_type)->ht_name);
+        instance = namedtuple_from_array((PyTypeObject*) cls,
+                                         PySequence_Fast_ITEMS(seq),
+                                         fieldc);
+        Py_DECREF(seq);
+        if (!instance) {
+            goto error;
+        }
 
-    for (n = 1;n < len + 1;++n) {
-        field = PyTuple_GET_ITEM(self, n - 1);
-        Py_INCREF(field);
-        PyTuple_SET_ITEM(args, n, field);
+        if (count < hint) {
+            PyList_SET_ITEM(ret, count, instance);
+        }
+        else {
+            err = PyList_Append(ret, instance);
+            Py_DECREF(instance);
+            if (err) {
+                goto error;
+            }
+        }
+        ++count;
+    }
+    if (PyErr_Occurred()) {
+        goto error;
     }
+    Py_DECREF(it);
 
-    ret = PyUnicode_Format(reprfmt, args);
-    Py_DECREF(reprfmt);
-    Py_DECREF(args);
+    /* The length hint was too large, drop the unused slots. */
+    if (count < hint && PyList_SetSlice(ret, count, hint, NULL)) {
+        Py_DECREF(ret);
+        return NULL;
+    }
+    PyObject_GC_Track(ret);
     return ret;
+
+error:
+    Py_DECREF(it);
+    Py_DECREF(ret);
+    return NULL;
 }
 
-/* Converts self into a dict.
-   return: A new dict or NULL in case of error. */
-PyObject *
-namedtuple__asdict(PyObject *self, PyObject *_)
+/* Namedtuple class method for creating a list of new instances from
+   parallel columns. The columns are matched to the fields like the arguments
+   to the constructor and the rows are read out of them in a single pass.
+   return: A new list or NULL in case of error. */
+static PyObject *
+namedtuple__from_columns(PyObject *cls, PyObject *args, PyObject *kwargs)
 {
-    Py_ssize_t n;
-    PyObject *fields;
+    namedtuple_fields *info;
     Py_ssize_t fieldc;
-    PyObject *args;
-    PyObject *ret;
-    PyObject *asdict;
+    Py_ssize_t nargs = PyTuple_GET_SIZE(args);
+    Py_ssize_t nkwargs = (kwargs) ? PyDict_Size(kwargs) : 0;
+    PyObject **columns = NULL;
+    PyObject **row = NULL;
+    PyObject *column;
+    Py_ssize_t nrows = 0;
+    Py_ssize_t n;
+    Py_ssize_t ix;
+    PyObject *ret = NULL;
+    PyObject *instance;
 
-    if (!(fields = get_fields(self))) {
+    if (!(info = get_fields_info((PyTypeObject*) cls, cls))) {
         return NULL;
     }
-    fieldc = PyTuple_GET_SIZE(fields);
+    fieldc = FIELDS_COUNT(info);
 
-    if (!(args = PyTuple_New(fieldc))) {
-        Py_DECREF(fields);
+    if (nargs + nkwargs != fieldc) {
+        PyErr_Format(PyExc_TypeError,
+                     "_from_columns expected %zd column%s (%zd given)",
+                     fieldc,
+                     (fieldc == 1) ? "" : "s",
+                     nargs + nkwargs);
+        Py_DECREF(info);
         return NULL;
     }
+
+    if (!(columns = PyMem_Calloc(fieldc + 1, sizeof(PyObject*))) ||
+        !(row = PyMem_Malloc((fieldc + 1) * sizeof(PyObject*)))) {
+        PyErr_NoMemory();
+        goto done;
+    }
+
     for (n = 0;n < fieldc;++n) {
-        if (!(ret = PyTuple_Pack(2,
-                                 PyTuple_GET_ITEM(fields, n),
-                                 PyTuple_GET_ITEM(self, n)))) {
-            Py_DECREF(args);
-            Py_DECREF(fields);
-            return NULL;
+        if (n < nargs) {
+            column = PyTuple_GET_ITEM(args, n);
+        }
+        else if (!(column = _PyDict_GetItem_KnownHash(kwargs,
+                                                      FIELDS_NAME(info, n),
+                                                      info->fi_hashes[n]))) {
+            if (!PyErr_Occurred()) {
+                /* `nargs + nkwargs == fieldc`, so a missing field means that
+                   some keyword did not name a field. */
+                PyErr_Format(PyExc_TypeError,
+                             "Required column '%U' (pos %zd) not found",
+                             FIELDS_NAME(info, n),
+                             n + 1);
+            }
+            goto done;
+        }
+
+        if (!(columns[n] = PySequence_Fast(column,
+                                           "columns must be iterables"))) {
+            goto done;
+        }
+        if (!n) {
+            nrows = PySequence_Fast_GET_SIZE(columns[n]);
+        }
+        else if (PySequence_Fast_GET_SIZE(columns[n]) != nrows) {
+            PyErr_Format(PyExc_ValueError,
+                         "column '%U' has length %zd, expected %zd",
+                         FIELDS_NAME(info, n),
+                         PySequence_Fast_GET_SIZE(columns[n]),
+                         nrows);
+            goto done;
         }
-        PyTuple_SET_ITEM(args, n, ret);
     }
-    Py_DECREF(fields);
 
-    if (!(asdict = PyObject_GetAttrString(self, "__asdict__"))) {
-        Py_DECREF(args);
-        return NULL;
+    if (!(ret = PyList_New(nrows))) {
+        goto done;
+    }
+    /* Hide the list from the gc while it still has empty slots, a `__new__`
+       override may run arbitrary code. */
+    PyObject_GC_UnTrack(ret);
+
+    for (ix = 0;ix < nrows;++ix) {
+        for (n = 0;n < fieldc;++n) {
+            if (PySequence_Fast_GET_SIZE(columns[n]) != nrows) {
+                /* A `__new__` override resized one of the columns. */
+                PyErr_SetString(PyExc_RuntimeError,
+                                "column changed size during iteration");
+                Py_CLEAR(ret);
+                goto done;
+            }
+            row[n] = PySequence_Fast_ITEMS(columns[n])[ix];
+        }
+        if (!(instance = namedtuple_from_array((PyTypeObject*) cls,
+                                               row,
+                                               fieldc))) {
+            Py_CLEAR(ret);
+            goto done;
+        }
+        PyList_SET_ITEM(ret, ix, instance);
     }
+    PyObject_GC_Track(ret);
 
-    ret = PyObject_CallFunctionObjArgs(asdict, args, NULL);
-    Py_DECREF(asdict);
-    Py_DECREF(args);
+done:
+    if (columns) {
+        for (n = 0;n < fieldc;++n) {
+            Py_XDECREF(columns[n]);
+        }
+    }
+    PyMem_Free(columns);
+    PyMem_Free(row);
+    Py_DECREF(info);
     return ret;
 }
 
-/* Pickle and copy protocol.
-   return: self as a plain tuple or NULL in case of error. */
+/* Construct the `fields` tuple from the input `field_names`. A str is split
+   on commas and whitespace, like `field_names.replace(',', ' ').split()`,
+   without building the intermediate strings. The items of any other
+   iterable are converted with `str`.
+   return: A new tuple or NULL in case of error. */
 static PyObject *
-namedtuple_getnewargs(PyObject *self, PyObject *_)
+build_fields(PyObject *field_names)
 {
-    return PySequence_Tuple(self);
+    PyObject *seq;
+    PyObject *fields;
+    PyObject *field;
+    void *data;
+    int kind;
+    Py_ssize_t len;
+    Py_ssize_t start;
+    Py_ssize_t ix;
+    Py_ssize_t n;
+
+    if (PyUnicode_Check(field_names)) {
+        if (PyUnicode_READY(field_names)) {
+            return NULL;
+        }
+        kind = PyUnicode_KIND(field_names);
+        data = PyUnicode_DATA(field_names);
+        len = PyUnicode_GET_LENGTH(field_names);
+
+#define IS_FIELD_SEP(ch) ((ch) == ',' || Py_UNICODE_ISSPACE(ch))
+        /* Count the names so that the tuple is built at its final size. */
+        n = 0;
+        for (ix = 0;ix < len;++ix) {
+            if (!IS_FIELD_SEP(PyUnicode_READ(kind, data, ix)) &&
+                (!ix || IS_FIELD_SEP(PyUnicode_READ(kind, data, ix - 1)))) {
+                ++n;
+            }
+        }
+        if (!(fields = PyTuple_New(n))) {
+            return NULL;
+        }
+        n = 0;
+        for (ix = 0;ix < len;) {
+            while (ix < len && IS_FIELD_SEP(PyUnicode_READ(kind, data, ix))) {
+                ++ix;
+            }
+            if (ix == len) {
+                break;
+            }
+            start = ix;
+            while (ix < len && !IS_FIELD_SEP(PyUnicode_READ(kind, data, ix))) {
+                ++ix;
+            }
+            if (!(field = PyUnicode_Substring(field_names, start, ix))) {
+                Py_DECREF(fields);
+                return NULL;
+            }
+            PyTuple_SET_ITEM(fields, n++, field);
+        }
+#undef IS_FIELD_SEP
+        return fields;
+    }
+
+    if (!(seq = PySequence_Fast(field_names,
+                                "field_names must be a sequence"))) {
+        return NULL;
+    }
+    len = PySequence_Fast_GET_SIZE(seq);
+    if (!(fields = PyTuple_New(len))) {
+        Py_DECREF(seq);
+        return NULL;
+    }
+    for (n = 0;n < len;++n) {
+        field = PySequence_Fast_GET_ITEM(seq, n);
+        if (PyUnicode_CheckExact(field)) {
+            Py_INCREF(field);
+        }
+        else if (!(field = PyObject_Str(field))) {
+            Py_DECREF(seq);
+            Py_DECREF(fields);
+            return NULL;
+        }
+        PyTuple_SET_ITEM(fields, n, field);
+    }
+    Py_DECREF(seq);
+    return fields;
 }
 
-/* Pass function for the pickle and copy protocol.
-   return: Py_None. */
-static PyObject *
-namedtuple_getstate(PyObject *self, PyObject *_)
+/* Check `record`, found at `ix` in a sequence of records, before reading
+   fields of it up to `maxix` directly.
+   return: Zero if `record` is an instance of `cls` with enough fields,
+   nonzero with an exception set otherwise. */
+static int
+check_record(PyTypeObject *cls,
+             PyObject *record,
+             Py_ssize_t ix,
+             Py_ssize_t maxix)
 {
-    Py_RETURN_NONE;
+    if (Py_TYPE(record) != cls && !PyObject_TypeCheck(record, cls)) {
+        PyErr_Format(PyExc_TypeError,
+                     "expected %s instance, got %s (record %zd)",
+                     cls->tp_name,
+                     Py_TYPE(record)->tp_name,
+                     ix);
+        return -1;
+    }
+    if (PyTuple_GET_SIZE(record) <= maxix) {
+        PyErr_Format(PyExc_ValueError,
+                     "record %zd has %zd fields, expected at least %zd",
+                     ix,
+                     PyTuple_GET_SIZE(record),
+                     maxix + 1);
+        return -1;
+    }
+    return 0;
 }
 
-/* Pickle protocol for extension types.
-   return: A tuple `(type(self),tuple(self))` or NULL in case of an error. */
+/* Read the fields at `indices` out of every instance of `cls` in `records`.
+   return: A new tuple holding one list per index or NULL in case of error. */
 static PyObject *
-namedtuple_reduce_ex(PyObject *self,PyObject *_)
+records_to_columns(PyTypeObject *cls,
+                   PyObject *records,
+                   const Py_ssize_t *indices,
+                   Py_ssize_t ncolumns)
 {
-    PyObject *astuple = PySequence_Tuple(self);
+    PyObject *seq;
+    PyObject **items;
+    Py_ssize_t nrecords;
     PyObject *ret;
+    PyObject *column;
+    PyObject *record;
+    PyObject *item;
+    Py_ssize_t maxix = -1;
+    Py_ssize_t ix;
+    Py_ssize_t n;
 
-    if (!astuple) {
+    if (!(seq = PySequence_Fast(records, "records must be iterable"))) {
         return NULL;
     }
+    nrecords = PySequence_Fast_GET_SIZE(seq);
+    items = PySequence_Fast_ITEMS(seq);
 
-    ret = PyTuple_Pack(2, self->ob_type, astuple);
-    Py_DECREF(astuple);
-    return ret;
-}
-
-static int
-namedtuple_traverse(PyTupleObject *self, visitproc visit, void *arg)
-{
-    Py_ssize_t n;
+    if (!(ret = PyTuple_New(ncolumns))) {
+        Py_DECREF(seq);
+        return NULL;
+    }
+    for (n = 0;n < ncolumns;++n) {
+        if (!(column = PyList_New(nrecords))) {
+            goto error;
+        }
+        PyTuple_SET_ITEM(ret, n, column);
+        if (indices[n] > maxix) {
+            maxix = indices[n];
+        }
+    }
 
-    for (n = PyTuple_GET_SIZE(self);--n >= 0;) {
-        Py_VISIT(PyTuple_GET_ITEM(self, n));
+    for (ix = 0;ix < nrecords;++ix) {
+        record = items[ix];
+        if (check_record(cls, record, ix, maxix)) {
+            goto error;
+        }
+        for (n = 0;n < ncolumns;++n) {
+            item = PyTuple_GET_ITEM(record, indices[n]);
+            Py_INCREF(item);
+            PyList_SET_ITEM(PyTuple_GET_ITEM(ret, n), ix, item);
+        }
     }
-    return 0;
+
+    Py_DECREF(seq);
+    return ret;
+
+error:
+    Py_DECREF(seq);
+    Py_DECREF(ret);
+    return NULL;
 }
 
-/* The `__dict__` of namedtuple types is the `__asdict__` type holding all
-   of the fields.
-   return: A new dict or NULL in case of error. */
+/* Namedtuple class method for splitting a sequence of instances into one list
+   per field.
+   return: A new tuple of lists or NULL in case of error. */
 static PyObject *
-namedtuple_get_dict(PyObject *self, void *_)
+namedtuple__to_columns(PyObject *cls, PyObject *args, PyObject *kwargs)
 {
-    PyObject *asdict = PyObject_GetAttrString(self, "__asdict__");
+    const char * const argnames[] = {"records", "fields", NULL};
+    PyObject *records;
+    PyObject *fields = Py_None;
+    namedtuple_fields *info;
+    Py_ssize_t *indices = NULL;
+    Py_ssize_t ncolumns;
     Py_ssize_t n;
-    PyObject *fields;
-    Py_ssize_t fieldc;
-    PyObject *arg;
-    PyObject *tmp;
+    PyObject *ret = NULL;
 
-    if (!asdict) {
+    if (!PyArg_ParseTupleAndKeywords(args,
+                                     kwargs,
+                                     "O|O:_to_columns",
+                                     (char**) argnames,
+                                     &records,
+                                     &fields)) {
         return NULL;
     }
 
-    if (!(fields = get_fields(self))) {
+    if (!(info = get_fields_info((PyTypeObject*) cls, cls))) {
         return NULL;
     }
 
-    fieldc = PyTuple_GET_SIZE(fields);
-    if (!(arg = PyTuple_New(fieldc))) {
-        Py_DECREF(fields);
+    if (fields == Py_None) {
+        fields = info->fi_fields;
+        Py_INCREF(fields);
+    }
+    /* Accept the same spellings as the `field_names` given to `namedtuple`. */
+    else if (!(fields = build_fields(fields))) {
+        Py_DECREF(info);
         return NULL;
     }
 
-    /* Construct an assoc list of ((field . value)) to pass to
-       the `__asdict__` constructor. */
-    for (n = 0;n < fieldc;++n) {
-        if (!(tmp = PyTuple_Pack(2,
-                                 PyTuple_GET_ITEM(fields, n),
-                                 PyTuple_GET_ITEM(self, n)))) {
-            Py_DECREF(arg);
-            Py_DECREF(fields);
-            return NULL;
+    ncolumns = PyTuple_GET_SIZE(fields);
+    if (!(indices = PyMem_Malloc((ncolumns + 1) * sizeof(Py_ssize_t)))) {
+        PyErr_NoMemory();
+        goto done;
+    }
+    for (n = 0;n < ncolumns;++n) {
+        if ((indices[n] = require_field(info,
+                                        PyTuple_GET_ITEM(fields, n))) < 0) {
+            goto done;
         }
-
-        PyTuple_SET_ITEM(arg, n, tmp);
     }
 
-    tmp = PyObject_CallFunctionObjArgs(asdict, arg, NULL);
-    Py_DECREF(arg);
+    ret = records_to_columns((PyTypeObject*) cls, records, indices, ncolumns);
+
+done:
+    PyMem_Free(indices);
     Py_DECREF(fields);
-    return tmp;
+    Py_DECREF(info);
+    return ret;
 }
 
-PyDoc_STRVAR(_make_doc,
-"_make(iterable) -> namedtuple\n\n"
-"Create an instance of this class from an iterable.");
+/* Namedtuple class method for reading one field out of a sequence of
+   instances.
+   return: A new list or NULL in case of error. */
+static PyObject *
+namedtuple__pluck(PyObject *cls, PyObject *args, PyObject *kwargs)
+{
+    const char * const argnames[] = {"records", "field", NULL};
+    PyObject *records;
+    PyObject *field;
+    namedtuple_fields *info;
+    Py_ssize_t ix;
+    PyObject *columns;
+    PyObject *ret;
 
-PyDoc_STRVAR(_replace_doc,
-"_replace(field=new_value, ...) -> new namedtuple\n\n"
-"Returns a new namedtuple with the specified fields replaced.");
-
-PyDoc_STRVAR(_asdict_doc,
-"_asdict() -> dict\n\n"
-"Converts this namedtuple into a dictionary that maps fields to values");
-
-PyDoc_STRVAR(__getnewargs___doc,
-"__getnewargs__() -> tuple\n\n"
-"Return self as a plain tuple. Used by copy and pickle.");
-
-PyDoc_STRVAR(__getstate___doc,
-"__getstate__() -> None\n\n"
-"Exclude the OrderedDict from pickling.");
+    if (!PyArg_ParseTupleAndKeywords(args,
+                                     kwargs,
+                                     "OO:_pluck",
+                                     (char**) argnames,
+                                     &records,
+                                     &field)) {
+        return NULL;
+    }
 
-PyDoc_STRVAR(__reduce_ex___doc,
-"__reduce_ex__() -> (type(self), tuple(self))\n\n"
-"Returns the pair of the type of the instance with the instance cast to\n"
-"a tuple.");
+    if (!(info = get_fields_info((PyTypeObject*) cls, cls))) {
+        return NULL;
+    }
+    ix = require_field(info, field);
+    Py_DECREF(info);
+    if (ix < 0) {
+        return NULL;
+    }
 
-PyMethodDef namedtuple_methods[] = {
-    {"_make",
-     (PyCFunction) namedtuple__make,
-     METH_CLASS | METH_VARARGS | METH_KEYWORDS,
-     _make_doc},
-    {"_replace",
-     (PyCFunction) namedtuple__replace,
-     METH_VARARGS | METH_KEYWORDS,
-     _replace_doc},
-    {"_asdict",
-     (PyCFunction) namedtuple__asdict,
-     METH_NOARGS,
-     _asdict_doc},
-    {"__getnewargs__",
-     (PyCFunction) namedtuple_getnewargs,
-     METH_NOARGS,
-     __getnewargs___doc},
-    {"__getstate__",
-     namedtuple_getstate,
-     METH_NOARGS,
-     __getstate___doc},
-    {"__reduce_ex__",
-     namedtuple_reduce_ex,
-     METH_O,
-     __reduce_ex___doc},
-    {NULL},
-};
+    if (!(columns = records_to_columns((PyTypeObject*) cls,
+                                       records,
+                                       &ix,
+                                       1))) {
+        return NULL;
+    }
+    ret = PyTuple_GET_ITEM(columns, 0);
+    Py_INCREF(ret);
+    Py_DECREF(columns);
+    return ret;
+}
 
-/* Construct the `fields` tuple from the input `field_names`. */
-static PyObject *
-build_fields(PyObject *field_names)
+/* Resolve the field names in the tuple `names` to indices. If `reverse` is
+   nonzero a name may start with '-' to sort that field in descending order,
+   which is stored as the bitwise complement of the index.
+   return: Zero on success, nonzero on failure. */
+static int
+resolve_sort_keys(namedtuple_fields *info,
+                  PyObject *names,
+                  int reverse,
+                  Py_ssize_t *indices,
+                  Py_ssize_t *maxix)
 {
-    PyObject  *tmp_fields;
-    PyObject  *fast_fields;
-    PyObject  *fields;
-    PyObject  *with_replace;
-    PyObject  *as_str;
-    PyObject  *comma;
-    PyObject  *space;
     Py_ssize_t n;
+    PyObject *name;
     Py_ssize_t len;
-
-    /* If the `field_names` is a `str`, then we will replace all ',' with ' '
-       and then split it on whitespace to get the sequence of fields. */
-    if (PyUnicode_Check(field_names)) {
-        if (!(comma = PyUnicode_InternFromString(","))) {
-            return NULL;
+    int descending;
+
+    *maxix = -1;
+    for (n = 0;n < PyTuple_GET_SIZE(names);++n) {
+        name = PyTuple_GET_ITEM(names, n);
+        descending = 0;
+        if (reverse &&
+            PyUnicode_Check(name) &&
+            !PyUnicode_READY(name) &&
+            (len = PyUnicode_GET_LENGTH(name)) > 1 &&
+            PyUnicode_READ_CHAR(name, 0) == '-') {
+            if (!(name = PyUnicode_Substring(name, 1, len))) {
+                return -1;
+            }
+            descending = 1;
         }
-        if (!(space = PyUnicode_InternFromString(" "))) {
-            Py_DECREF(comma);
-            return NULL;
+        else {
+            Py_INCREF(name);
         }
-
-        /* Replace all instances of ',' with ' '. */
-        with_replace = PyUnicode_Replace(field_names, comma, space, -1);
-        Py_DECREF(comma);
-        Py_DECREF(space);
-
-        if (!with_replace) {
-            return NULL;
+        indices[n] = require_field(info, name);
+        Py_DECREF(name);
+        if (indices[n] < 0) {
+            return -1;
         }
-
-        // Split the field names into a tuple around all whitespace.
-        tmp_fields = PyUnicode_Split(with_replace, NULL, -1);
-        Py_DECREF(with_replace);
-
-        if (!tmp_fields) {
-            return NULL;
+        if (indices[n] > *maxix) {
+            *maxix = indices[n];
+        }
+        if (descending) {
+            indices[n] = ~indices[n];
         }
     }
-    else {
-        /* The `field_names` is a sequence already, just convert it into a
-           tuple. */
-        if (!(tmp_fields = PySequence_Tuple(field_names))) {
-            return NULL;
+    return 0;
+}
+
+/* A callable that reads some fields of a namedtuple type, created with `_key`
+   or `_getter`. The indices are resolved once so that calls read the fields
+   directly. */
+typedef struct{
+    PyObject_VAR_HEAD
+    PyTypeObject *ng_type;      /* The type whose fields are read. */
+    PyObject *ng_fields;        /* The names of the fields that are read. */
+    PyTypeObject *ng_result;    /* The projection type to build, or NULL to
+                                   build a tuple. */
+    int ng_key;                 /* Nonzero if built by `_key`, which returns
+                                   a single field as it is. */
+#if PY_VERSION_HEX >= 0x03090000
+    vectorcallfunc ng_vectorcall;
+#endif
+    Py_ssize_t ng_maxix;        /* The largest index in `ng_indices`. */
+    Py_ssize_t ng_indices[1];   /* The index of each field that is read. */
+}namedtuple_getter;
+
+PyTypeObject namedtuple_getter_type;
+
+#define GETTER_COUNT(self) Py_SIZE(self)
+
+/* return: A new reference to the fields of `record` read by `self` or NULL on
+   failure. */
+static PyObject *
+namedtuple_getter_get(namedtuple_getter *self, PyObject *record)
+{
+    int fast = (PyTuple_Check(record) &&
+                PyTuple_GET_SIZE(record) > self->ng_maxix);
+    Py_ssize_t n;
+    PyObject *item;
+    PyObject *ret;
+
+    if (self->ng_key && GETTER_COUNT(self) == 1) {
+        if (fast) {
+            item = PyTuple_GET_ITEM(record, self->ng_indices[0]);
+            Py_INCREF(item);
+            return item;
         }
+        /* Typed namedtuples box the field on access. */
+        return PySequence_GetItem(record, self->ng_indices[0]);
     }
 
-    fast_fields = PySequence_Fast(tmp_fields, "field_names must be a sequence");
-    Py_DECREF(tmp_fields);
-    if (!fast_fields) {
+    /* The projection type is always created by `namedtuple`, so it is filled
+       like a tuple. */
+    if (!(ret = (self->ng_result) ?
+          self->ng_result->tp_alloc(self->ng_result, GETTER_COUNT(self)) :
+          PyTuple_New(GETTER_COUNT(self)))) {
         return NULL;
     }
-    len = PySequence_Fast_GET_SIZE(fast_fields);
-    fields = PyTuple_New(len);
-
-    for (n = 0;n < len;++n) {
-        if (!(as_str =
-              PyObject_Str(PySequence_Fast_GET_ITEM(fast_fields, n)))) {
-            Py_DECREF(tmp_fields);
-            Py_DECREF(fields);
+    for (n = 0;n < GETTER_COUNT(self);++n) {
+        if (fast) {
+            item = PyTuple_GET_ITEM(record, self->ng_indices[n]);
+            Py_INCREF(item);
+        }
+        else if (!(item = PySequence_GetItem(record, self->ng_indices[n]))) {
+            Py_DECREF(ret);
             return NULL;
         }
-        PyTuple_SET_ITEM(fields, n, as_str);
+        PyTuple_SET_ITEM(ret, n, item);
     }
-
-    Py_DECREF(tmp_fields);
-    return fields;
+    return ret;
 }
 
-/* A type to indicate the results of checking a field or type name */
-typedef enum{
-    CHECKFIELD_VALID      = 0,
-    CHECKFIELD_EMPTY      = 1,
-    CHECKFIELD_DIGIT      = 2,
-    CHECKFIELD_UNDERSCORE = 3,
-    CHECKFIELD_NONALNUM   = 4,
-    CHECKFIELD_KEYWORD    = 5,
-    CHECKFIELD_NOTREADY   = 6,
-}nt_checkfield;
-
-/* Checks the field against the various rules for invalid names.
-   return: An `nt_checkfield` indicating the result. */
-static nt_checkfield
-checkfield(PyObject *iskeyword, PyObject *field)
+/* return: Zero if the call has exactly one positional argument, nonzero with
+   a `TypeError` set otherwise. */
+static int
+namedtuple_getter_check_args(Py_ssize_t nargs, Py_ssize_t nkwargs)
 {
-    void      *data;
-    int        kind;
-    Py_UCS4    ch;
-    Py_ssize_t idx;
-    PyObject  *iskwd_obj;
-    int        iskwd;
+    if (nkwargs) {
+        PyErr_SetString(PyExc_TypeError,
+                        "getters take no keyword arguments");
+        return -1;
+    }
+    if (nargs != 1) {
+        PyErr_Format(PyExc_TypeError,
+                     "getters take exactly one argument (%zd given)",
+                     nargs);
+        return -1;
+    }
+    return 0;
+}
 
-    if (PyUnicode_READY(field)) {
-        return CHECKFIELD_NOTREADY;
+static PyObject *
+namedtuple_getter_call(namedtuple_getter *self,
+                       PyObject *args,
+                       PyObject *kwargs)
+{
+    if (namedtuple_getter_check_args(PyTuple_GET_SIZE(args),
+                                     (kwargs) ? PyDict_GET_SIZE(kwargs) : 0)) {
+        return NULL;
     }
+    return namedtuple_getter_get(self, PyTuple_GET_ITEM(args, 0));
+}
 
-    if (!PyUnicode_GET_LENGTH(field)) {
-        /* Empty name. */
-        return CHECKFIELD_EMPTY;
+#if PY_VERSION_HEX >= 0x03090000
+/* `sorted`, `heapq`, `bisect` and `map` call the getter through vectorcall,
+   which does not need an argument tuple. */
+static PyObject *
+namedtuple_getter_vectorcall(PyObject *self,
+                             PyObject *const *args,
+                             size_t nargsf,
+                             PyObject *kwnames)
+{
+    if (namedtuple_getter_check_args(PyVectorcall_NARGS(nargsf),
+                                     (kwnames) ?
+                                     PyTuple_GET_SIZE(kwnames) :
+                                     0)) {
+        return NULL;
     }
+    return namedtuple_getter_get((namedtuple_getter*) self, args[0]);
+}
+#endif
 
-    kind = PyUnicode_KIND(field);
-    data = PyUnicode_DATA(field);
-    ch = PyUnicode_READ(kind, data, 0);
+static int
+namedtuple_getter_traverse(namedtuple_getter *self,
+                           visitproc visit,
+                           void *arg)
+{
+    Py_VISIT(self->ng_type);
+    Py_VISIT(self->ng_result);
+    return 0;
+}
 
-    if (Py_UNICODE_ISDIGIT(ch)) {
-        /* Cannot start with digit. */
-        return CHECKFIELD_DIGIT;
-    }
-    else if (ch == (Py_UCS4) '_') {
-        /* Cannot start with '_'. */
-        return CHECKFIELD_UNDERSCORE;
-    }
+static void
+namedtuple_getter_dealloc(namedtuple_getter *self)
+{
+    PyObject_GC_UnTrack(self);
+    Py_CLEAR(self->ng_type);
+    Py_CLEAR(self->ng_fields);
+    Py_CLEAR(self->ng_result);
+    PyObject_GC_Del(self);
+}
 
+static PyObject *
+namedtuple_getter_repr(namedtuple_getter *self)
+{
+    PyObject *sep;
+    PyObject *reprs;
+    PyObject *item;
+    PyObject *joined;
+    PyObject *ret = NULL;
+    Py_ssize_t n;
 
-    idx = PyUnicode_GET_LENGTH(field);
-    while (idx--) {
-        ch = PyUnicode_READ(kind, data, idx);
-        if (!(Py_UNICODE_ISALNUM(ch) || ch == (Py_UCS4) '_')) {
-            /* Must be all alphanumeric characters or underscores. */
-            return CHECKFIELD_NONALNUM;
+    if (!(reprs = PyTuple_New(GETTER_COUNT(self)))) {
+        return NULL;
+    }
+    for (n = 0;n < GETTER_COUNT(self);++n) {
+        if (!(item = PyObject_Repr(PyTuple_GET_ITEM(self->ng_fields, n)))) {
+            Py_DECREF(reprs);
+            return NULL;
         }
+        PyTuple_SET_ITEM(reprs, n, item);
+    }
+    if (!(sep = PyUnicode_FromString(", "))) {
+        Py_DECREF(reprs);
+        return NULL;
     }
+    joined = PyUnicode_Join(sep, reprs);
+    Py_DECREF(sep);
+    Py_DECREF(reprs);
+    if (joined) {
+        ret = PyUnicode_FromFormat("%s.%s(%U%s)",
+                                   self->ng_type->tp_name,
+                                   (self->ng_key) ? "_key" : "_getter",
+                                   joined,
+                                   (self->ng_result) ? ", as_type=True" : "");
+        Py_DECREF(joined);
+    }
+    return ret;
+}
 
-    iskwd = ((iskwd_obj = PyObject_CallFunctionObjArgs(iskeyword,
-                                                       field,
-                                                       NULL)) &&
-             PyObject_IsTrue(iskwd_obj));
-    Py_XDECREF(iskwd_obj);
+/* Apply the getter to every record in an iterable.
+   return: A new list or NULL in case of error. */
+static PyObject *
+namedtuple_getter_map(namedtuple_getter *self, PyObject *records)
+{
+    PyObject *seq;
+    PyObject **items;
+    Py_ssize_t nrecords;
+    Py_ssize_t ix;
+    PyObject *item;
+    PyObject *ret;
 
-    if (iskwd) {
-        return CHECKFIELD_KEYWORD;
+    if (!(seq = PySequence_Fast(records, "map() argument must be iterable"))) {
+        return NULL;
     }
+    nrecords = PySequence_Fast_GET_SIZE(seq);
+    items = PySequence_Fast_ITEMS(seq);
 
-    return CHECKFIELD_VALID;
+    if (!(ret = PyList_New(nrecords))) {
+        Py_DECREF(seq);
+        return NULL;
+    }
+    for (ix = 0;ix < nrecords;++ix) {
+        if (!(item = namedtuple_getter_get(self, items[ix]))) {
+            Py_CLEAR(ret);
+            break;
+        }
+        PyList_SET_ITEM(ret, ix, item);
+    }
+    Py_DECREF(seq);
+    return ret;
 }
 
-/* Rename the `field_names` if they fail the various checks. This mutates
-   `fields` in place.
-   return: Zero on succes, nonzero on failure */
-static int
-rename_fields(PyObject *iskeyword, PyObject *fields)
+static PyObject *
+namedtuple_getter_get_type(namedtuple_getter *self, void *_)
 {
-    PyObject *seen;
-    PyObject *field;
-    Py_ssize_t fieldc = PyTuple_GET_SIZE(fields);
-    Py_ssize_t n;
-    int rename;
+    PyObject *ret = (self->ng_result) ? (PyObject*) self->ng_result : Py_None;
 
-    if (!(seen = PySet_New(NULL))) {
-        return -1;
-    }
+    Py_INCREF(ret);
+    return ret;
+}
 
-    /* Iterate over the fields, applying any renames if needed. */
-    for (n = 0;n < fieldc;++n) {
-        rename = 0;
-        field = PyTuple_GET_ITEM(fields, n);
+PyDoc_STRVAR(namedtuple_getter_map_doc,
+"map(records) -> list\n\n"
+"Apply the getter to every record in 'records'.");
 
-        if (checkfield(iskeyword, field)
-            != CHECKFIELD_VALID) {
-            // Invalid name for some reason.
-            rename = 1;
-        }
-        else {
-            /* Check if the name is in the set of seen names. */
-            switch(PySet_Contains(seen, field)) {
-            case 1:
-                rename = 1;
-                break;
-            case -1:
-                Py_DECREF(seen);
-                return -1;
-            }
-        }
+PyMethodDef namedtuple_getter_methods[] = {
+    {"map",
+     (PyCFunction) namedtuple_getter_map,
+     METH_O,
+     namedtuple_getter_map_doc},
+    {NULL},
+};
 
-        if (rename) {
-            Py_DECREF(field);
-            PyTuple_SET_ITEM(fields, n, NULL);
+PyGetSetDef namedtuple_getter_getsets[] = {
+    {"type",
+     (getter) namedtuple_getter_get_type,
+     NULL,
+     "The projection type built by the getter, None if it builds tuples."},
+    {NULL},
+};
 
-            if (!(field = PyUnicode_FromFormat("_%zu", n))) {
-                Py_DECREF(seen);
-                return -1;
-            }
-            PyTuple_SET_ITEM(fields, n, field);
-        }
+PyDoc_STRVAR(namedtuple_getter_doc,
+"A callable that reads some fields of a namedtuple. Created with\n"
+"'_key(*fields)' or '_getter(*fields, as_type=False)'.");
 
-        /* Add the name to the set of seen names. */
-        if (PySet_Add(seen, field)) {
-            Py_DECREF(seen);
-            return -1;
-        }
-    }
+PyTypeObject namedtuple_getter_type = {
+    PyVarObject_HEAD_INIT(&PyType_Type, 0)
+    "_collections.NamedTupleGetter",            /* tp_name */
+    offsetof(namedtuple_getter, ng_indices),    /* tp_basicsize */
+    sizeof(Py_ssize_t),                         /* tp_itemsize */
+    (destructor) namedtuple_getter_dealloc,     /* tp_dealloc */
+#if PY_VERSION_HEX >= 0x03090000
+    offsetof(namedtuple_getter, ng_vectorcall), /* tp_vectorcall_offset */
+#else
+    0,                                          /* tp_print */
+#endif
+    0,                                          /* tp_getattr */
+    0,                                          /* tp_setattr */
+    0,                                          /* tp_reserved */
+    (reprfunc) namedtuple_getter_repr,          /* tp_repr */
+    0,                                          /* tp_as_number */
+    0,                                          /* tp_as_sequence */
+    0,                                          /* tp_as_mapping */
+    0,                                          /* tp_hash */
+    (ternaryfunc) namedtuple_getter_call,       /* tp_call */
+    0,                                          /* tp_str */
+    PyObject_GenericGetAttr,                    /* tp_getattro */
+    0,                                          /* tp_setattro */
+    0,                                          /* tp_as_buffer */
+#if PY_VERSION_HEX >= 0x03090000
+    Py_TPFLAGS_DEFAULT | Py_TPFLAGS_HAVE_GC |
+    Py_TPFLAGS_HAVE_VECTORCALL,                 /* tp_flags */
+#else
+    Py_TPFLAGS_DEFAULT | Py_TPFLAGS_HAVE_GC,    /* tp_flags */
+#endif
+    namedtuple_getter_doc,                      /* tp_doc */
+    (traverseproc) namedtuple_getter_traverse,  /* tp_traverse */
+    0,                                          /* tp_clear */
+    0,                                          /* tp_richcompare */
+    0,                                          /* tp_weaklistoffset */
+    0,                                          /* tp_iter */
+    0,                                          /* tp_iternext */
+    namedtuple_getter_methods,                  /* tp_methods */
+    0,                                          /* tp_members */
+    namedtuple_getter_getsets,                  /* tp_getset */
+};
 
-    Py_DECREF(seen);
-    return 0;
+/* Build a getter over `fields` of `cls`, for `_key` if `key` is nonzero.
+   return: A new getter or NULL in case of error. */
+static namedtuple_getter *
+namedtuple_getter_new(PyTypeObject *cls, PyObject *fields, int key)
+{
+    Py_ssize_t nfields = PyTuple_GET_SIZE(fields);
+    namedtuple_fields *info;
+    namedtuple_getter *ret;
+
+    if (!nfields) {
+        PyErr_SetString(PyExc_TypeError,
+                        "expected at least one field name");
+        return NULL;
+    }
+    if (!(info = get_fields_info(cls, (PyObject*) cls))) {
+        return NULL;
+    }
+    if (!(ret = PyObject_GC_NewVar(namedtuple_getter,
+                                   &namedtuple_getter_type,
+                                   nfields))) {
+        Py_DECREF(info);
+        return NULL;
+    }
+    Py_INCREF(cls);
+    ret->ng_type = cls;
+    Py_INCREF(fields);
+    ret->ng_fields = fields;
+    ret->ng_result = NULL;
+    ret->ng_key = key;
+#if PY_VERSION_HEX >= 0x03090000
+    ret->ng_vectorcall = namedtuple_getter_vectorcall;
+#endif
+    PyObject_GC_Track(ret);
+
+    if (resolve_sort_keys(info, fields, 0, ret->ng_indices, &ret->ng_maxix)) {
+        Py_CLEAR(ret);
+    }
+    Py_DECREF(info);
+    return ret;
 }
 
-/* Process the `typename` and `field_names` for a `namedtuple`.
-   After this function is called (and no errors occur),
-   `field_names` will point to a new reference to a tuple of field names
-   that have been properly renamed and checked.
-   return: Zero on succes, nonzero on failure. */
-static int
-validate_field_names(PyObject *typename,
-                     PyObject **field_names,
-                     int rename,
-                     PyObject *iskeyword)
+/* Namedtuple class method for building a key function over some fields.
+   return: A new key function or NULL in case of error. */
+static PyObject *
+namedtuple__key(PyObject *cls, PyObject *fields)
+{
+    return (PyObject*) namedtuple_getter_new((PyTypeObject*) cls, fields, 1);
+}
+
+/* Defined with the `namedtuple` factory below. */
+static PyObject *
+cached_namedtuple_type(module_state *st,
+                       PyObject *typename,
+                       PyObject *field_names,
+                       int rename,
+                       PyObject *module_name,
+                       PyObject *types,
+                       int cache,
+                       int cache_hash);
+
+/* Create, or find in the type cache, the namedtuple type `<cls>_<fields>`
+   for the results of a getter over `fields` of `cls`.
+   return: A new reference to the type or NULL in case of error. */
+static PyTypeObject *
+projection_type(PyTypeObject *cls, PyObject *fields)
+{
+    PyObject *module;
+    PyObject *sep;
+    PyObject *joined;
+    PyObject *typename;
+    PyObject *module_name;
+    PyObject *ret = NULL;
+
+    if (!(module = PyState_FindModule(&_namedtuplemodule))) {
+        PyErr_SetString(PyExc_RuntimeError, "_namedtuple module not loaded");
+        return NULL;
+    }
+    if (!(sep = PyUnicode_FromString("_"))) {
+        return NULL;
+    }
+    joined = PyUnicode_Join(sep, fields);
+    Py_DECREF(sep);
+    if (!joined) {
+        return NULL;
+    }
+    typename = PyUnicode_FromFormat("%U_%U",
+                                    ((PyHeapTypeObject*) cls)->ht_name,
+                                    joined);
+    Py_DECREF(joined);
+    if (!typename) {
+        return NULL;
+    }
+    if ((module_name = PyObject_GetAttrString((PyObject*) cls,
+                                              "__module__"))) {
+        ret = cached_namedtuple_type(PyModule_GetState(module),
+                                     typename,
+                                     fields,
+                                     0,
+                                     module_name,
+                                     NULL,
+                                     1,
+                                     0);
+        Py_DECREF(module_name);
+    }
+    Py_DECREF(typename);
+    return (PyTypeObject*) ret;
+}
+
+/* Namedtuple class method for building a projection of some fields.
+   return: A new getter or NULL in case of error. */
+static PyObject *
+namedtuple__getter(PyObject *cls, PyObject *args, PyObject *kwargs)
+{
+    const char * const argnames[] = {"as_type", NULL};
+    PyObject *empty;
+    int as_type = 0;
+    namedtuple_getter *ret;
+
+    if (!(empty = PyTuple_New(0))) {
+        return NULL;
+    }
+    if (!PyArg_ParseTupleAndKeywords(empty,
+                                     kwargs,
+                                     "|$p:_getter",
+                                     (char**) argnames,
+                                     &as_type)) {
+        Py_DECREF(empty);
+        return NULL;
+    }
+    Py_DECREF(empty);
+
+    if (!(ret = namedtuple_getter_new((PyTypeObject*) cls, args, 0))) {
+        return NULL;
+    }
+    if (as_type &&
+        !(ret->ng_result = projection_type((PyTypeObject*) cls, args))) {
+        Py_CLEAR(ret);
+    }
+    return (PyObject*) ret;
+}
+
+/* How `group_records` stores the records under their keys. */
+typedef enum{
+    GROUP_LAST,     /* The last record with a key, like `{r.id: r}`. */
+    GROUP_UNIQUE,   /* The only record with a key, duplicates are an error. */
+    GROUP_LIST,     /* A list of all records with a key, in order. */
+}group_kind;
+
+/* Map the key read from each instance of `cls` in `records` to the records
+   with that key. `args` holds the records followed by the fields of the key,
+   which is the field itself for one field or a tuple of the fields
+   otherwise.
+   return: A new dict or NULL in case of error. */
+static PyObject *
+group_records(PyTypeObject *cls,
+              PyObject *args,
+              const char *name,
+              group_kind kind)
+{
+    PyObject *fields;
+    namedtuple_getter *getter;
+    PyObject *seq;
+    PyObject *record;
+    PyObject *key;
+    PyObject *group;
+    Py_ssize_t size;
+    Py_ssize_t ix;
+    int err;
+    PyObject *ret;
+
+    if (!PyTuple_GET_SIZE(args)) {
+        PyErr_Format(PyExc_TypeError,
+                     "%s() missing required argument 'records' (pos 1)",
+                     name);
+        return NULL;
+    }
+    if (!(fields = PyTuple_GetSlice(args, 1, PY_SSIZE_T_MAX))) {
+        return NULL;
+    }
+    getter = namedtuple_getter_new(cls, fields, 1);
+    Py_DECREF(fields);
+    if (!getter) {
+        return NULL;
+    }
+    if (!(seq = PySequence_Fast(PyTuple_GET_ITEM(args, 0),
+                                "records must be iterable"))) {
+        Py_DECREF(getter);
+        return NULL;
+    }
+    if (!(ret = PyDict_New())) {
+        goto done;
+    }
+
+    /* Hashing and comparing the keys may run arbitrary code which changes
+       `seq`, so the size is read again and each record is held while it is
+       stored. */
+    for (ix = 0;ix < PySequence_Fast_GET_SIZE(seq);++ix) {
+        record = PySequence_Fast_GET_ITEM(seq, ix);
+        if (check_record(cls, record, ix, getter->ng_maxix)) {
+            goto error;
+        }
+        Py_INCREF(record);
+        if (!(key = namedtuple_getter_get(getter, record))) {
+            Py_DECREF(record);
+            goto error;
+        }
+        switch (kind) {
+        case GROUP_LAST:
+            err = PyDict_SetItem(ret, key, record);
+            break;
+        case GROUP_UNIQUE:
+            size = PyDict_GET_SIZE(ret);
+            if (!(err = !PyDict_SetDefault(ret, key, record)) &&
+                PyDict_GET_SIZE(ret) == size) {
+                PyErr_Format(PyExc_ValueError,
+                             "duplicate key %R (record %zd)",
+                             key,
+                             ix);
+                err = -1;
+            }
+            break;
+        case GROUP_LIST:
+            if (!(group = PyDict_GetItemWithError(ret, key))) {
+                if (PyErr_Occurred() || !(group = PyList_New(0))) {
+                    err = -1;
+                    break;
+                }
+                err = PyDict_SetItem(ret, key, group);
+                Py_DECREF(group);
+                if (err) {
+                    break;
+                }
+            }
+            err = PyList_Append(group, record);
+            break;
+        }
+        Py_DECREF(key);
+        Py_DECREF(record);
+        if (err) {
+            goto error;
+        }
+    }
+
+done:
+    Py_DECREF(seq);
+    Py_DECREF(getter);
+    return ret;
+
+error:
+    Py_CLEAR(ret);
+    goto done;
+}
+
+/* Namedtuple class method for indexing records by some fields.
+   return: A new dict or NULL in case of error. */
+static PyObject *
+namedtuple__index(PyObject *cls, PyObject *args, PyObject *kwargs)
+{
+    const char * const argnames[] = {"unique", NULL};
+    PyObject *empty;
+    int unique = 0;
+
+    if (!(empty = PyTuple_New(0))) {
+        return NULL;
+    }
+    if (!PyArg_ParseTupleAndKeywords(empty,
+                                     kwargs,
+                                     "|$p:_index",
+                                     (char**) argnames,
+                                     &unique)) {
+        Py_DECREF(empty);
+        return NULL;
+    }
+    Py_DECREF(empty);
+
+    return group_records((PyTypeObject*) cls,
+                         args,
+                         "_index",
+                         (unique) ? GROUP_UNIQUE : GROUP_LAST);
+}
+
+/* Namedtuple class method for grouping records by some fields.
+   return: A new dict of lists or NULL in case of error. */
+static PyObject *
+namedtuple__groupby(PyObject *cls, PyObject *args)
+{
+    return group_records((PyTypeObject*) cls, args, "_groupby", GROUP_LIST);
+}
+
+/* Namedtuple class method for selecting the records whose fields equal the
+   given values.
+   return: A new list or NULL in case of error. */
+static PyObject *
+namedtuple__where(PyObject *cls, PyObject *args, PyObject *kwargs)
+{
+    namedtuple_fields *info;
+    Py_ssize_t nconds = (kwargs) ? PyDict_GET_SIZE(kwargs) : 0;
+    Py_ssize_t *indices = NULL;
+    PyObject **values = NULL;
+    Py_ssize_t maxix = -1;
+    Py_ssize_t pos = 0;
+    PyObject *field;
+    PyObject *seq = NULL;
+    PyObject *record;
+    Py_ssize_t ix;
+    Py_ssize_t n;
+    int cmp = 1;
+    PyObject *ret = NULL;
+
+    if (PyTuple_GET_SIZE(args) != 1) {
+        PyErr_Format(PyExc_TypeError,
+                     "_where() takes exactly one positional argument "
+                     "(%zd given)",
+                     PyTuple_GET_SIZE(args));
+        return NULL;
+    }
+    if (!(info = get_fields_info((PyTypeObject*) cls, cls))) {
+        return NULL;
+    }
+    if (!(indices = PyMem_New(Py_ssize_t, nconds + 1)) ||
+        !(values = PyMem_New(PyObject*, nconds + 1))) {
+        PyErr_NoMemory();
+        goto done;
+    }
+    /* The values are borrowed from `kwargs`, which is only seen by this
+       call. */
+    for (n = 0;n < nconds && PyDict_Next(kwargs, &pos, &field, &values[n]);
+         ++n) {
+        if ((indices[n] = require_field(info, field)) < 0) {
+            goto done;
+        }
+        if (indices[n] > maxix) {
+            maxix = indices[n];
+        }
+    }
+
+    if (!(seq = PySequence_Fast(PyTuple_GET_ITEM(args, 0),
+                                "records must be iterable")) ||
+        !(ret = PyList_New(0))) {
+        goto done;
+    }
+    /* Comparing the fields may run arbitrary code which changes `seq`, so the
+       size is read again and each record is held while it is compared. */
+    for (ix = 0;ix < PySequence_Fast_GET_SIZE(seq);++ix) {
+        record = PySequence_Fast_GET_ITEM(seq, ix);
+        if (check_record((PyTypeObject*) cls, record, ix, maxix)) {
+            Py_CLEAR(ret);
+            break;
+        }
+        Py_INCREF(record);
+        for (n = 0;n < nconds;++n) {
+            if ((cmp = PyObject_RichCompareBool(
+                     PyTuple_GET_ITEM(record, indices[n]),
+                     values[n],
+                     Py_EQ)) <= 0) {
+                break;
+            }
+        }
+        if (cmp > 0) {
+            cmp = PyList_Append(ret, record) ? -1 : 1;
+        }
+        Py_DECREF(record);
+        if (cmp < 0) {
+            Py_CLEAR(ret);
+            break;
+        }
+    }
+
+done:
+    Py_XDECREF(seq);
+    PyMem_Free(values);
+    PyMem_Free(indices);
+    Py_DECREF(info);
+    return ret;
+}
+
+/* Sorts at most this many records by insertion. */
+#define SORT_INSERTION_MAX 32
+
+/* Compare two values of a sort key. Exact floats, strs and ints which fit in
+   a long are compared without going through rich comparison.
+   return: 1 if `a < b`, 0 if not or -1 in case of error. */
+static int
+sort_value_lt(PyObject *a, PyObject *b)
+{
+    long la;
+    long lb;
+    int overflow;
+    int cmp;
+
+    if (Py_TYPE(a) == Py_TYPE(b)) {
+        if (PyFloat_CheckExact(a)) {
+            return PyFloat_AS_DOUBLE(a) < PyFloat_AS_DOUBLE(b);
+        }
+        if (PyUnicode_CheckExact(a)) {
+            if ((cmp = PyUnicode_Compare(a, b)) == -1 && PyErr_Occurred()) {
+                return -1;
+            }
+            return cmp < 0;
+        }
+        if (PyLong_CheckExact(a)) {
+            la = PyLong_AsLongAndOverflow(a, &overflow);
+            if (!overflow) {
+                lb = PyLong_AsLongAndOverflow(b, &overflow);
+                if (!overflow) {
+                    return la < lb;
+                }
+            }
+        }
+    }
+    return PyObject_RichCompareBool(a, b, Py_LT);
+}
+
+/* How the values of a sort key are stored in `sort_word`. */
+typedef enum{
+    SORT_OBJECT,    /* `sw_object`, compared with `sort_value_lt`. */
+    SORT_FLOAT,     /* `sw_float`, unboxed from exact floats. */
+    SORT_INT,       /* `sw_int`, unboxed from exact ints. */
+}sort_kind;
+
+/* One value of a sort key, or the record itself after the last key. */
+typedef union{
+    PyObject *sw_object;
+    double sw_float;
+    long long sw_int;
+}sort_word;
+
+typedef struct{
+    Py_ssize_t sk_index;    /* The index of the field. */
+    int sk_descending;      /* Nonzero to sort the field in reverse. */
+    sort_kind sk_kind;      /* How the values of the field are stored. */
+}sort_key;
+
+/* Copy the values of `key` out of the records into column `col` of `rows`.
+   A field which only holds exact floats, or exact ints that fit in a long
+   long, is unboxed so that it compares without touching the values. */
+static void
+sort_fill_column(sort_key *key,
+                 PyObject **records,
+                 Py_ssize_t nrecords,
+                 sort_word *rows,
+                 Py_ssize_t stride,
+                 Py_ssize_t col)
+{
+    PyObject *value;
+    Py_ssize_t ix;
+    int overflow;
+
+    if (!nrecords) {
+        key->sk_kind = SORT_OBJECT;
+        return;
+    }
+    value = PyTuple_GET_ITEM(records[0], key->sk_index);
+    key->sk_kind = (PyFloat_CheckExact(value)) ? SORT_FLOAT :
+                   (PyLong_CheckExact(value)) ? SORT_INT :
+                   SORT_OBJECT;
+
+    for (ix = 0;ix < nrecords;++ix) {
+        value = PyTuple_GET_ITEM(records[ix], key->sk_index);
+        switch (key->sk_kind) {
+        case SORT_FLOAT:
+            if (!PyFloat_CheckExact(value)) {
+                goto boxed;
+            }
+            rows[ix * stride + col].sw_float = PyFloat_AS_DOUBLE(value);
+            break;
+        case SORT_INT:
+            if (!PyLong_CheckExact(value)) {
+                goto boxed;
+            }
+            rows[ix * stride + col].sw_int =
+                PyLong_AsLongLongAndOverflow(value, &overflow);
+            if (overflow) {
+                goto boxed;
+            }
+            break;
+        case SORT_OBJECT:
+            rows[ix * stride + col].sw_object = value;
+            break;
+        }
+    }
+    return;
+
+boxed:
+    /* The field is not homogeneous, store the values instead. */
+    key->sk_kind = SORT_OBJECT;
+    for (ix = 0;ix < nrecords;++ix) {
+        rows[ix * stride + col].sw_object =
+            PyTuple_GET_ITEM(records[ix], key->sk_index);
+    }
+}
+
+/* Compare two rows key by key.
+   return: 1 if `a` sorts before `b`, 0 if not or -1 in case of error. */
+static int
+sort_row_lt(const sort_key *keys,
+            Py_ssize_t nkeys,
+            const sort_word *a,
+            const sort_word *b)
+{
+    const sort_word *x;
+    const sort_word *y;
+    Py_ssize_t n;
+    int lt;
+
+    for (n = 0;n < nkeys;++n) {
+        x = (keys[n].sk_descending) ? b + n : a + n;
+        y = (keys[n].sk_descending) ? a + n : b + n;
+        switch (keys[n].sk_kind) {
+        case SORT_FLOAT:
+            if (x->sw_float < y->sw_float) {
+                return 1;
+            }
+            if (y->sw_float < x->sw_float) {
+                return 0;
+            }
+            break;
+        case SORT_INT:
+            if (x->sw_int != y->sw_int) {
+                return x->sw_int < y->sw_int;
+            }
+            break;
+        case SORT_OBJECT:
+            if (x->sw_object == y->sw_object) {
+                break;
+            }
+            if ((lt = sort_value_lt(x->sw_object, y->sw_object))) {
+                return lt;
+            }
+            /* The last field does not need to tell equal from greater. */
+            if (n == nkeys - 1) {
+                return 0;
+            }
+            if ((lt = sort_value_lt(y->sw_object, x->sw_object))) {
+                return (lt < 0) ? -1 : 0;
+            }
+            break;
+        }
+    }
+    return 0;
+}
+
+/* Stable merge sort of the `n` rows pointed to by `order`. `tmp` must have
+   room for `n / 2` pointers. On failure `order` is left as some permutation
+   of the rows.
+   return: Zero on success, nonzero on failure. */
+static int
+sort_rows(const sort_key *keys,
+          Py_ssize_t nkeys,
+          sort_word **order,
+          Py_ssize_t n,
+          sort_word **tmp)
+{
+    Py_ssize_t mid = n / 2;
+    Py_ssize_t left;
+    Py_ssize_t right;
+    Py_ssize_t out;
+    sort_word *row;
+    int lt = 0;
+
+    if (n <= SORT_INSERTION_MAX) {
+        for (right = 1;right < n;++right) {
+            row = order[right];
+            for (out = right;out > 0;--out) {
+                if ((lt = sort_row_lt(keys,
+                                      nkeys,
+                                      row,
+                                      order[out - 1])) <= 0) {
+                    break;
+                }
+                order[out] = order[out - 1];
+            }
+            order[out] = row;
+            if (lt < 0) {
+                return -1;
+            }
+        }
+        return 0;
+    }
+
+    if (sort_rows(keys, nkeys, order, mid, tmp) ||
+        sort_rows(keys, nkeys, order + mid, n - mid, tmp)) {
+        return -1;
+    }
+    /* Already sorted input only costs one comparison per merge. */
+    if ((lt = sort_row_lt(keys, nkeys, order[mid], order[mid - 1])) <= 0) {
+        return lt;
+    }
+
+    /* Merge the left half, moved to `tmp`, with the right half. The slots
+       between `out` and `right` always have room for the rest of `tmp`. */
+    memcpy(tmp, order, mid * sizeof(sort_word*));
+    left = 0;
+    right = mid;
+    out = 0;
+    while (left < mid && right < n) {
+        if ((lt = sort_row_lt(keys, nkeys, order[right], tmp[left])) < 0) {
+            break;
+        }
+        order[out++] = (lt) ? order[right++] : tmp[left++];
+    }
+    memcpy(order + out, tmp + left, (mid - left) * sizeof(sort_word*));
+    return (lt < 0) ? -1 : 0;
+}
+
+/* Sort `records` by `keys`, writing them back in order only on success. The
+   keys of each record are copied into one row so that comparisons do not
+   have to go through the records.
+   return: Zero on success, nonzero on failure. */
+static int
+sort_records(sort_key *keys,
+             Py_ssize_t nkeys,
+             PyObject **records,
+             Py_ssize_t nrecords)
+{
+    Py_ssize_t stride = nkeys + 1;
+    sort_word *rows;
+    sort_word **order;
+    Py_ssize_t n;
+    int err;
+
+    if (!(rows = PyMem_New(sort_word, nrecords * stride + 1))) {
+        PyErr_NoMemory();
+        return -1;
+    }
+    if (!(order = PyMem_New(sort_word*, nrecords + nrecords / 2 + 1))) {
+        PyMem_Free(rows);
+        PyErr_NoMemory();
+        return -1;
+    }
+
+    for (n = 0;n < nkeys;++n) {
+        sort_fill_column(&keys[n], records, nrecords, rows, stride, n);
+    }
+    for (n = 0;n < nrecords;++n) {
+        rows[n * stride + nkeys].sw_object = records[n];
+        order[n] = rows + n * stride;
+    }
+
+    if (!(err = sort_rows(keys, nkeys, order, nrecords, order + nrecords))) {
+        for (n = 0;n < nrecords;++n) {
+            records[n] = order[n][nkeys].sw_object;
+        }
+    }
+    PyMem_Free(order);
+    PyMem_Free(rows);
+    return err;
+}
+
+/* Namedtuple class method for sorting instances by some of their fields.
+   return: A new sorted list, Py_None when sorting in place or NULL in case of
+   error. */
+static PyObject *
+namedtuple__sort(PyObject *cls, PyObject *args, PyObject *kwargs)
+{
+    const char * const argnames[] = {"records", "by", "inplace", NULL};
+    PyObject *records;
+    PyObject *by = Py_None;
+    int inplace = 0;
+    namedtuple_fields *info;
+    Py_ssize_t *indices = NULL;
+    sort_key *keys = NULL;
+    Py_ssize_t nkeys;
+    Py_ssize_t maxix;
+    PyListObject *list = NULL;
+    PyObject *record;
+    PyObject **items;
+    PyObject **final_items;
+    Py_ssize_t nrecords;
+    Py_ssize_t allocated;
+    Py_ssize_t ix;
+    int err;
+    PyObject *ret = NULL;
+
+    if (!PyArg_ParseTupleAndKeywords(args,
+                                     kwargs,
+                                     "O|Op:_sort",
+                                     (char**) argnames,
+                                     &records,
+                                     &by,
+                                     &inplace)) {
+        return NULL;
+    }
+
+    if (!(info = get_fields_info((PyTypeObject*) cls, cls))) {
+        return NULL;
+    }
+    if (by == Py_None) {
+        by = info->fi_fields;
+        Py_INCREF(by);
+    }
+    /* Accept the same spellings as the `field_names` given to `namedtuple`. */
+    else if (!(by = build_fields(by))) {
+        Py_DECREF(info);
+        return NULL;
+    }
+    nkeys = PyTuple_GET_SIZE(by);
+    if (!(indices = PyMem_New(Py_ssize_t, nkeys + 1)) ||
+        !(keys = PyMem_New(sort_key, nkeys + 1))) {
+        PyErr_NoMemory();
+        goto done;
+    }
+    if (resolve_sort_keys(info, by, 1, indices, &maxix)) {
+        goto done;
+    }
+    for (ix = 0;ix < nkeys;++ix) {
+        keys[ix].sk_descending = indices[ix] < 0;
+        keys[ix].sk_index = (indices[ix] < 0) ? ~indices[ix] : indices[ix];
+    }
+
+    if (inplace) {
+        if (!PyList_Check(records)) {
+            PyErr_Format(PyExc_TypeError,
+                         "_sort(inplace=True) needs a list, got %s",
+                         Py_TYPE(records)->tp_name);
+            goto done;
+        }
+        Py_INCREF(records);
+        list = (PyListObject*) records;
+    }
+    else if (!(list = (PyListObject*) PySequence_List(records))) {
+        goto done;
+    }
+
+    nrecords = Py_SIZE(list);
+    for (ix = 0;ix < nrecords;++ix) {
+        record = list->ob_item[ix];
+        if (check_record((PyTypeObject*) cls, record, ix, maxix)) {
+            goto done;
+        }
+    }
+
+    /* Like `list.sort`, empty the list while comparing so that comparisons
+       which mutate it cannot free the records being sorted. */
+    items = list->ob_item;
+    allocated = list->allocated;
+    ((PyVarObject*) list)->ob_size = 0;
+    list->ob_item = NULL;
+    list->allocated = -1;
+
+    err = sort_records(keys, nkeys, items, nrecords);
+    if (!err && (list->allocated != -1 || Py_SIZE(list))) {
+        PyErr_SetString(PyExc_ValueError, "list modified during sort");
+        err = -1;
+    }
+
+    final_items = list->ob_item;
+    ix = Py_SIZE(list);
+    ((PyVarObject*) list)->ob_size = nrecords;
+    list->ob_item = items;
+    list->allocated = allocated;
+    if (final_items) {
+        while (--ix >= 0) {
+            Py_XDECREF(final_items[ix]);
+        }
+        PyMem_Free(final_items);
+    }
+
+    if (!err) {
+        if (inplace) {
+            Py_INCREF(Py_None);
+            ret = Py_None;
+        }
+        else {
+            Py_INCREF(list);
+            ret = (PyObject*) list;
+        }
+    }
+
+done:
+    PyMem_Free(keys);
+    PyMem_Free(indices);
+    Py_XDECREF(list);
+    Py_DECREF(by);
+    Py_DECREF(info);
+    return ret;
+}
+
+/* A growable array of records of one namedtuple type. The fields of every
+   record are stored in one contiguous block of slots and instances are only
+   created when a record is read. */
+typedef struct{
+    PyObject_HEAD
+    PyTypeObject *ra_type;      /* The type of the records. */
+    namedtuple_fields *ra_info; /* The field metadata of `ra_type`. */
+    Py_ssize_t ra_len;          /* The number of records. */
+    Py_ssize_t ra_capacity;     /* The number of records that fit in
+                                   `ra_items`. */
+    PyObject **ra_items;        /* `ra_len` rows of `FIELDS_COUNT(ra_info)`
+                                   fields, row major. */
+}namedtuple_array;
+
+PyTypeObject namedtuple_array_type;
+
+#define ARRAY_FIELDC(self) FIELDS_COUNT((self)->ra_info)
+#define ARRAY_ROW(self, ix) ((self)->ra_items + (ix) * ARRAY_FIELDC(self))
+
+/* return: A new empty array of `cls` records or NULL in case of error. */
+static namedtuple_array *
+namedtuple_array_new(PyTypeObject *cls,
+                     namedtuple_fields *info,
+                     Py_ssize_t capacity)
+{
+    namedtuple_array *self;
+
+    if (!(self = PyObject_GC_New(namedtuple_array, &namedtuple_array_type))) {
+        return NULL;
+    }
+    Py_INCREF(cls);
+    self->ra_type = cls;
+    Py_INCREF(info);
+    self->ra_info = info;
+    self->ra_len = 0;
+    self->ra_capacity = 0;
+    self->ra_items = NULL;
+    PyObject_GC_Track(self);
+
+    if (FIELDS_COUNT(info) &&
+        capacity > PY_SSIZE_T_MAX / FIELDS_COUNT(info)) {
+        Py_DECREF(self);
+        PyErr_NoMemory();
+        return NULL;
+    }
+    if (capacity &&
+        !(self->ra_items = PyMem_New(PyObject*,
+                                     capacity * FIELDS_COUNT(info)))) {
+        Py_DECREF(self);
+        PyErr_NoMemory();
+        return NULL;
+    }
+    self->ra_capacity = capacity;
+    return self;
+}
+
+/* Make room for at least `needed` records, over-allocating like `list`.
+   return: Zero on succes, nonzero on failure. */
+static int
+namedtuple_array_reserve(namedtuple_array *self, Py_ssize_t needed)
+{
+    Py_ssize_t fieldc = ARRAY_FIELDC(self);
+    Py_ssize_t capacity;
+    PyObject **items;
+
+    if (needed <= self->ra_capacity) {
+        return 0;
+    }
+    if (needed > PY_SSIZE_T_MAX - (needed >> 3) - 6) {
+        PyErr_NoMemory();
+        return -1;
+    }
+    capacity = needed + (needed >> 3) + 6;
+    if (fieldc &&
+        capacity > PY_SSIZE_T_MAX / fieldc / (Py_ssize_t) sizeof(PyObject*)) {
+        PyErr_NoMemory();
+        return -1;
+    }
+    /* `PyMem_Resize` would clear `ra_items` on failure and lose the
+       records. */
+    items = PyMem_Realloc(self->ra_items,
+                          (size_t) (capacity * fieldc) * sizeof(PyObject*));
+    if (!items) {
+        PyErr_NoMemory();
+        return -1;
+    }
+    self->ra_items = items;
+    self->ra_capacity = capacity;
+    return 0;
+}
+
+/* Copy the fields of `record` onto the end of the array. `record` may be any
+   sequence with one item per field.
+   return: Zero on succes, nonzero on failure. */
+static int
+namedtuple_array_push(namedtuple_array *self, PyObject *record)
+{
+    Py_ssize_t fieldc = ARRAY_FIELDC(self);
+    PyObject *seq;
+    PyObject **items;
+    PyObject **row;
+    Py_ssize_t n;
+
+    if (!(seq = PySequence_Fast(record, "records must be iterable"))) {
+        return -1;
+    }
+    if (PySequence_Fast_GET_SIZE(seq) != fieldc) {
+        PyErr_Format(PyExc_TypeError,
+                     "Expected %zd arguments, got %zd",
+                     fieldc,
+                     PySequence_Fast_GET_SIZE(seq));
+        Py_DECREF(seq);
+        return -1;
+    }
+    if (namedtuple_array_reserve(self, self->ra_len + 1)) {
+        Py_DECREF(seq);
+        return -1;
+    }
+    items = PySequence_Fast_ITEMS(seq);
+    row = ARRAY_ROW(self, self->ra_len);
+    for (n = 0;n < fieldc;++n) {
+        Py_INCREF(items[n]);
+        row[n] = items[n];
+    }
+    ++self->ra_len;
+    Py_DECREF(seq);
+    return 0;
+}
+
+static int
+namedtuple_array_traverse(namedtuple_array *self, visitproc visit, void *arg)
+{
+    Py_ssize_t n;
+
+    Py_VISIT(self->ra_type);
+    for (n = 0;n < self->ra_len * ARRAY_FIELDC(self);++n) {
+        Py_VISIT(self->ra_items[n]);
+    }
+    return 0;
+}
+
+static int
+namedtuple_array_clear(namedtuple_array *self)
+{
+    PyObject **items = self->ra_items;
+    Py_ssize_t n = self->ra_len * ARRAY_FIELDC(self);
+
+    self->ra_items = NULL;
+    self->ra_len = 0;
+    self->ra_capacity = 0;
+    while (n--) {
+        Py_DECREF(items[n]);
+    }
+    PyMem_Free(items);
+    /* `ra_type` is kept like `ra_info`, the items are what can form a
+       cycle. */
+    return 0;
+}
+
+static void
+namedtuple_array_dealloc(namedtuple_array *self)
+{
+    PyObject_GC_UnTrack(self);
+    namedtuple_array_clear(self);
+    Py_CLEAR(self->ra_type);
+    Py_CLEAR(self->ra_info);
+    PyObject_GC_Del(self);
+}
+
+static Py_ssize_t
+namedtuple_array_length(namedtuple_array *self)
+{
+    Py_ssize_t ret;
+
+    Py_BEGIN_CRITICAL_SECTION(self);
+    ret = self->ra_len;
+    Py_END_CRITICAL_SECTION();
+    return ret;
+}
+
+/* Create the instance for the record at `ix`. The array must be locked.
+   Like `namedtuple_from_array`, but the row is only read once the result is
+   allocated: allocating may run a finalizer that grows the array, which
+   moves the rows.
+   return: A new instance or NULL in case of error. */
+static PyObject *
+namedtuple_array_item_locked(namedtuple_array *self, Py_ssize_t ix)
+{
+    PyTypeObject *cls = self->ra_type;
+    Py_ssize_t fieldc = ARRAY_FIELDC(self);
+    int fast = cls->tp_new == namedtuple_new;
+    PyObject **row;
+    PyObject *args;
+    PyObject *ret;
+    Py_ssize_t n;
+
+    if (ix < 0 || ix >= self->ra_len) {
+        PyErr_SetString(PyExc_IndexError, "array index out of range");
+        return NULL;
+    }
+    if (!(ret = (fast) ? cls->tp_alloc(cls, fieldc) : PyTuple_New(fieldc))) {
+        return NULL;
+    }
+    if (ix >= self->ra_len) {
+        Py_DECREF(ret);
+        PyErr_SetString(PyExc_IndexError, "array index out of range");
+        return NULL;
+    }
+    row = ARRAY_ROW(self, ix);
+    for (n = 0;n < fieldc;++n) {
+        Py_INCREF(row[n]);
+        PyTuple_SET_ITEM(ret, n, row[n]);
+    }
+    if (fast) {
+        return ret;
+    }
+    args = ret;
+    ret = cls->tp_new(cls, args, NULL);
+    Py_DECREF(args);
+    return ret;
+}
+
+static PyObject *
+namedtuple_array_item(namedtuple_array *self, Py_ssize_t ix)
+{
+    PyObject *ret;
+
+    Py_BEGIN_CRITICAL_SECTION(self);
+    ret = namedtuple_array_item_locked(self, ix);
+    Py_END_CRITICAL_SECTION();
+    return ret;
+}
+
+/* Index with an integer to get an instance or a slice to get a new array.
+   The array must be locked. */
+static PyObject *
+namedtuple_array_subscript_locked(namedtuple_array *self, PyObject *key)
+{
+    Py_ssize_t fieldc = ARRAY_FIELDC(self);
+    namedtuple_array *ret;
+    Py_ssize_t start;
+    Py_ssize_t stop;
+    Py_ssize_t step;
+    Py_ssize_t len;
+    Py_ssize_t ix;
+    Py_ssize_t n;
+    PyObject **src;
+    PyObject **dst;
+
+    if (PyIndex_Check(key)) {
+        if ((ix = PyNumber_AsSsize_t(key, PyExc_IndexError)) == -1 &&
+            PyErr_Occurred()) {
+            return NULL;
+        }
+        if (ix < 0) {
+            ix += self->ra_len;
+        }
+        return namedtuple_array_item_locked(self, ix);
+    }
+    if (!PySlice_Check(key)) {
+        PyErr_Format(PyExc_TypeError,
+                     "array indices must be integers or slices, not %s",
+                     Py_TYPE(key)->tp_name);
+        return NULL;
+    }
+
+    if (PySlice_Unpack(key, &start, &stop, &step)) {
+        return NULL;
+    }
+    len = PySlice_AdjustIndices(self->ra_len, &start, &stop, step);
+    if (!(ret = namedtuple_array_new(self->ra_type, self->ra_info, len))) {
+        return NULL;
+    }
+    for (ix = 0;ix < len;++ix) {
+        src = ARRAY_ROW(self, start + ix * step);
+        dst = ARRAY_ROW(ret, ix);
+        for (n = 0;n < fieldc;++n) {
+            Py_INCREF(src[n]);
+            dst[n] = src[n];
+        }
+    }
+    ret->ra_len = len;
+    return (PyObject*) ret;
+}
+
+static PyObject *
+namedtuple_array_subscript(namedtuple_array *self, PyObject *key)
+{
+    PyObject *ret;
+
+    Py_BEGIN_CRITICAL_SECTION(self);
+    ret = namedtuple_array_subscript_locked(self, key);
+    Py_END_CRITICAL_SECTION();
+    return ret;
+}
+
+static PyObject *
+namedtuple_array_repr(namedtuple_array *self)
+{
+    PyObject *ret;
+
+    Py_BEGIN_CRITICAL_SECTION(self);
+    ret = PyUnicode_FromFormat("<%s._array len=%zd capacity=%zd>",
+                               self->ra_type->tp_name,
+                               self->ra_len,
+                               self->ra_capacity);
+    Py_END_CRITICAL_SECTION();
+    return ret;
+}
+
+static PyObject *
+namedtuple_array_append(namedtuple_array *self, PyObject *record)
+{
+    int err;
+
+    Py_BEGIN_CRITICAL_SECTION(self);
+    err = namedtuple_array_push(self, record);
+    Py_END_CRITICAL_SECTION();
+    if (err) {
+        return NULL;
+    }
+    Py_RETURN_NONE;
+}
+
+/* The array, and `records` when it is an array, must be locked. */
+static PyObject *
+namedtuple_array_extend_locked(namedtuple_array *self, PyObject *records)
+{
+    Py_ssize_t fieldc = ARRAY_FIELDC(self);
+    namedtuple_array *other;
+    PyObject *it;
+    PyObject *record;
+    Py_ssize_t hint;
+    Py_ssize_t n;
+
+    if (Py_TYPE(records) == &namedtuple_array_type &&
+        ARRAY_FIELDC((namedtuple_array*) records) == fieldc) {
+        /* Copy the slots directly. This also handles `a.extend(a)` because
+           the length is read before the items are copied. */
+        other = (namedtuple_array*) records;
+        if (namedtuple_array_reserve(self, self->ra_len + other->ra_len)) {
+            return NULL;
+        }
+        for (n = 0;n < other->ra_len * fieldc;++n) {
+            Py_INCREF(other->ra_items[n]);
+            ARRAY_ROW(self, self->ra_len)[n] = other->ra_items[n];
+        }
+        self->ra_len += other->ra_len;
+        Py_RETURN_NONE;
+    }
+
+    if ((hint = PyObject_LengthHint(records, 0)) < 0) {
+        return NULL;
+    }
+    if (hint > PY_SSIZE_T_MAX - self->ra_len) {
+        PyErr_NoMemory();
+        return NULL;
+    }
+    if (namedtuple_array_reserve(self, self->ra_len + hint)) {
+        return NULL;
+    }
+    if (!(it = PyObject_GetIter(records))) {
+        return NULL;
+    }
+    while ((record = PyIter_Next(it))) {
+        if (namedtuple_array_push(self, record)) {
+            Py_DECREF(record);
+            Py_DECREF(it);
+            return NULL;
+        }
+        Py_DECREF(record);
+    }
+    Py_DECREF(it);
+    if (PyErr_Occurred()) {
+        return NULL;
+    }
+    Py_RETURN_NONE;
+}
+
+static PyObject *
+namedtuple_array_extend(namedtuple_array *self, PyObject *records)
+{
+    PyObject *ret;
+
+    if (Py_TYPE(records) == &namedtuple_array_type) {
+        Py_BEGIN_CRITICAL_SECTION2(self, records);
+        ret = namedtuple_array_extend_locked(self, records);
+        Py_END_CRITICAL_SECTION2();
+    }
+    else {
+        Py_BEGIN_CRITICAL_SECTION(self);
+        ret = namedtuple_array_extend_locked(self, records);
+        Py_END_CRITICAL_SECTION();
+    }
+    return ret;
+}
+
+/* return: A new list with the value of `field` for every record. */
+static PyObject *
+namedtuple_array_column(namedtuple_array *self, PyObject *field)
+{
+    Py_ssize_t ix;
+    Py_ssize_t n;
+    PyObject *ret;
+    PyObject *item;
+
+    if ((ix = require_field(self->ra_info, field)) < 0) {
+        return NULL;
+    }
+    Py_BEGIN_CRITICAL_SECTION(self);
+    if ((ret = PyList_New(self->ra_len))) {
+        for (n = 0;n < self->ra_len;++n) {
+            item = ARRAY_ROW(self, n)[ix];
+            Py_INCREF(item);
+            PyList_SET_ITEM(ret, n, item);
+        }
+    }
+    Py_END_CRITICAL_SECTION();
+    return ret;
+}
+
+/* return: A new list with an instance for every record. The array must be
+   locked. */
+static PyObject *
+namedtuple_array_tolist_locked(namedtuple_array *self)
+{
+    Py_ssize_t len = self->ra_len;
+    PyObject *ret;
+    PyObject *record;
+    Py_ssize_t n;
+
+    if (!(ret = PyList_New(len))) {
+        return NULL;
+    }
+    /* `__new__` may run Python code which could see the empty slots. */
+    PyObject_GC_UnTrack(ret);
+    for (n = 0;n < len;++n) {
+        if (n >= self->ra_len) {
+            PyErr_SetString(PyExc_RuntimeError,
+                            "array changed size during iteration");
+            PyObject_GC_Track(ret);
+            Py_DECREF(ret);
+            return NULL;
+        }
+        if (!(record = namedtuple_array_item_locked(self, n))) {
+            PyObject_GC_Track(ret);
+            Py_DECREF(ret);
+            return NULL;
+        }
+        PyList_SET_ITEM(ret, n, record);
+    }
+    PyObject_GC_Track(ret);
+    return ret;
+}
+
+static PyObject *
+namedtuple_array_tolist(namedtuple_array *self, PyObject *_)
+{
+    PyObject *ret;
+
+    Py_BEGIN_CRITICAL_SECTION(self);
+    ret = namedtuple_array_tolist_locked(self);
+    Py_END_CRITICAL_SECTION();
+    return ret;
+}
+
+static PyObject *
+namedtuple_array_get_capacity(namedtuple_array *self, void *_)
+{
+    Py_ssize_t ret;
+
+    Py_BEGIN_CRITICAL_SECTION(self);
+    ret = self->ra_capacity;
+    Py_END_CRITICAL_SECTION();
+    return PyLong_FromSsize_t(ret);
+}
+
+static PyObject *
+namedtuple_array_get_type(namedtuple_array *self, void *_)
+{
+    Py_INCREF(self->ra_type);
+    return (PyObject*) self->ra_type;
+}
+
+PyDoc_STRVAR(namedtuple_array_append_doc,
+"append(record) -> None\n\n"
+"Copy the fields of a record onto the end of the array.");
+
+PyDoc_STRVAR(namedtuple_array_extend_doc,
+"extend(records) -> None\n\n"
+"Copy the fields of each record in an iterable onto the end of the array.");
+
+PyDoc_STRVAR(namedtuple_array_column_doc,
+"column(field) -> list\n\n"
+"Read one field out of every record without creating the instances.");
+
+PyDoc_STRVAR(namedtuple_array_tolist_doc,
+"tolist() -> list\n\n"
+"Create an instance for every record.");
+
+PyMethodDef namedtuple_array_methods[] = {
+    {"append",
+     (PyCFunction) namedtuple_array_append,
+     METH_O,
+     namedtuple_array_append_doc},
+    {"extend",
+     (PyCFunction) namedtuple_array_extend,
+     METH_O,
+     namedtuple_array_extend_doc},
+    {"column",
+     (PyCFunction) namedtuple_array_column,
+     METH_O,
+     namedtuple_array_column_doc},
+    {"tolist",
+     (PyCFunction) namedtuple_array_tolist,
+     METH_NOARGS,
+     namedtuple_array_tolist_doc},
+    {NULL},
+};
+
+PyGetSetDef namedtuple_array_getsets[] = {
+    {"capacity",
+     (getter) namedtuple_array_get_capacity,
+     NULL,
+     "The number of records that fit before the array grows."},
+    {"type",
+     (getter) namedtuple_array_get_type,
+     NULL,
+     "The namedtuple type of the records."},
+    {NULL},
+};
+
+PySequenceMethods namedtuple_array_as_sequence = {
+    (lenfunc) namedtuple_array_length,          /* sq_length */
+    0,                                          /* sq_concat */
+    0,                                          /* sq_repeat */
+    (ssizeargfunc) namedtuple_array_item,       /* sq_item */
+};
+
+PyMappingMethods namedtuple_array_as_mapping = {
+    (lenfunc) namedtuple_array_length,          /* mp_length */
+    (binaryfunc) namedtuple_array_subscript,    /* mp_subscript */
+};
+
+PyDoc_STRVAR(namedtuple_array_doc,
+"A growable array of records of one namedtuple type. Created with\n"
+"'NT._array(capacity)'.");
+
+PyTypeObject namedtuple_array_type = {
+    PyVarObject_HEAD_INIT(&PyType_Type, 0)
+    "_collections.NamedTupleArray",             /* tp_name */
+    sizeof(namedtuple_array),                   /* tp_basicsize */
+    0,                                          /* tp_itemsize */
+    (destructor) namedtuple_array_dealloc,      /* tp_dealloc */
+    0,                                          /* tp_print */
+    0,                                          /* tp_getattr */
+    0,                                          /* tp_setattr */
+    0,                                          /* tp_reserved */
+    (reprfunc) namedtuple_array_repr,           /* tp_repr */
+    0,                                          /* tp_as_number */
+    &namedtuple_array_as_sequence,              /* tp_as_sequence */
+    &namedtuple_array_as_mapping,               /* tp_as_mapping */
+    PyObject_HashNotImplemented,                /* tp_hash */
+    0,                                          /* tp_call */
+    0,                                          /* tp_str */
+    PyObject_GenericGetAttr,                    /* tp_getattro */
+    0,                                          /* tp_setattro */
+    0,                                          /* tp_as_buffer */
+    Py_TPFLAGS_DEFAULT | Py_TPFLAGS_HAVE_GC,    /* tp_flags */
+    namedtuple_array_doc,                       /* tp_doc */
+    (traverseproc) namedtuple_array_traverse,   /* tp_traverse */
+    (inquiry) namedtuple_array_clear,           /* tp_clear */
+    0,                                          /* tp_richcompare */
+    0,                                          /* tp_weaklistoffset */
+    0,                                          /* tp_iter */
+    0,                                          /* tp_iternext */
+    namedtuple_array_methods,                   /* tp_methods */
+    0,                                          /* tp_members */
+    namedtuple_array_getsets,                   /* tp_getset */
+};
+
+/* Namedtuple class method for creating an empty record array.
+   return: A new array or NULL in case of error. */
+static PyObject *
+namedtuple__array(PyObject *cls, PyObject *args, PyObject *kwargs)
+{
+    const char * const argnames[] = {"capacity", NULL};
+    Py_ssize_t capacity = 0;
+    namedtuple_fields *info;
+    PyObject *ret;
+
+    if (!PyArg_ParseTupleAndKeywords(args,
+                                     kwargs,
+                                     "|n:_array",
+                                     (char**) argnames,
+                                     &capacity)) {
+        return NULL;
+    }
+    if (capacity < 0) {
+        PyErr_SetString(PyExc_ValueError, "capacity must be non-negative");
+        return NULL;
+    }
+    if (!(info = get_fields_info((PyTypeObject*) cls, cls))) {
+        return NULL;
+    }
+    if (FIELDS_COUNT(info) &&
+        capacity >
+        PY_SSIZE_T_MAX / FIELDS_COUNT(info) / (Py_ssize_t) sizeof(PyObject*)) {
+        Py_DECREF(info);
+        return PyErr_NoMemory();
+    }
+    ret = (PyObject*) namedtuple_array_new((PyTypeObject*) cls,
+                                           info,
+                                           capacity);
+    Py_DECREF(info);
+    return ret;
+}
+
+/* Binary record codec.
+
+   `NT._pack(records)` writes a header followed by the fields of each record:
+
+       magic        4 bytes   "CNT\x01"
+       fingerprint  8 bytes   FNV-1a hash of the field names
+       fieldc       4 bytes
+       nrecords     8 bytes
+       values       fieldc * nrecords tagged values, row major
+
+   Every value starts with a one byte tag. The builtin scalars are encoded
+   directly and everything else is pickled. All integers are little endian. */
+#define PACK_MAGIC "CNT\x01"
+#define PACK_HEADER_SIZE 24
+
+#define PACK_NONE 'N'
+#define PACK_TRUE 'T'
+#define PACK_FALSE 'F'
+#define PACK_INT 'i'        /* 8 byte signed integer */
+#define PACK_FLOAT 'd'      /* 8 byte IEEE 754 double */
+#define PACK_STR 's'        /* 4 byte length + utf-8 */
+#define PACK_BYTES 'b'      /* 4 byte length + data */
+#define PACK_PICKLE 'p'     /* 4 byte length + pickle */
+
+/* A stable hash of the field names used to check that packed data belongs to
+   the type it is unpacked with. `hash(str)` is randomized so it cannot be
+   used here.
+   return: The fingerprint or (uint64_t) -1 with an exception set. */
+static uint64_t
+fields_fingerprint(namedtuple_fields *info)
+{
+    uint64_t hash = 14695981039346656037ULL;
+    const char *name;
+    Py_ssize_t len;
+    Py_ssize_t n;
+    Py_ssize_t ix;
+
+    for (n = 0;n < FIELDS_COUNT(info);++n) {
+        if (!(name = PyUnicode_AsUTF8AndSize(FIELDS_NAME(info, n), &len))) {
+            return (uint64_t) -1;
+        }
+        /* Hash the trailing NUL to separate the names. */
+        for (ix = 0;ix <= len;++ix) {
+            hash = (hash ^ (unsigned char) name[ix]) * 1099511628211ULL;
+        }
+    }
+    return hash;
+}
+
+/* A bytes object being filled by `_pack`. */
+typedef struct{
+    PyObject *pb_bytes;     /* The output, over-allocated while writing. */
+    Py_ssize_t pb_len;      /* The number of bytes written. */
+    PyObject *pb_dumps;     /* `pickle.dumps`, imported on first use. */
+}pack_buffer;
+
+/* Make room for `n` more bytes.
+   return: A pointer to write the bytes at or NULL in case of error. */
+static unsigned char *
+pack_reserve(pack_buffer *pb, Py_ssize_t n)
+{
+    Py_ssize_t size = PyBytes_GET_SIZE(pb->pb_bytes);
+    unsigned char *ret;
+
+    if (pb->pb_len + n > size) {
+        if (n > PY_SSIZE_T_MAX - pb->pb_len ||
+            pb->pb_len + n > PY_SSIZE_T_MAX / 2) {
+            PyErr_NoMemory();
+            return NULL;
+        }
+        if (_PyBytes_Resize(&pb->pb_bytes, (pb->pb_len + n) * 2)) {
+            return NULL;
+        }
+    }
+    ret = (unsigned char*) PyBytes_AS_STRING(pb->pb_bytes) + pb->pb_len;
+    pb->pb_len += n;
+    return ret;
+}
+
+static void
+store_u32(unsigned char *p, uint32_t v)
+{
+    int n;
+
+    for (n = 0;n < 4;++n) {
+        p[n] = (unsigned char) (v >> (8 * n));
+    }
+}
+
+static void
+store_u64(unsigned char *p, uint64_t v)
+{
+    int n;
+
+    for (n = 0;n < 8;++n) {
+        p[n] = (unsigned char) (v >> (8 * n));
+    }
+}
+
+static uint32_t
+load_u32(const unsigned char *p)
+{
+    uint32_t v = 0;
+    int n;
+
+    for (n = 3;n >= 0;--n) {
+        v = (v << 8) | p[n];
+    }
+    return v;
+}
+
+static uint64_t
+load_u64(const unsigned char *p)
+{
+    uint64_t v = 0;
+    int n;
+
+    for (n = 7;n >= 0;--n) {
+        v = (v << 8) | p[n];
+    }
+    return v;
+}
+
+/* Write a tag, a 4 byte length and `len` bytes of data.
+   return: Zero on succes, nonzero on failure. */
+static int
+pack_sized(pack_buffer *pb, char tag, const char *data, Py_ssize_t len)
+{
+    unsigned char *p;
+
+    if (!(p = pack_reserve(pb, 5 + len))) {
+        return -1;
+    }
+    p[0] = tag;
+    store_u32(p + 1, (uint32_t) len);
+    memcpy(p + 5, data, len);
+    return 0;
+}
+
+/* Write one tagged value.
+   return: Zero on succes, nonzero on failure. */
+static int
+pack_value(pack_buffer *pb, PyObject *value)
+{
+    PyTypeObject *type = Py_TYPE(value);
+    unsigned char *p;
+    long long iv;
+    double dv;
+    uint64_t bits;
+    const char *data;
+    Py_ssize_t len;
+    int overflow;
+    PyObject *pickled;
+    int err;
+
+    if (value == Py_None || value == Py_True || value == Py_False) {
+        if (!(p = pack_reserve(pb, 1))) {
+            return -1;
+        }
+        p[0] = (value == Py_None) ? PACK_NONE :
+            (value == Py_True) ? PACK_TRUE : PACK_FALSE;
+        return 0;
+    }
+    if (type == &PyLong_Type) {
+        iv = PyLong_AsLongLongAndOverflow(value, &overflow);
+        if (iv == -1 && PyErr_Occurred()) {
+            return -1;
+        }
+        if (!overflow) {
+            if (!(p = pack_reserve(pb, 9))) {
+                return -1;
+            }
+            p[0] = PACK_INT;
+            store_u64(p + 1, (uint64_t) iv);
+            return 0;
+        }
+    }
+    else if (type == &PyFloat_Type) {
+        if (!(p = pack_reserve(pb, 9))) {
+            return -1;
+        }
+        dv = PyFloat_AS_DOUBLE(value);
+        memcpy(&bits, &dv, sizeof(bits));
+        p[0] = PACK_FLOAT;
+        store_u64(p + 1, bits);
+        return 0;
+    }
+    else if (type == &PyUnicode_Type) {
+        if ((data = PyUnicode_AsUTF8AndSize(value, &len)) &&
+            len <= UINT32_MAX) {
+            return pack_sized(pb, PACK_STR, data, len);
+        }
+        /* Lone surrogates cannot be encoded, let pickle handle them. */
+        PyErr_Clear();
+    }
+    else if (type == &PyBytes_Type && PyBytes_GET_SIZE(value) <= UINT32_MAX) {
+        return pack_sized(pb,
+                          PACK_BYTES,
+                          PyBytes_AS_STRING(value),
+                          PyBytes_GET_SIZE(value));
+    }
+
+    if (!pb->pb_dumps) {
+        PyObject *pickle = PyImport_ImportModule("pickle");
+
+        if (!pickle) {
+            return -1;
+        }
+        pb->pb_dumps = PyObject_GetAttrString(pickle, "dumps");
+        Py_DECREF(pickle);
+        if (!pb->pb_dumps) {
+            return -1;
+        }
+    }
+    if (!(pickled = PyObject_CallFunction(pb->pb_dumps, "Oi", value, -1))) {
+        return -1;
+    }
+    if (!PyBytes_Check(pickled) || PyBytes_GET_SIZE(pickled) > UINT32_MAX) {
+        PyErr_Format(PyExc_ValueError, "cannot pack %R", value);
+        Py_DECREF(pickled);
+        return -1;
+    }
+    err = pack_sized(pb,
+                     PACK_PICKLE,
+                     PyBytes_AS_STRING(pickled),
+                     PyBytes_GET_SIZE(pickled));
+    Py_DECREF(pickled);
+    return err;
+}
+
+/* Pickling a value runs Python code, which may change a list of records
+   while it is being packed. Lists are copied so that every record is held
+   and the count written in the header stays right.
+   return: A new tuple of the records or NULL in case of error. */
+static PyObject *
+records_snapshot(PyObject *records)
+{
+    PyObject *seq;
+
+    if (!(seq = PySequence_Fast(records, "records must be iterable"))) {
+        return NULL;
+    }
+    if (PyList_Check(seq)) {
+        Py_SETREF(seq, PyList_AsTuple(seq));
+    }
+    return seq;
+}
+
+/* Pack the fields of every instance of `cls` in `records` into `pb`, after a
+   header.
+   return: Zero on succes, nonzero on failure. */
+static int
+pack_records(pack_buffer *pb, PyTypeObject *cls, PyObject *records)
+{
+    namedtuple_fields *info;
+    Py_ssize_t fieldc;
+    uint64_t fingerprint;
+    PyObject *seq;
+    PyObject *record;
+    unsigned char *header;
+    Py_ssize_t nrecords;
+    Py_ssize_t ix;
+    Py_ssize_t n;
+
+    if (!(info = get_fields_info(cls, (PyObject*) cls))) {
+        return -1;
+    }
+    fieldc = FIELDS_COUNT(info);
+    fingerprint = fields_fingerprint(info);
+    Py_DECREF(info);
+    if (fingerprint == (uint64_t) -1 && PyErr_Occurred()) {
+        return -1;
+    }
+    if (!(seq = records_snapshot(records))) {
+        return -1;
+    }
+    nrecords = PySequence_Fast_GET_SIZE(seq);
+
+    if (!(header = pack_reserve(pb, PACK_HEADER_SIZE))) {
+        goto error;
+    }
+    memcpy(header, PACK_MAGIC, 4);
+    store_u64(header + 4, fingerprint);
+    store_u32(header + 12, (uint32_t) fieldc);
+    store_u64(header + 16, (uint64_t) nrecords);
+
+    for (ix = 0;ix < nrecords;++ix) {
+        record = PySequence_Fast_GET_ITEM(seq, ix);
+        if (!PyObject_TypeCheck(record, cls)) {
+            PyErr_Format(PyExc_TypeError,
+                         "expected %s instance, got %s (record %zd)",
+                         cls->tp_name,
+                         Py_TYPE(record)->tp_name,
+                         ix);
+            goto error;
+        }
+        if (PyTuple_GET_SIZE(record) < fieldc) {
+            PyErr_Format(PyExc_ValueError,
+                         "record %zd has %zd fields, expected %zd",
+                         ix,
+                         PyTuple_GET_SIZE(record),
+                         fieldc);
+            goto error;
+        }
+        for (n = 0;n < fieldc;++n) {
+            if (pack_value(pb, PyTuple_GET_ITEM(record, n))) {
+                goto error;
+            }
+        }
+    }
+
+    Py_DECREF(seq);
+    return 0;
+
+error:
+    Py_DECREF(seq);
+    return -1;
+}
+
+/* Namedtuple class method for packing a sequence of instances into bytes.
+   return: A new bytes object or NULL in case of error. */
+static PyObject *
+namedtuple__pack(PyObject *cls, PyObject *records)
+{
+    pack_buffer pb = {NULL, 0, NULL};
+
+    if (!(pb.pb_bytes = PyBytes_FromStringAndSize(NULL, 256))) {
+        return NULL;
+    }
+    if (pack_records(&pb, (PyTypeObject*) cls, records) ||
+        _PyBytes_Resize(&pb.pb_bytes, pb.pb_len)) {
+        Py_XDECREF(pb.pb_bytes);
+        Py_XDECREF(pb.pb_dumps);
+        return NULL;
+    }
+    Py_XDECREF(pb.pb_dumps);
+    return pb.pb_bytes;
+}
+
+/* A cursor over packed data. */
+typedef struct{
+    const unsigned char *pr_data;   /* The next unread byte. */
+    Py_ssize_t pr_left;             /* The number of unread bytes. */
+    PyObject *pr_loads;             /* `pickle.loads`, imported on first
+                                       use. */
+}pack_reader;
+
+/* Consume `n` bytes.
+   return: A pointer to the bytes or NULL with an exception set if there are
+   not enough left. */
+static const unsigned char *
+pack_read(pack_reader *pr, Py_ssize_t n)
+{
+    const unsigned char *ret = pr->pr_data;
+
+    if (n > pr->pr_left) {
+        PyErr_SetString(PyExc_ValueError, "packed records are truncated");
+        return NULL;
+    }
+    pr->pr_data += n;
+    pr->pr_left -= n;
+    return ret;
+}
+
+/* Read one tagged value.
+   return: A new reference or NULL in case of error. */
+static PyObject *
+unpack_value(pack_reader *pr)
+{
+    const unsigned char *p;
+    const unsigned char *data;
+    uint64_t bits;
+    double dv;
+    Py_ssize_t len;
+    PyObject *pickle;
+    PyObject *view;
+    PyObject *ret;
+
+    if (!(p = pack_read(pr, 1))) {
+        return NULL;
+    }
+    switch (*p) {
+    case PACK_NONE:
+        Py_RETURN_NONE;
+    case PACK_TRUE:
+        Py_RETURN_TRUE;
+    case PACK_FALSE:
+        Py_RETURN_FALSE;
+    case PACK_INT:
+        if (!(p = pack_read(pr, 8))) {
+            return NULL;
+        }
+        return PyLong_FromLongLong((long long) load_u64(p));
+    case PACK_FLOAT:
+        if (!(p = pack_read(pr, 8))) {
+            return NULL;
+        }
+        bits = load_u64(p);
+        memcpy(&dv, &bits, sizeof(dv));
+        return PyFloat_FromDouble(dv);
+    case PACK_STR:
+    case PACK_BYTES:
+    case PACK_PICKLE:
+        if (!(data = pack_read(pr, 4))) {
+            return NULL;
+        }
+        len = (Py_ssize_t) load_u32(data);
+        if (!(data = pack_read(pr, len))) {
+            return NULL;
+        }
+        if (*p == PACK_STR) {
+            return PyUnicode_DecodeUTF8((const char*) data, len, NULL);
+        }
+        if (*p == PACK_BYTES) {
+            return PyBytes_FromStringAndSize((const char*) data, len);
+        }
+        break;
+    default:
+        PyErr_Format(PyExc_ValueError,
+                     "unknown packed value tag: 0x%02x",
+                     (unsigned int) *p);
+        return NULL;
+    }
+
+    if (!pr->pr_loads) {
+        if (!(pickle = PyImport_ImportModule("pickle"))) {
+            return NULL;
+        }
+        pr->pr_loads = PyObject_GetAttrString(pickle, "loads");
+        Py_DECREF(pickle);
+        if (!pr->pr_loads) {
+            return NULL;
+        }
+    }
+    if (!(view = PyMemoryView_FromMemory((char*) data, len, PyBUF_READ))) {
+        return NULL;
+    }
+    ret = PyObject_CallFunctionObjArgs(pr->pr_loads, view, NULL);
+    Py_DECREF(view);
+    return ret;
+}
+
+/* Check the header of packed data against `cls`.
+   return: The number of records or -1 in case of error. */
+static Py_ssize_t
+unpack_header(pack_reader *pr, PyTypeObject *cls, Py_ssize_t fieldc)
+{
+    namedtuple_fields *info;
+    const unsigned char *header;
+    uint64_t fingerprint;
+    uint64_t nrecords;
+
+    if (!(header = pack_read(pr, PACK_HEADER_SIZE))) {
+        return -1;
+    }
+    if (memcmp(header, PACK_MAGIC, 4)) {
+        PyErr_SetString(PyExc_ValueError, "not packed namedtuple records");
+        return -1;
+    }
+    if (!(info = get_fields_info(cls, (PyObject*) cls))) {
+        return -1;
+    }
+    fingerprint = fields_fingerprint(info);
+    Py_DECREF(info);
+    if (fingerprint == (uint64_t) -1 && PyErr_Occurred()) {
+        return -1;
+    }
+    if (load_u64(header + 4) != fingerprint ||
+        load_u32(header + 12) != (uint32_t) fieldc) {
+        PyErr_Format(PyExc_ValueError,
+                     "packed records do not match the fields of %s",
+                     cls->tp_name);
+        return -1;
+    }
+    /* Every value takes at least one byte. */
+    nrecords = load_u64(header + 16);
+    if (fieldc && nrecords > (uint64_t) (pr->pr_left / fieldc)) {
+        PyErr_SetString(PyExc_ValueError, "packed records are truncated");
+        return -1;
+    }
+    if (nrecords > (uint64_t) PY_SSIZE_T_MAX) {
+        PyErr_SetString(PyExc_ValueError, "too many packed records");
+        return -1;
+    }
+    return (Py_ssize_t) nrecords;
+}
+
+/* Rebuild the instances of `cls` from packed data.
+   return: A new list or NULL in case of error. */
+static PyObject *
+unpack_records(PyTypeObject *cls, const void *data, Py_ssize_t len)
+{
+    pack_reader pr = {data, len, NULL};
+    namedtuple_fields *info;
+    Py_ssize_t fieldc;
+    Py_ssize_t nrecords;
+    PyObject **values = NULL;
+    PyObject *ret = NULL;
+    PyObject *record;
+    Py_ssize_t ix;
+    Py_ssize_t n;
+
+    if (!(info = get_fields_info(cls, (PyObject*) cls))) {
+        return NULL;
+    }
+    fieldc = FIELDS_COUNT(info);
+    Py_DECREF(info);
+
+    if ((nrecords = unpack_header(&pr, cls, fieldc)) < 0) {
+        return NULL;
+    }
+    if (!(values = PyMem_New(PyObject*, fieldc + 1))) {
+        PyErr_NoMemory();
+        return NULL;
+    }
+    if (!(ret = PyList_New(nrecords))) {
+        goto done;
+    }
+    /* `__new__` and `pickle.loads` may run Python code which could see the
+       empty slots. */
+    PyObject_GC_UnTrack(ret);
+
+    for (ix = 0;ix < nrecords;++ix) {
+        for (n = 0;n < fieldc;++n) {
+            if (!(values[n] = unpack_value(&pr))) {
+                while (n--) {
+                    Py_DECREF(values[n]);
+                }
+                goto error;
+            }
+        }
+        record = namedtuple_from_array(cls, values, fieldc);
+        for (n = 0;n < fieldc;++n) {
+            Py_DECREF(values[n]);
+        }
+        if (!record) {
+            goto error;
+        }
+        PyList_SET_ITEM(ret, ix, record);
+    }
+    if (pr.pr_left) {
+        PyErr_Format(PyExc_ValueError,
+                     "%zd bytes left over after the packed records",
+                     pr.pr_left);
+        goto error;
+    }
+    PyObject_GC_Track(ret);
+    goto done;
+
+error:
+    PyObject_GC_Track(ret);
+    Py_CLEAR(ret);
+done:
+    Py_XDECREF(pr.pr_loads);
+    PyMem_Free(values);
+    return ret;
+}
+
+/* Namedtuple class method for unpacking the output of `_pack`. The buffer is
+   read in place.
+   return: A new list or NULL in case of error. */
+static PyObject *
+namedtuple__unpack_many(PyObject *cls, PyObject *buf)
+{
+    Py_buffer view;
+    PyObject *ret;
+
+    if (PyObject_GetBuffer(buf, &view, PyBUF_SIMPLE)) {
+        return NULL;
+    }
+    ret = unpack_records((PyTypeObject*) cls, view.buf, view.len);
+    PyBuffer_Release(&view);
+    return ret;
+}
+
+/* A batch of records held in packed form. Pickling a batch writes the type
+   once and, with protocol 5, hands the packed data to pickle as an
+   out-of-band buffer. */
+typedef struct{
+    PyObject_HEAD
+    PyTypeObject *nb_type;  /* The type of the records. */
+    PyObject *nb_data;      /* An object exporting the output of `_pack`. */
+    Py_ssize_t nb_len;      /* The number of records. */
+}namedtuple_batch;
+
+PyTypeObject namedtuple_batch_type;
+
+/* Create a batch of `cls` records from packed data. Only the header is
+   checked, the records are decoded when they are read.
+   return: A new batch or NULL in case of error. */
+static PyObject *
+namedtuple_batch_new(PyTypeObject *cls, PyObject *data)
+{
+    namedtuple_fields *info;
+    namedtuple_batch *self;
+    pack_reader pr;
+    Py_buffer view;
+    Py_ssize_t fieldc;
+    Py_ssize_t len;
+
+    if (!(info = get_fields_info(cls, (PyObject*) cls))) {
+        return NULL;
+    }
+    fieldc = FIELDS_COUNT(info);
+    Py_DECREF(info);
+
+    if (PyObject_GetBuffer(data, &view, PyBUF_SIMPLE)) {
+        return NULL;
+    }
+    pr.pr_data = view.buf;
+    pr.pr_left = view.len;
+    pr.pr_loads = NULL;
+    len = unpack_header(&pr, cls, fieldc);
+    PyBuffer_Release(&view);
+    if (len < 0) {
+        return NULL;
+    }
+
+    if (!(self = PyObject_GC_New(namedtuple_batch, &namedtuple_batch_type))) {
+        return NULL;
+    }
+    Py_INCREF(cls);
+    self->nb_type = cls;
+    Py_INCREF(data);
+    self->nb_data = data;
+    self->nb_len = len;
+    PyObject_GC_Track(self);
+    return (PyObject*) self;
+}
+
+static int
+namedtuple_batch_traverse(namedtuple_batch *self, visitproc visit, void *arg)
+{
+    Py_VISIT(self->nb_type);
+    Py_VISIT(self->nb_data);
+    return 0;
+}
+
+static int
+namedtuple_batch_clear(namedtuple_batch *self)
+{
+    Py_CLEAR(self->nb_type);
+    Py_CLEAR(self->nb_data);
+    return 0;
+}
+
+static void
+namedtuple_batch_dealloc(namedtuple_batch *self)
+{
+    PyObject_GC_UnTrack(self);
+    namedtuple_batch_clear(self);
+    PyObject_GC_Del(self);
+}
+
+static Py_ssize_t
+namedtuple_batch_length(namedtuple_batch *self)
+{
+    return self->nb_len;
+}
+
+/* Decode every record in the batch.
+   return: A new list or NULL in case of error. */
+static PyObject *
+namedtuple_batch_tolist(namedtuple_batch *self, PyObject *_)
+{
+    Py_buffer view;
+    PyObject *ret;
+
+    if (PyObject_GetBuffer(self->nb_data, &view, PyBUF_SIMPLE)) {
+        return NULL;
+    }
+    ret = unpack_records(self->nb_type, view.buf, view.len);
+    PyBuffer_Release(&view);
+    return ret;
+}
+
+static PyObject *
+namedtuple_batch_iter(namedtuple_batch *self)
+{
+    PyObject *records = namedtuple_batch_tolist(self, NULL);
+    PyObject *ret;
+
+    if (!records) {
+        return NULL;
+    }
+    ret = PyObject_GetIter(records);
+    Py_DECREF(records);
+    return ret;
+}
+
+static PyObject *
+namedtuple_batch_repr(namedtuple_batch *self)
+{
+    return PyUnicode_FromFormat("<%s batch of %zd records>",
+                                self->nb_type->tp_name,
+                                self->nb_len);
+}
+
+/* Pickle protocol for batches. Protocol 5 wraps the packed data in a
+   `PickleBuffer` so that it may be sent out-of-band.
+   return: A tuple `(_batch_from_buffer, (type, data))` or NULL in case of
+   error. */
+static PyObject *
+namedtuple_batch_reduce_ex(namedtuple_batch *self, PyObject *protocol_ob)
+{
+    long protocol = PyLong_AsLong(protocol_ob);
+    PyObject *module;
+    PyObject *rebuild;
+    PyObject *payload;
+    PyObject *ret;
+
+    if (protocol == -1 && PyErr_Occurred()) {
+        return NULL;
+    }
+    if (!(module = PyState_FindModule(&_namedtuplemodule))) {
+        PyErr_SetString(PyExc_RuntimeError, "_namedtuple module not loaded");
+        return NULL;
+    }
+    if (!(rebuild = PyObject_GetAttrString(module, "_batch_from_buffer"))) {
+        return NULL;
+    }
+
+#if PY_VERSION_HEX >= 0x03080000
+    if (protocol >= 5) {
+        payload = PyPickleBuffer_FromObject(self->nb_data);
+    }
+    else
+#endif
+    payload = PyBytes_FromObject(self->nb_data);
+    if (!payload) {
+        Py_DECREF(rebuild);
+        return NULL;
+    }
+    ret = Py_BuildValue("N(ON)", rebuild, self->nb_type, payload);
+    return ret;
+}
+
+static PyObject *
+namedtuple_batch_get_type(namedtuple_batch *self, void *_)
+{
+    Py_INCREF(self->nb_type);
+    return (PyObject*) self->nb_type;
+}
+
+static PyObject *
+namedtuple_batch_get_data(namedtuple_batch *self, void *_)
+{
+    Py_INCREF(self->nb_data);
+    return self->nb_data;
+}
+
+PyDoc_STRVAR(namedtuple_batch_tolist_doc,
+"tolist() -> list\n\n"
+"Decode every record in the batch.");
+
+PyMethodDef namedtuple_batch_methods[] = {
+    {"tolist",
+     (PyCFunction) namedtuple_batch_tolist,
+     METH_NOARGS,
+     namedtuple_batch_tolist_doc},
+    {"__reduce_ex__",
+     (PyCFunction) namedtuple_batch_reduce_ex,
+     METH_O,
+     NULL},
+    {NULL},
+};
+
+PyGetSetDef namedtuple_batch_getsets[] = {
+    {"type",
+     (getter) namedtuple_batch_get_type,
+     NULL,
+     "The namedtuple type of the records."},
+    {"data",
+     (getter) namedtuple_batch_get_data,
+     NULL,
+     "The object exporting the packed records."},
+    {NULL},
+};
+
+PySequenceMethods namedtuple_batch_as_sequence = {
+    (lenfunc) namedtuple_batch_length,          /* sq_length */
+};
+
+PyDoc_STRVAR(namedtuple_batch_doc,
+"A batch of records in the format written by '_pack'. Created with\n"
+"'NT._batch(records)'.");
+
+PyTypeObject namedtuple_batch_type = {
+    PyVarObject_HEAD_INIT(&PyType_Type, 0)
+    "_collections.NamedTupleBatch",             /* tp_name */
+    sizeof(namedtuple_batch),                   /* tp_basicsize */
+    0,                                          /* tp_itemsize */
+    (destructor) namedtuple_batch_dealloc,      /* tp_dealloc */
+    0,                                          /* tp_print */
+    0,                                          /* tp_getattr */
+    0,                                          /* tp_setattr */
+    0,                                          /* tp_reserved */
+    (reprfunc) namedtuple_batch_repr,           /* tp_repr */
+    0,                                          /* tp_as_number */
+    &namedtuple_batch_as_sequence,              /* tp_as_sequence */
+    0,                                          /* tp_as_mapping */
+    PyObject_HashNotImplemented,                /* tp_hash */
+    0,                                          /* tp_call */
+    0,                                          /* tp_str */
+    PyObject_GenericGetAttr,                    /* tp_getattro */
+    0,                                          /* tp_setattro */
+    0,                                          /* tp_as_buffer */
+    Py_TPFLAGS_DEFAULT | Py_TPFLAGS_HAVE_GC,    /* tp_flags */
+    namedtuple_batch_doc,                       /* tp_doc */
+    (traverseproc) namedtuple_batch_traverse,   /* tp_traverse */
+    (inquiry) namedtuple_batch_clear,           /* tp_clear */
+    0,                                          /* tp_richcompare */
+    0,                                          /* tp_weaklistoffset */
+    (getiterfunc) namedtuple_batch_iter,        /* tp_iter */
+    0,                                          /* tp_iternext */
+    namedtuple_batch_methods,                   /* tp_methods */
+    0,                                          /* tp_members */
+    namedtuple_batch_getsets,                   /* tp_getset */
+};
+
+/* Namedtuple class method for packing records into a batch.
+   return: A new batch or NULL in case of error. */
+static PyObject *
+namedtuple__batch(PyObject *cls, PyObject *records)
+{
+    PyObject *data = namedtuple__pack(cls, records);
+    PyObject *ret;
+
+    if (!data) {
+        return NULL;
+    }
+    ret = namedtuple_batch_new((PyTypeObject*) cls, data);
+    Py_DECREF(data);
+    return ret;
+}
+
+/* Record files.
+
+   `NT._dump(records, path)` writes the records column by column so that
+   `NT._open(path)` can map the file and decode single values in place:
+
+       magic        4 bytes   "CNTF"
+       version      4 bytes
+       fingerprint  8 bytes   as in `_pack`
+       fieldc       4 bytes
+       nrecords     8 bytes
+       typename     4 byte length + utf-8
+       fields       fieldc * (4 byte length + utf-8)
+       directory    fieldc * (1 byte encoding, 7 bytes padding, 8 byte offset)
+       columns      one per field, each starting on an 8 byte boundary
+
+   A column is encoded as one of:
+
+       'q'  nrecords 8 byte signed integers
+       'd'  nrecords 8 byte doubles
+       'v'  nrecords + 1 8 byte offsets followed by the tagged values of
+            `_pack`; value `n` spans offsets `n` to `n + 1`, relative to the
+            end of the offsets */
+#define FILE_MAGIC "CNTF"
+#define FILE_VERSION 1
+
+#define COLUMN_INT 'q'
+#define COLUMN_FLOAT 'd'
+#define COLUMN_TAGGED 'v'
+
+/* Pick the encoding for field `n` of the tuple `seq` of checked records.
+   return: The encoding or 0 in case of error. */
+static char
+column_encoding(PyObject *seq, Py_ssize_t n)
+{
+    PyObject *value;
+    Py_ssize_t ix;
+    int overflow;
+    int ints = 1;
+    int floats = 1;
+
+    for (ix = 0;ix < PyTuple_GET_SIZE(seq);++ix) {
+        value = PyTuple_GET_ITEM(PyTuple_GET_ITEM(seq, ix), n);
+        if (Py_TYPE(value) == &PyLong_Type && ints) {
+            floats = 0;
+            if (PyLong_AsLongLongAndOverflow(value, &overflow) == -1 &&
+                PyErr_Occurred()) {
+                return 0;
+            }
+            ints = !overflow;
+        }
+        else if (Py_TYPE(value) == &PyFloat_Type) {
+            ints = 0;
+        }
+        else {
+            return COLUMN_TAGGED;
+        }
+        if (!ints && !floats) {
+            return COLUMN_TAGGED;
+        }
+    }
+    return ints ? COLUMN_INT : floats ? COLUMN_FLOAT : COLUMN_TAGGED;
+}
+
+/* Write a length prefixed string.
+   return: Zero on succes, nonzero on failure. */
+static int
+file_write_str(pack_buffer *pb, PyObject *str)
+{
+    const char *data;
+    Py_ssize_t len;
+    unsigned char *p;
+
+    if (!(data = PyUnicode_AsUTF8AndSize(str, &len))) {
+        return -1;
+    }
+    if (!(p = pack_reserve(pb, 4 + len))) {
+        return -1;
+    }
+    store_u32(p, (uint32_t) len);
+    memcpy(p + 4, data, len);
+    return 0;
+}
+
+/* Pad the output to a multiple of 8 bytes.
+   return: Zero on succes, nonzero on failure. */
+static int
+file_align(pack_buffer *pb)
+{
+    Py_ssize_t pad = -pb->pb_len & 7;
+    unsigned char *p;
+
+    if (!(p = pack_reserve(pb, pad))) {
+        return -1;
+    }
+    memset(p, 0, pad);
+    return 0;
+}
+
+/* Write one column of the tuple `seq` of checked records. The tuple keeps
+   the records alive while `pack_value` runs pickle.
+   return: Zero on succes, nonzero on failure. */
+static int
+file_write_column(pack_buffer *pb, PyObject *seq, Py_ssize_t n, char enc)
+{
+    Py_ssize_t nrecords = PyTuple_GET_SIZE(seq);
+    PyObject *value;
+    Py_ssize_t offsets;
+    Py_ssize_t start;
+    unsigned char *p;
+    uint64_t bits;
+    double dv;
+    Py_ssize_t ix;
+
+    if (nrecords > (PY_SSIZE_T_MAX - 8) / 8) {
+        PyErr_NoMemory();
+        return -1;
+    }
+    if (enc != COLUMN_TAGGED) {
+        if (!(p = pack_reserve(pb, nrecords * 8))) {
+            return -1;
+        }
+        for (ix = 0;ix < nrecords;++ix) {
+            value = PyTuple_GET_ITEM(PyTuple_GET_ITEM(seq, ix), n);
+            if (enc == COLUMN_INT) {
+                bits = (uint64_t) PyLong_AsLongLong(value);
+            }
+            else {
+                dv = PyFloat_AS_DOUBLE(value);
+                memcpy(&bits, &dv, sizeof(bits));
+            }
+            store_u64(p + ix * 8, bits);
+        }
+        return 0;
+    }
+
+    offsets = pb->pb_len;
+    if (!pack_reserve(pb, (nrecords + 1) * 8)) {
+        return -1;
+    }
+    start = pb->pb_len;
+    for (ix = 0;ix < nrecords;++ix) {
+        store_u64((unsigned char*) PyBytes_AS_STRING(pb->pb_bytes) +
+                  offsets + ix * 8,
+                  (uint64_t) (pb->pb_len - start));
+        value = PyTuple_GET_ITEM(PyTuple_GET_ITEM(seq, ix), n);
+        if (pack_value(pb, value)) {
+            return -1;
+        }
+    }
+    store_u64((unsigned char*) PyBytes_AS_STRING(pb->pb_bytes) +
+              offsets + nrecords * 8,
+              (uint64_t) (pb->pb_len - start));
+    return 0;
+}
+
+/* Encode `records` as a record file into `pb`.
+   return: Zero on succes, nonzero on failure. */
+static int
+file_encode(pack_buffer *pb, PyTypeObject *cls, PyObject *records)
+{
+    namedtuple_fields *info;
+    Py_ssize_t fieldc;
+    uint64_t fingerprint;
+    PyObject *seq;
+    PyObject *record;
+    PyObject *typename;
+    Py_ssize_t directory;
+    Py_ssize_t nrecords;
+    unsigned char *p;
+    char enc;
+    Py_ssize_t ix;
+    Py_ssize_t n;
+
+    if (!(info = get_fields_info(cls, (PyObject*) cls))) {
+        return -1;
+    }
+    fieldc = FIELDS_COUNT(info);
+    if ((fingerprint = fields_fingerprint(info)) == (uint64_t) -1 &&
+        PyErr_Occurred()) {
+        Py_DECREF(info);
+        return -1;
+    }
+    /* The records are checked once and every column is written from the
+       same snapshot, whatever pickle does to `records`. */
+    if (!(seq = records_snapshot(records))) {
+        Py_DECREF(info);
+        return -1;
+    }
+    nrecords = PyTuple_GET_SIZE(seq);
+    for (ix = 0;ix < nrecords;++ix) {
+        record = PyTuple_GET_ITEM(seq, ix);
+        if (!PyObject_TypeCheck(record, cls) ||
+            PyTuple_GET_SIZE(record) < fieldc) {
+            PyErr_Format(PyExc_TypeError,
+                         "expected %s instance, got %R (record %zd)",
+                         cls->tp_name,
+                         record,
+                         ix);
+            goto error;
+        }
+    }
+
+    if (!(p = pack_reserve(pb, 28))) {
+        goto error;
+    }
+    memcpy(p, FILE_MAGIC, 4);
+    store_u32(p + 4, FILE_VERSION);
+    store_u64(p + 8, fingerprint);
+    store_u32(p + 16, (uint32_t) fieldc);
+    store_u64(p + 20, (uint64_t) nrecords);
+    if (!(typename = PyUnicode_FromString(cls->tp_name))) {
+        goto error;
+    }
+    n = file_write_str(pb, typename);
+    Py_DECREF(typename);
+    if (n) {
+        goto error;
+    }
+    for (n = 0;n < fieldc;++n) {
+        if (file_write_str(pb, FIELDS_NAME(info, n))) {
+            goto error;
+        }
+    }
+
+    if (file_align(pb)) {
+        goto error;
+    }
+    directory = pb->pb_len;
+    if (!(p = pack_reserve(pb, fieldc * 16))) {
+        goto error;
+    }
+    memset(p, 0, fieldc * 16);
+    for (n = 0;n < fieldc;++n) {
+        if (!(enc = column_encoding(seq, n)) || file_align(pb)) {
+            goto error;
+        }
+        p = (unsigned char*) PyBytes_AS_STRING(pb->pb_bytes) + directory;
+        p[n * 16] = enc;
+        store_u64(p + n * 16 + 8, (uint64_t) pb->pb_len);
+        if (file_write_column(pb, seq, n, enc)) {
+            goto error;
+        }
+    }
+
+    Py_DECREF(seq);
+    Py_DECREF(info);
+    return 0;
+
+error:
+    Py_DECREF(seq);
+    Py_DECREF(info);
+    return -1;
+}
+
+/* Namedtuple class method for writing records to a file.
+   return: None or NULL in case of error. */
+static PyObject *
+namedtuple__dump(PyObject *cls, PyObject *args)
+{
+    PyObject *records;
+    PyObject *path;
+    pack_buffer pb = {NULL, 0, NULL};
+    PyObject *io;
+    PyObject *file;
+    PyObject *res;
+
+    if (!PyArg_ParseTuple(args, "OO:_dump", &records, &path)) {
+        return NULL;
+    }
+    if (!(pb.pb_bytes = PyBytes_FromStringAndSize(NULL, 256))) {
+        return NULL;
+    }
+    if (file_encode(&pb, (PyTypeObject*) cls, records) ||
+        _PyBytes_Resize(&pb.pb_bytes, pb.pb_len)) {
+        Py_XDECREF(pb.pb_bytes);
+        Py_XDECREF(pb.pb_dumps);
+        return NULL;
+    }
+    Py_XDECREF(pb.pb_dumps);
+
+    if (!(io = PyImport_ImportModule("io"))) {
+        Py_DECREF(pb.pb_bytes);
+        return NULL;
+    }
+    file = PyObject_CallMethod(io, "open", "Os", path, "wb");
+    Py_DECREF(io);
+    if (!file) {
+        Py_DECREF(pb.pb_bytes);
+        return NULL;
+    }
+    res = PyObject_CallMethod(file, "write", "O", pb.pb_bytes);
+    Py_DECREF(pb.pb_bytes);
+    if (!res) {
+        /* Keep the write error, the file is closed when it is collected. */
+        Py_DECREF(file);
+        return NULL;
+    }
+    Py_DECREF(res);
+    res = PyObject_CallMethod(file, "close", NULL);
+    Py_DECREF(file);
+    if (!res) {
+        return NULL;
+    }
+    Py_DECREF(res);
+    Py_RETURN_NONE;
+}
+
+/* One column of a mapped record file. */
+typedef struct{
+    char fc_enc;                    /* The column encoding. */
+    const unsigned char *fc_data;   /* The fixed width values or the
+                                       offsets. */
+    const unsigned char *fc_values; /* The start of the tagged values. */
+    Py_ssize_t fc_size;             /* The number of bytes of tagged
+                                       values. */
+}file_column;
+
+/* A record file mapped into memory. Values are decoded when they are read. */
+typedef struct{
+    PyObject_HEAD
+    PyTypeObject *nf_type;  /* The type of the records. */
+    PyObject *nf_mmap;      /* The `mmap.mmap` of the file. */
+    Py_buffer nf_view;      /* A view of `nf_mmap`, `buf` is NULL once
+                               closed. */
+    Py_ssize_t nf_len;      /* The number of records. */
+    Py_ssize_t nf_fieldc;   /* The number of columns. */
+    Py_ssize_t nf_reading;  /* The number of reads in progress, the map
+                               cannot be closed while this is nonzero. */
+    file_column *nf_columns;
+    PyObject *nf_loads;     /* `pickle.loads`, imported on first use. */
+}namedtuple_file;
+
+PyTypeObject namedtuple_file_type;
+
+/* Read the header and column directory of a mapped file into `self`.
+   return: Zero on succes, nonzero on failure. */
+static int
+file_decode_header(namedtuple_file *self, namedtuple_fields *info)
+{
+    pack_reader pr = {self->nf_view.buf, self->nf_view.len, NULL};
+    const unsigned char *base = self->nf_view.buf;
+    const unsigned char *p;
+    uint64_t fingerprint;
+    uint64_t nrecords;
+    uint64_t offset;
+    uint64_t end;
+    file_column *column;
+    Py_ssize_t n;
+
+    if (!(p = pack_read(&pr, 28)) || memcmp(p, FILE_MAGIC, 4)) {
+        PyErr_Clear();
+        PyErr_SetString(PyExc_ValueError, "not a namedtuple record file");
+        return -1;
+    }
+    if (load_u32(p + 4) != FILE_VERSION) {
+        PyErr_Format(PyExc_ValueError,
+                     "unsupported record file version: %u",
+                     (unsigned int) load_u32(p + 4));
+        return -1;
+    }
+    if ((fingerprint = fields_fingerprint(info)) == (uint64_t) -1 &&
+        PyErr_Occurred()) {
+        return -1;
+    }
+    if (load_u64(p + 8) != fingerprint ||
+        load_u32(p + 16) != (uint32_t) FIELDS_COUNT(info)) {
+        PyErr_Format(PyExc_ValueError,
+                     "record file does not match the fields of %s",
+                     self->nf_type->tp_name);
+        return -1;
+    }
+    nrecords = load_u64(p + 20);
+    if (nrecords > (uint64_t) self->nf_view.len / 8 + 1) {
+        PyErr_SetString(PyExc_ValueError, "record file is truncated");
+        return -1;
+    }
+    self->nf_len = (Py_ssize_t) nrecords;
+
+    /* Skip the typename and the field names. */
+    for (n = 0;n <= FIELDS_COUNT(info);++n) {
+        if (!(p = pack_read(&pr, 4)) || !pack_read(&pr, load_u32(p))) {
+            return -1;
+        }
+    }
+    if (!pack_read(&pr, -(self->nf_view.len - pr.pr_left) & 7)) {
+        return -1;
+    }
+
+    for (n = 0;n < self->nf_fieldc;++n) {
+        if (!(p = pack_read(&pr, 16))) {
+            return -1;
+        }
+        column = &self->nf_columns[n];
+        column->fc_enc = p[0];
+        offset = load_u64(p + 8);
+        if (column->fc_enc != COLUMN_INT &&
+            column->fc_enc != COLUMN_FLOAT &&
+            column->fc_enc != COLUMN_TAGGED) {
+            PyErr_Format(PyExc_ValueError,
+                         "unknown column encoding: 0x%02x",
+                         (unsigned int) (unsigned char) column->fc_enc);
+            return -1;
+        }
+        end = offset + (nrecords + (column->fc_enc == COLUMN_TAGGED)) * 8;
+        if (offset > (uint64_t) self->nf_view.len ||
+            end > (uint64_t) self->nf_view.len) {
+            PyErr_SetString(PyExc_ValueError, "record file is truncated");
+            return -1;
+        }
+        column->fc_data = base + offset;
+        column->fc_values = base + end;
+        column->fc_size = self->nf_view.len - (Py_ssize_t) end;
+    }
+    return 0;
+}
+
+/* Call `mmap.mmap(fileno, 0, access=mmap.ACCESS_READ)`.
+   return: A new reference or NULL in case of error. */
+static PyObject *
+map_file(PyObject *mmap, PyObject *fileno)
+{
+    PyObject *args;
+    PyObject *kwargs;
+    PyObject *access;
+    PyObject *func;
+    PyObject *ret = NULL;
+
+    if (!(func = PyObject_GetAttrString(mmap, "mmap"))) {
+        return NULL;
+    }
+    if (!(access = PyObject_GetAttrString(mmap, "ACCESS_READ"))) {
+        Py_DECREF(func);
+        return NULL;
+    }
+    args = Py_BuildValue("(On)", fileno, (Py_ssize_t) 0);
+    kwargs = Py_BuildValue("{sN}", "access", access);
+    if (args && kwargs) {
+        ret = PyObject_Call(func, args, kwargs);
+    }
+    Py_XDECREF(args);
+    Py_XDECREF(kwargs);
+    Py_DECREF(func);
+    return ret;
+}
+
+/* Map the record file at `path` for reading `cls` records.
+   return: A new file or NULL in case of error. */
+static PyObject *
+namedtuple_file_new(PyTypeObject *cls, PyObject *path)
+{
+    namedtuple_fields *info;
+    namedtuple_file *self;
+    PyObject *io;
+    PyObject *mmap;
+    PyObject *file;
+    PyObject *fileno;
+    PyObject *res;
+
+    if (!(info = get_fields_info(cls, (PyObject*) cls))) {
+        return NULL;
+    }
+    if (!(self = PyObject_GC_New(namedtuple_file, &namedtuple_file_type))) {
+        Py_DECREF(info);
+        return NULL;
+    }
+    Py_INCREF(cls);
+    self->nf_type = cls;
+    self->nf_mmap = NULL;
+    self->nf_view.buf = NULL;
+    self->nf_len = 0;
+    self->nf_fieldc = FIELDS_COUNT(info);
+    self->nf_reading = 0;
+    self->nf_columns = NULL;
+    self->nf_loads = NULL;
+    PyObject_GC_Track(self);
+
+    if (!(self->nf_columns = PyMem_New(file_column, self->nf_fieldc + 1))) {
+        PyErr_NoMemory();
+        goto error;
+    }
+    if (!(io = PyImport_ImportModule("io"))) {
+        goto error;
+    }
+    file = PyObject_CallMethod(io, "open", "Os", path, "rb");
+    Py_DECREF(io);
+    if (!file) {
+        goto error;
+    }
+    if (!(mmap = PyImport_ImportModule("mmap"))) {
+        Py_DECREF(file);
+        goto error;
+    }
+    /* The map stays valid after the file is closed. */
+    if ((fileno = PyObject_CallMethod(file, "fileno", NULL))) {
+        self->nf_mmap = map_file(mmap, fileno);
+        Py_DECREF(fileno);
+    }
+    Py_DECREF(mmap);
+    if ((res = PyObject_CallMethod(file, "close", NULL))) {
+        Py_DECREF(res);
+    }
+    else if (self->nf_mmap) {
+        Py_CLEAR(self->nf_mmap);
+    }
+    Py_DECREF(file);
+    if (!self->nf_mmap) {
+        goto error;
+    }
+
+    if (PyObject_GetBuffer(self->nf_mmap, &self->nf_view, PyBUF_SIMPLE)) {
+        self->nf_view.buf = NULL;
+        goto error;
+    }
+    if (file_decode_header(self, info)) {
+        goto error;
+    }
+    Py_DECREF(info);
+    return (PyObject*) self;
+
+error:
+    Py_DECREF(info);
+    Py_DECREF(self);
+    return NULL;
+}
+
+/* Release the map.
+   return: Zero on succes, nonzero on failure. */
+static int
+namedtuple_file_release(namedtuple_file *self)
+{
+    PyObject *res;
+
+    if (self->nf_view.buf) {
+        PyBuffer_Release(&self->nf_view);
+        self->nf_view.buf = NULL;
+    }
+    if (self->nf_mmap) {
+        res = PyObject_CallMethod(self->nf_mmap, "close", NULL);
+        Py_CLEAR(self->nf_mmap);
+        if (!res) {
+            return -1;
+        }
+        Py_DECREF(res);
+    }
+    return 0;
+}
+
+static int
+namedtuple_file_traverse(namedtuple_file *self, visitproc visit, void *arg)
+{
+    Py_VISIT(self->nf_type);
+    Py_VISIT(self->nf_loads);
+    return 0;
+}
+
+static int
+namedtuple_file_clear(namedtuple_file *self)
+{
+    Py_CLEAR(self->nf_type);
+    Py_CLEAR(self->nf_loads);
+    return 0;
+}
+
+static void
+namedtuple_file_dealloc(namedtuple_file *self)
+{
+    PyObject *type;
+    PyObject *value;
+    PyObject *tb;
+
+    PyObject_GC_UnTrack(self);
+    /* Closing the map runs Python code, which must not see an exception
+       that is being raised while a file is freed. */
+    PyErr_Fetch(&type, &value, &tb);
+    if (namedtuple_file_release(self)) {
+        PyErr_WriteUnraisable((PyObject*) self);
+    }
+    PyErr_Restore(type, value, tb);
+    namedtuple_file_clear(self);
+    PyMem_Free(self->nf_columns);
+    PyObject_GC_Del(self);
+}
+
+/* return: Zero if the file is open, nonzero with an exception set if it was
+   closed. */
+static int
+namedtuple_file_check_open(namedtuple_file *self)
+{
+    if (!self->nf_view.buf) {
+        PyErr_SetString(PyExc_ValueError, "record file is closed");
+        return -1;
+    }
+    return 0;
+}
+
+/* Decode the value of column `n` in record `ix`, which must be in range.
+   return: A new reference or NULL in case of error. */
+static PyObject *
+namedtuple_file_value(namedtuple_file *self, Py_ssize_t n, Py_ssize_t ix)
+{
+    file_column *column = &self->nf_columns[n];
+    pack_reader pr;
+    uint64_t bits;
+    uint64_t start;
+    uint64_t stop;
+    double dv;
+    PyObject *ret;
+
+    switch (column->fc_enc) {
+    case COLUMN_INT:
+        bits = load_u64(column->fc_data + ix * 8);
+        return PyLong_FromLongLong((long long) bits);
+    case COLUMN_FLOAT:
+        bits = load_u64(column->fc_data + ix * 8);
+        memcpy(&dv, &bits, sizeof(dv));
+        return PyFloat_FromDouble(dv);
+    }
+
+    start = load_u64(column->fc_data + ix * 8);
+    stop = load_u64(column->fc_data + ix * 8 + 8);
+    if (start > stop || stop > (uint64_t) column->fc_size) {
+        PyErr_SetString(PyExc_ValueError, "record file is corrupt");
+        return NULL;
+    }
+    pr.pr_data = column->fc_values + start;
+    pr.pr_left = (Py_ssize_t) (stop - start);
+    pr.pr_loads = self->nf_loads;
+    ret = unpack_value(&pr);
+    self->nf_loads = pr.pr_loads;
+    if (ret && pr.pr_left) {
+        Py_DECREF(ret);
+        PyErr_SetString(PyExc_ValueError, "record file is corrupt");
+        return NULL;
+    }
+    return ret;
+}
+
+static Py_ssize_t
+namedtuple_file_length(namedtuple_file *self)
+{
+    return self->nf_len;
+}
+
+/* The file must be locked. */
+static PyObject *
+namedtuple_file_item_locked(namedtuple_file *self, Py_ssize_t ix)
+{
+    PyObject **values;
+    PyObject *ret = NULL;
+    Py_ssize_t n;
+
+    if (namedtuple_file_check_open(self)) {
+        return NULL;
+    }
+    if (ix < 0 || ix >= self->nf_len) {
+        PyErr_SetString(PyExc_IndexError, "record index out of range");
+        return NULL;
+    }
+    if (!(values = PyMem_New(PyObject*, self->nf_fieldc + 1))) {
+        return PyErr_NoMemory();
+    }
+    /* Decoding a pickled value runs Python code, which could otherwise
+       close the map under us. */
+    ++self->nf_reading;
+    for (n = 0;n < self->nf_fieldc;++n) {
+        if (!(values[n] = namedtuple_file_value(self, n, ix))) {
+            goto done;
+        }
+    }
+    ret = namedtuple_from_array(self->nf_type, values, self->nf_fieldc);
+done:
+    --self->nf_reading;
+    while (n--) {
+        Py_DECREF(values[n]);
+    }
+    PyMem_Free(values);
+    return ret;
+}
+
+static PyObject *
+namedtuple_file_item(namedtuple_file *self, Py_ssize_t ix)
+{
+    PyObject *ret;
+
+    Py_BEGIN_CRITICAL_SECTION(self);
+    ret = namedtuple_file_item_locked(self, ix);
+    Py_END_CRITICAL_SECTION();
+    return ret;
+}
+
+static PyObject *
+namedtuple_file_iter(namedtuple_file *self)
+{
+    return PySeqIter_New((PyObject*) self);
+}
+
+/* The file must be locked. */
+static PyObject *
+namedtuple_file_column_locked(namedtuple_file *self, PyObject *field)
+{
+    namedtuple_fields *info;
+    Py_ssize_t n;
+    Py_ssize_t ix;
+    PyObject *value;
+    PyObject *ret;
+
+    if (namedtuple_file_check_open(self)) {
+        return NULL;
+    }
+    if (!(info = get_fields_info(self->nf_type, (PyObject*) self->nf_type))) {
+        return NULL;
+    }
+    n = require_field(info, field);
+    Py_DECREF(info);
+    if (n < 0) {
+        return NULL;
+    }
+    if (!(ret = PyList_New(self->nf_len))) {
+        return NULL;
+    }
+    ++self->nf_reading;
+    for (ix = 0;ix < self->nf_len;++ix) {
+        if (!(value = namedtuple_file_value(self, n, ix))) {
+            Py_CLEAR(ret);
+            break;
+        }
+        PyList_SET_ITEM(ret, ix, value);
+    }
+    --self->nf_reading;
+    return ret;
+}
+
+static PyObject *
+namedtuple_file_column(namedtuple_file *self, PyObject *field)
+{
+    PyObject *ret;
+
+    Py_BEGIN_CRITICAL_SECTION(self);
+    ret = namedtuple_file_column_locked(self, field);
+    Py_END_CRITICAL_SECTION();
+    return ret;
+}
+
+static PyObject *
+namedtuple_file_close(namedtuple_file *self, PyObject *_)
+{
+    int err = -1;
+
+    Py_BEGIN_CRITICAL_SECTION(self);
+    if (self->nf_reading) {
+        PyErr_SetString(PyExc_BufferError,
+                        "cannot close a record file while it is being read");
+    }
+    else {
+        err = namedtuple_file_release(self);
+    }
+    Py_END_CRITICAL_SECTION();
+    if (err) {
+        return NULL;
+    }
+    Py_RETURN_NONE;
+}
+
+static PyObject *
+namedtuple_file_enter(namedtuple_file *self, PyObject *_)
+{
+    Py_INCREF(self);
+    return (PyObject*) self;
+}
+
+static PyObject *
+namedtuple_file_exit(namedtuple_file *self, PyObject *_)
+{
+    return namedtuple_file_close(self, NULL);
+}
+
+static PyObject *
+namedtuple_file_repr(namedtuple_file *self)
+{
+    int closed;
+
+    Py_BEGIN_CRITICAL_SECTION(self);
+    closed = !self->nf_view.buf;
+    Py_END_CRITICAL_SECTION();
+    return PyUnicode_FromFormat("<%s%s record file of %zd records>",
+                                closed ? "closed " : "",
+                                self->nf_type->tp_name,
+                                self->nf_len);
+}
+
+static PyObject *
+namedtuple_file_get_type(namedtuple_file *self, void *_)
+{
+    Py_INCREF(self->nf_type);
+    return (PyObject*) self->nf_type;
+}
+
+static PyObject *
+namedtuple_file_get_encodings(namedtuple_file *self, void *_)
+{
+    PyObject *ret;
+    PyObject *enc;
+    Py_ssize_t n;
+
+    if (!(ret = PyTuple_New(self->nf_fieldc))) {
+        return NULL;
+    }
+    for (n = 0;n < self->nf_fieldc;++n) {
+        if (!(enc = PyUnicode_FromStringAndSize(
+                  &self->nf_columns[n].fc_enc, 1))) {
+            Py_DECREF(ret);
+            return NULL;
+        }
+        PyTuple_SET_ITEM(ret, n, enc);
+    }
+    return ret;
+}
+
+static PyObject *
+namedtuple_file_get_closed(namedtuple_file *self, void *_)
+{
+    int closed;
+
+    Py_BEGIN_CRITICAL_SECTION(self);
+    closed = !self->nf_view.buf;
+    Py_END_CRITICAL_SECTION();
+    return PyBool_FromLong(closed);
+}
+
+PyDoc_STRVAR(namedtuple_file_column_doc,
+"column(field) -> list\n\n"
+"Read one field out of every record without creating the instances.");
+
+PyDoc_STRVAR(namedtuple_file_close_doc,
+"close() -> None\n\n"
+"Unmap the file. Reading records after closing raises a ValueError and\n"
+"closing while a record is being decoded raises a BufferError.");
+
+PyMethodDef namedtuple_file_methods[] = {
+    {"column",
+     (PyCFunction) namedtuple_file_column,
+     METH_O,
+     namedtuple_file_column_doc},
+    {"close",
+     (PyCFunction) namedtuple_file_close,
+     METH_NOARGS,
+     namedtuple_file_close_doc},
+    {"__enter__",
+     (PyCFunction) namedtuple_file_enter,
+     METH_NOARGS,
+     NULL},
+    {"__exit__",
+     (PyCFunction) namedtuple_file_exit,
+     METH_VARARGS,
+     NULL},
+    {NULL},
+};
+
+PyGetSetDef namedtuple_file_getsets[] = {
+    {"type",
+     (getter) namedtuple_file_get_type,
+     NULL,
+     "The namedtuple type of the records."},
+    {"encodings",
+     (getter) namedtuple_file_get_encodings,
+     NULL,
+     "The encoding of each column: 'q', 'd' or 'v'."},
+    {"closed",
+     (getter) namedtuple_file_get_closed,
+     NULL,
+     "Whether the file has been closed."},
+    {NULL},
+};
+
+PySequenceMethods namedtuple_file_as_sequence = {
+    (lenfunc) namedtuple_file_length,           /* sq_length */
+    0,                                          /* sq_concat */
+    0,                                          /* sq_repeat */
+    (ssizeargfunc) namedtuple_file_item,        /* sq_item */
+};
+
+PyDoc_STRVAR(namedtuple_file_doc,
+"A read only sequence of the records in a file written by '_dump'. Created\n"
+"with 'NT._open(path)'.");
+
+PyTypeObject namedtuple_file_type = {
+    PyVarObject_HEAD_INIT(&PyType_Type, 0)
+    "_collections.NamedTupleFile",              /* tp_name */
+    sizeof(namedtuple_file),                    /* tp_basicsize */
+    0,                                          /* tp_itemsize */
+    (destructor) namedtuple_file_dealloc,       /* tp_dealloc */
+    0,                                          /* tp_print */
+    0,                                          /* tp_getattr */
+    0,                                          /* tp_setattr */
+    0,                                          /* tp_reserved */
+    (reprfunc) namedtuple_file_repr,            /* tp_repr */
+    0,                                          /* tp_as_number */
+    &namedtuple_file_as_sequence,               /* tp_as_sequence */
+    0,                                          /* tp_as_mapping */
+    PyObject_HashNotImplemented,                /* tp_hash */
+    0,                                          /* tp_call */
+    0,                                          /* tp_str */
+    PyObject_GenericGetAttr,                    /* tp_getattro */
+    0,                                          /* tp_setattro */
+    0,                                          /* tp_as_buffer */
+    Py_TPFLAGS_DEFAULT | Py_TPFLAGS_HAVE_GC,    /* tp_flags */
+    namedtuple_file_doc,                        /* tp_doc */
+    (traverseproc) namedtuple_file_traverse,    /* tp_traverse */
+    (inquiry) namedtuple_file_clear,            /* tp_clear */
+    0,                                          /* tp_richcompare */
+    0,                                          /* tp_weaklistoffset */
+    (getiterfunc) namedtuple_file_iter,         /* tp_iter */
+    0,                                          /* tp_iternext */
+    namedtuple_file_methods,                    /* tp_methods */
+    0,                                          /* tp_members */
+    namedtuple_file_getsets,                    /* tp_getset */
+};
+
+/* Namedtuple class method for mapping a record file.
+   return: A new file or NULL in case of error. */
+static PyObject *
+namedtuple__open(PyObject *cls, PyObject *path)
+{
+    return namedtuple_file_new((PyTypeObject*) cls, path);
+}
+
+/* Delimited text reader.
+
+   `NT._read_csv` parses the quoting rules of `csv.excel`: fields are
+   separated by the delimiter, records by '\n', '\r' or '\r\n' and fields
+   may be wrapped in double quotes, inside of which the delimiter and
+   newlines are literal and '""' is one quote. Blank lines are skipped. */
+#define CSV_CHUNK_SIZE 65536
+
+typedef enum{
+    CSV_START_FIELD,        /* At the start of a field. */
+    CSV_IN_FIELD,           /* Inside of an unquoted field. */
+    CSV_IN_QUOTED_FIELD,    /* Inside of a quoted field. */
+    CSV_QUOTE_IN_QUOTED,    /* After a quote inside of a quoted field. */
+    CSV_EAT_NEWLINE,        /* After a '\r' which ended a record. */
+}csv_state;
+
+typedef struct{
+    PyTypeObject *cr_type;      /* The type of the records. */
+    namedtuple_fields *cr_info; /* The field metadata of `cr_type`. */
+    Py_ssize_t cr_fieldc;       /* The number of fields. */
+    PyObject *cr_header;        /* True, False or a mapping from column name
+                                   to field name. */
+    Py_UCS4 cr_delimiter;       /* The field separator. */
+    csv_state cr_state;         /* The parser state. */
+    Py_UCS4 *cr_field;          /* The characters of the current field. */
+    Py_ssize_t cr_field_len;
+    Py_ssize_t cr_field_cap;
+    PyObject **cr_row;          /* The fields of the current record. */
+    Py_ssize_t cr_row_len;
+    Py_ssize_t cr_row_cap;
+    Py_ssize_t cr_ncolumns;     /* The number of columns or -1 until the
+                                   header has been read. */
+    Py_ssize_t *cr_columns;     /* The field of each column or NULL if the
+                                   columns are in field order. */
+    PyObject **cr_converters;   /* A callable or NULL for each field. */
+    PyObject **cr_values;       /* The fields of the record being built. */
+    Py_ssize_t cr_line;         /* The number of records read, including
+                                   the header. */
+    PyObject *cr_records;       /* The output list. */
+}csv_reader;
+
+/* Append a character to the current field.
+   return: Zero on succes, nonzero on failure. */
+static int
+csv_add_char(csv_reader *cr, Py_UCS4 c)
+{
+    Py_UCS4 *field;
+    Py_ssize_t cap;
+
+    if (cr->cr_field_len == cr->cr_field_cap) {
+        cap = cr->cr_field_cap ? cr->cr_field_cap * 2 : 64;
+        if (!(field = PyMem_Realloc(cr->cr_field, cap * sizeof(Py_UCS4)))) {
+            PyErr_NoMemory();
+            return -1;
+        }
+        cr->cr_field = field;
+        cr->cr_field_cap = cap;
+    }
+    cr->cr_field[cr->cr_field_len++] = c;
+    return 0;
+}
+
+/* Append a field to the current record. `field` is stolen and may be NULL
+   to propagate an error.
+   return: Zero on succes, nonzero on failure. */
+static int
+csv_push_field(csv_reader *cr, PyObject *field)
+{
+    PyObject **row;
+    Py_ssize_t cap;
+
+    if (!field) {
+        return -1;
+    }
+    if (cr->cr_ncolumns >= 0 && cr->cr_row_len == cr->cr_ncolumns) {
+        PyErr_Format(PyExc_ValueError,
+                     "record %zd has more than %zd columns",
+                     cr->cr_line + 1,
+                     cr->cr_ncolumns);
+        Py_DECREF(field);
+        return -1;
+    }
+    if (cr->cr_row_len == cr->cr_row_cap) {
+        cap = cr->cr_row_cap ? cr->cr_row_cap * 2 : 8;
+        if (!(row = PyMem_Realloc(cr->cr_row, cap * sizeof(PyObject*)))) {
+            PyErr_NoMemory();
+            Py_DECREF(field);
+            return -1;
+        }
+        cr->cr_row = row;
+        cr->cr_row_cap = cap;
+    }
+    cr->cr_row[cr->cr_row_len++] = field;
+    return 0;
+}
+
+/* Move the current field onto the current record.
+   return: Zero on succes, nonzero on failure. */
+static int
+csv_end_field(csv_reader *cr)
+{
+    Py_ssize_t len = cr->cr_field_len;
+
+    cr->cr_field_len = 0;
+    return csv_push_field(cr,
+                          PyUnicode_FromKindAndData(PyUnicode_4BYTE_KIND,
+                                                    cr->cr_field,
+                                                    len));
+}
+
+/* Map the columns named by the header record to the fields.
+   return: Zero on succes, nonzero on failure. */
+static int
+csv_read_header(csv_reader *cr)
+{
+    Py_ssize_t ncolumns = cr->cr_row_len;
+    PyObject *name;
+    Py_ssize_t n;
+    Py_ssize_t ix;
+    int ordered = ncolumns == cr->cr_fieldc;
+
+    if (!(cr->cr_columns = PyMem_New(Py_ssize_t, ncolumns + 1))) {
+        PyErr_NoMemory();
+        return -1;
+    }
+    for (n = 0;n < ncolumns;++n) {
+        if (PyBool_Check(cr->cr_header)) {
+            Py_INCREF(cr->cr_row[n]);
+            name = cr->cr_row[n];
+        }
+        else if (!(name = PyObject_GetItem(cr->cr_header, cr->cr_row[n]))) {
+            if (!PyErr_ExceptionMatches(PyExc_KeyError)) {
+                return -1;
+            }
+            PyErr_Clear();
+            Py_INCREF(cr->cr_row[n]);
+            name = cr->cr_row[n];
+        }
+        ix = find_field(cr->cr_info, name);
+        if (ix == -1) {
+            PyErr_Format(PyExc_ValueError,
+                         "column %R is not a field of %s",
+                         name,
+                         cr->cr_type->tp_name);
+        }
+        Py_DECREF(name);
+        if (ix < 0) {
+            return -1;
+        }
+        cr->cr_columns[n] = ix;
+        ordered &= ix == n;
+    }
+
+    for (ix = 0;ix < cr->cr_fieldc;++ix) {
+        Py_ssize_t count = 0;
+
+        for (n = 0;n < ncolumns;++n) {
+            count += cr->cr_columns[n] == ix;
+        }
+        if (count != 1) {
+            PyErr_Format(PyExc_ValueError,
+                         "%s column for field %R",
+                         count ? "duplicate" : "missing",
+                         FIELDS_NAME(cr->cr_info, ix));
+            return -1;
+        }
+    }
+    if (ordered) {
+        PyMem_Free(cr->cr_columns);
+        cr->cr_columns = NULL;
+    }
+    cr->cr_ncolumns = ncolumns;
+    return 0;
+}
+
+/* Build an instance out of the current record and append it to the output.
+   return: Zero on succes, nonzero on failure. */
+static int
+csv_end_record(csv_reader *cr)
+{
+    PyObject *value;
+    PyObject *converter;
+    PyObject *record;
+    Py_ssize_t n;
+    Py_ssize_t ix;
+    int err = -1;
+
+    if (cr->cr_ncolumns < 0) {
+        err = csv_read_header(cr);
+        goto done;
+    }
+    if (cr->cr_row_len != cr->cr_ncolumns) {
+        PyErr_Format(PyExc_ValueError,
+                     "record %zd has %zd columns, expected %zd",
+                     cr->cr_line + 1,
+                     cr->cr_row_len,
+                     cr->cr_ncolumns);
+        goto done;
+    }
+
+    for (n = 0;n < cr->cr_row_len;++n) {
+        ix = cr->cr_columns ? cr->cr_columns[n] : n;
+        value = cr->cr_row[n];
+        cr->cr_row[n] = NULL;
+        if ((converter = cr->cr_converters[ix])) {
+            PyObject *converted;
+
+            /* Parse numbers without the call overhead. */
+            if (converter == (PyObject*) &PyLong_Type) {
+                converted = PyLong_FromUnicodeObject(value, 10);
+            }
+            else if (converter == (PyObject*) &PyFloat_Type) {
+                converted = PyFloat_FromString(value);
+            }
+            else {
+                converted = PyObject_CallFunctionObjArgs(converter,
+                                                         value,
+                                                         NULL);
+            }
+            Py_DECREF(value);
+            value = converted;
+        }
+        cr->cr_values[ix] = value;
+        if (!value) {
+            /* Release the values converted so far. */
+            while (n--) {
+                ix = cr->cr_columns ? cr->cr_columns[n] : n;
+                Py_CLEAR(cr->cr_values[ix]);
+            }
+            goto done;
+        }
+    }
+    cr->cr_row_len = 0;
+
+    record = namedtuple_from_array(cr->cr_type,
+                                   cr->cr_values,
+                                   cr->cr_fieldc);
+    for (ix = 0;ix < cr->cr_fieldc;++ix) {
+        Py_CLEAR(cr->cr_values[ix]);
+    }
+    if (!record) {
+        goto done;
+    }
+    err = PyList_Append(cr->cr_records, record);
+    Py_DECREF(record);
+
+done:
+    while (cr->cr_row_len) {
+        --cr->cr_row_len;
+        Py_CLEAR(cr->cr_row[cr->cr_row_len]);
+    }
+    ++cr->cr_line;
+    return err;
+}
+
+/* Feed one character to the parser.
+   return: Zero on succes, nonzero on failure. */
+static int
+csv_feed(csv_reader *cr, Py_UCS4 c)
+{
+    switch (cr->cr_state) {
+    case CSV_EAT_NEWLINE:
+        cr->cr_state = CSV_START_FIELD;
+        if (c == '\n') {
+            return 0;
+        }
+        /* fall through */
+    case CSV_START_FIELD:
+        if (c == '\n' || c == '\r') {
+            cr->cr_state = (c == '\r') ? CSV_EAT_NEWLINE : CSV_START_FIELD;
+            /* A newline at the start of a record is a blank line. */
+            if (!cr->cr_row_len) {
+                return 0;
+            }
+            return csv_end_field(cr) || csv_end_record(cr);
+        }
+        if (c == '"') {
+            cr->cr_state = CSV_IN_QUOTED_FIELD;
+            return 0;
+        }
+        if (c == cr->cr_delimiter) {
+            return csv_end_field(cr);
+        }
+        cr->cr_state = CSV_IN_FIELD;
+        return csv_add_char(cr, c);
+    case CSV_IN_FIELD:
+    case CSV_QUOTE_IN_QUOTED:
+        if (c == '\n' || c == '\r') {
+            cr->cr_state = (c == '\r') ? CSV_EAT_NEWLINE : CSV_START_FIELD;
+            return csv_end_field(cr) || csv_end_record(cr);
+        }
+        if (c == cr->cr_delimiter) {
+            cr->cr_state = CSV_START_FIELD;
+            return csv_end_field(cr);
+        }
+        if (c == '"' && cr->cr_state == CSV_QUOTE_IN_QUOTED) {
+            cr->cr_state = CSV_IN_QUOTED_FIELD;
+            return csv_add_char(cr, c);
+        }
+        /* Like `csv`, keep text after a closing quote. */
+        cr->cr_state = CSV_IN_FIELD;
+        return csv_add_char(cr, c);
+    case CSV_IN_QUOTED_FIELD:
+        if (c == '"') {
+            cr->cr_state = CSV_QUOTE_IN_QUOTED;
+            return 0;
+        }
+        return csv_add_char(cr, c);
+    }
+    return 0;
+}
+
+/* Finish the last record at the end of the input.
+   return: Zero on succes, nonzero on failure. */
+static int
+csv_finish(csv_reader *cr)
+{
+    switch (cr->cr_state) {
+    case CSV_IN_QUOTED_FIELD:
+        PyErr_Format(PyExc_ValueError,
+                     "unexpected end of data in a quoted field (record %zd)",
+                     cr->cr_line + 1);
+        return -1;
+    case CSV_START_FIELD:
+        if (!cr->cr_row_len) {
+            return 0;
+        }
+        /* fall through */
+    case CSV_IN_FIELD:
+    case CSV_QUOTE_IN_QUOTED:
+        return csv_end_field(cr) || csv_end_record(cr);
+    case CSV_EAT_NEWLINE:
+        return 0;
+    }
+    return 0;
+}
+
+/* Read `fileobj` in chunks and feed it to the parser.
+   return: Zero on succes, nonzero on failure. */
+static int
+csv_parse(csv_reader *cr, PyObject *fileobj)
+{
+    PyObject *read;
+    PyObject *chunk;
+    Py_ssize_t len;
+    Py_ssize_t n;
+    int kind;
+    void *data;
+
+    if (!(read = PyObject_GetAttrString(fileobj, "read"))) {
+        return -1;
+    }
+    for (;;) {
+        if (!(chunk = PyObject_CallFunction(read, "n", CSV_CHUNK_SIZE))) {
+            goto error;
+        }
+        if (!PyUnicode_Check(chunk)) {
+            PyErr_Format(PyExc_TypeError,
+                         "fileobj must be opened in text mode, read() "
+                         "returned %s",
+                         Py_TYPE(chunk)->tp_name);
+            Py_DECREF(chunk);
+            goto error;
+        }
+        if (PyUnicode_READY(chunk)) {
+            Py_DECREF(chunk);
+            goto error;
+        }
+        if (!(len = PyUnicode_GET_LENGTH(chunk))) {
+            Py_DECREF(chunk);
+            break;
+        }
+        kind = PyUnicode_KIND(chunk);
+        data = PyUnicode_DATA(chunk);
+        for (n = 0;n < len;++n) {
+            if (kind == PyUnicode_1BYTE_KIND &&
+                cr->cr_state == CSV_START_FIELD) {
+                /* An unquoted field which ends in this chunk is sliced out
+                   of it without going through `cr_field`. */
+                const Py_UCS1 *start = (const Py_UCS1*) data + n;
+                const Py_UCS1 *end = (const Py_UCS1*) data + len;
+                const Py_UCS1 *p = start;
+
+                while (p < end &&
+                       *p != cr->cr_delimiter &&
+                       *p != '\n' &&
+                       *p != '\r' &&
+                       *p != '"') {
+                    ++p;
+                }
+                if (p > start && p < end && *p != '"') {
+                    if (csv_push_field(
+                            cr,
+                            PyUnicode_FromKindAndData(PyUnicode_1BYTE_KIND,
+                                                      start,
+                                                      p - start))) {
+                        goto error_chunk;
+                    }
+                    n += p - start;
+                    if (*p != cr->cr_delimiter) {
+                        cr->cr_state = (*p == '\r') ?
+                            CSV_EAT_NEWLINE :
+                            CSV_START_FIELD;
+                        if (csv_end_record(cr)) {
+                            goto error_chunk;
+                        }
+                    }
+                    continue;
+                }
+            }
+            if (csv_feed(cr, PyUnicode_READ(kind, data, n))) {
+                goto error_chunk;
+            }
+        }
+        Py_DECREF(chunk);
+    }
+    Py_DECREF(read);
+    return csv_finish(cr);
+
+error_chunk:
+    Py_DECREF(chunk);
+error:
+    Py_DECREF(read);
+    return -1;
+}
+
+/* Namedtuple class method for reading records from delimited text.
+   return: A new list or NULL in case of error. */
+static PyObject *
+namedtuple__read_csv(PyObject *cls, PyObject *args, PyObject *kwargs)
+{
+    const char * const argnames[] = {"fileobj",
+                                     "header",
+                                     "delimiter",
+                                     "converters",
+                                     NULL};
+    PyObject *fileobj;
+    PyObject *header = Py_True;
+    PyObject *delimiter = NULL;
+    PyObject *converters = Py_None;
+    PyObject *items = NULL;
+    PyObject *item;
+    csv_reader cr;
+    Py_ssize_t n;
+    Py_ssize_t ix;
+    PyObject *ret = NULL;
+
+    if (!PyArg_ParseTupleAndKeywords(args,
+                                     kwargs,
+                                     "O|OUO:_read_csv",
+                                     (char**) argnames,
+                                     &fileobj,
+                                     &header,
+                                     &delimiter,
+                                     &converters)) {
+        return NULL;
+    }
+
+    memset(&cr, 0, sizeof(cr));
+    cr.cr_type = (PyTypeObject*) cls;
+    cr.cr_header = header;
+    cr.cr_delimiter = ',';
+    cr.cr_state = CSV_START_FIELD;
+
+    if (delimiter) {
+        if (PyUnicode_READY(delimiter)) {
+            return NULL;
+        }
+        if (PyUnicode_GET_LENGTH(delimiter) != 1) {
+            PyErr_SetString(PyExc_TypeError,
+                            "delimiter must be a 1-character string");
+            return NULL;
+        }
+        cr.cr_delimiter = PyUnicode_READ_CHAR(delimiter, 0);
+        if (cr.cr_delimiter == '"' ||
+            cr.cr_delimiter == '\n' ||
+            cr.cr_delimiter == '\r') {
+            PyErr_Format(PyExc_ValueError,
+                         "invalid delimiter: %R",
+                         delimiter);
+            return NULL;
+        }
+    }
+
+    if (!(cr.cr_info = get_fields_info(cr.cr_type, cls))) {
+        return NULL;
+    }
+    cr.cr_fieldc = FIELDS_COUNT(cr.cr_info);
+    if (!PyBool_Check(header) && !PyMapping_Check(header)) {
+        PyErr_Format(PyExc_TypeError,
+                     "header must be a bool or a mapping, got %s",
+                     Py_TYPE(header)->tp_name);
+        goto done;
+    }
+    cr.cr_ncolumns = (header == Py_False) ? cr.cr_fieldc : -1;
+    if (!(cr.cr_converters = PyMem_New(PyObject*, cr.cr_fieldc + 1)) ||
+        !(cr.cr_values = PyMem_New(PyObject*, cr.cr_fieldc + 1))) {
+        PyErr_NoMemory();
+        goto done;
+    }
+    for (ix = 0;ix < cr.cr_fieldc;++ix) {
+        cr.cr_converters[ix] = NULL;
+        cr.cr_values[ix] = NULL;
+    }
+
+    if (converters != Py_None) {
+        if (!(items = PyMapping_Items(converters))) {
+            goto done;
+        }
+        for (n = 0;n < PyList_GET_SIZE(items);++n) {
+            item = PyList_GET_ITEM(items, n);
+            if (!PyTuple_Check(item) || PyTuple_GET_SIZE(item) != 2) {
+                PyErr_SetString(PyExc_TypeError,
+                                "converters must be a mapping");
+                goto done;
+            }
+            if ((ix = require_field(cr.cr_info,
+                                    PyTuple_GET_ITEM(item, 0))) < 0) {
+                goto done;
+            }
+            if (!PyCallable_Check(PyTuple_GET_ITEM(item, 1))) {
+                PyErr_Format(PyExc_TypeError,
+                             "converter for %R is not callable",
+                             PyTuple_GET_ITEM(item, 0));
+                goto done;
+            }
+            Py_INCREF(PyTuple_GET_ITEM(item, 1));
+            Py_XSETREF(cr.cr_converters[ix], PyTuple_GET_ITEM(item, 1));
+        }
+    }
+
+    if (!(cr.cr_records = PyList_New(0))) {
+        goto done;
+    }
+    if (csv_parse(&cr, fileobj)) {
+        Py_CLEAR(cr.cr_records);
+        goto done;
+    }
+    if (cr.cr_ncolumns < 0) {
+        PyErr_SetString(PyExc_ValueError, "missing header");
+        Py_CLEAR(cr.cr_records);
+        goto done;
+    }
+    ret = cr.cr_records;
+
+done:
+    if (cr.cr_converters) {
+        for (ix = 0;ix < cr.cr_fieldc;++ix) {
+            Py_XDECREF(cr.cr_converters[ix]);
+        }
+    }
+    while (cr.cr_row_len) {
+        --cr.cr_row_len;
+        Py_XDECREF(cr.cr_row[cr.cr_row_len]);
+    }
+    Py_XDECREF(items);
+    PyMem_Free(cr.cr_converters);
+    PyMem_Free(cr.cr_values);
+    PyMem_Free(cr.cr_field);
+    PyMem_Free(cr.cr_row);
+    PyMem_Free(cr.cr_columns);
+    Py_DECREF(cr.cr_info);
+    return ret;
+}
+
+/* Copy `self` into a fresh instance of its type with the fields named by
+   `kwnames` replaced. The keyword values are read straight out of the vector
+   call so the caller's arguments are never copied or mutated.
+   return:  new instance of `type(self)` with the kwargs
+   swapped out. On failure, returns NULL. */
+static PyObject *
+namedtuple__replace(PyObject *self,
+                    PyObject *const *args,
+                    Py_ssize_t nargs,
+                    PyObject *kwnames)
+{
+    PyTypeObject *cls = Py_TYPE(self);
+    Py_ssize_t size = PyTuple_GET_SIZE(self);
+    Py_ssize_t nkwargs = (kwnames) ? PyTuple_GET_SIZE(kwnames) : 0;
+    namedtuple_fields *info;
+    PyObject *unexpected = NULL;
+    PyObject *items;
+    PyObject *item;
+    PyObject *key;
+    PyObject *ret;
+    Py_ssize_t ix;
+    Py_ssize_t n;
+
+    if (nargs) {
+        /* No positional arguments allowed. */
+        PyErr_Format(PyExc_TypeError,
+                     "_replace takes no positional arguments (%zd given)",
+                     nargs);
+        return NULL;
+    }
+    if (!(info = get_fields_info(cls, self))) {
+        return NULL;
+    }
+
+    /* When `cls` uses our `tp_new` the copy is the new instance, otherwise it
+       is the argument tuple for `cls.__new__`. */
+    if (!(items = (cls->tp_new == namedtuple_new) ?
+          cls->tp_alloc(cls, size) :
+          PyTuple_New(size))) {
+        Py_DECREF(info);
+        return NULL;
+    }
+    for (n = 0;n < size;++n) {
+        item = PyTuple_GET_ITEM(self, n);
+        Py_INCREF(item);
+        PyTuple_SET_ITEM(items, n, item);
+    }
+
+    for (n = 0;n < nkwargs;++n) {
+        key = PyTuple_GET_ITEM(kwnames, n);
+        if ((ix = find_field(info, key)) == -2) {
+            goto error;
+        }
+        if (ix == -1 || ix >= size) {
+            if (!unexpected && !(unexpected = PyList_New(0))) {
+                goto error;
+            }
+            if (PyList_Append(unexpected, key)) {
+                goto error;
+            }
+            continue;
+        }
+        item = args[n];
+        Py_INCREF(item);
+        Py_SETREF(((PyTupleObject*) items)->ob_item[ix], item);
+    }
+
+    if (unexpected) {
+        PyErr_Format(PyExc_ValueError,
+                     "Got unexpected field names: %R",
+                     unexpected);
+        goto error;
+    }
+    Py_DECREF(info);
+
+    if (cls->tp_new == namedtuple_new) {
+        return items;
+    }
+    ret = cls->tp_new(cls, items, NULL);
+    Py_DECREF(items);
+    return ret;
+
+error:
+    Py_XDECREF(unexpected);
+    Py_DECREF(info);
+    Py_DECREF(items);
+    return NULL;
+}
+
+/* Check if the repr of any of `values` could call back into the repr of the
+   namedtuple that holds them. The builtin scalars cannot, which saves the
+   `Py_ReprEnter` bookkeeping for most records.
+   return: Nonzero if the repr needs recursion protection. */
+static int
+repr_may_recurse(PyObject *values)
+{
+    PyTypeObject *type;
+    Py_ssize_t n;
+
+    for (n = 0;n < PyTuple_GET_SIZE(values);++n) {
+        type = Py_TYPE(PyTuple_GET_ITEM(values, n));
+        if (type != &PyLong_Type &&
+            type != &PyFloat_Type &&
+            type != &PyUnicode_Type &&
+            type != &PyBytes_Type &&
+            type != &PyBool_Type &&
+            type != Py_TYPE(Py_None)) {
+            return 1;
+        }
+    }
+    return 0;
+}
+
+/* Write the repr of `self`, whose field values are the tuple `values`, in the
+   format `{typename}({f_1}={v_1}, ..., {f_n}={v_n})`. If `self` is already
+   being written further up the stack, "..." is written instead.
+   return: Zero on succes, nonzero on failure. */
+static int
+write_repr(_PyUnicodeWriter *writer, PyObject *self, PyObject *values)
+{
+    PyObject *typename = ((PyHeapTypeObject*) Py_TYPE(self))->ht_name;
+    int guard = repr_may_recurse(values);
+    namedtuple_fields *info;
+    Py_ssize_t fieldc;
+    Py_ssize_t n;
+    PyObject *repr;
+    int err;
+
+    if (guard && (err = Py_ReprEnter(self))) {
+        return (err < 0) ? -1 : _PyUnicodeWriter_WriteASCIIString(writer,
+                                                                  "...",
+                                                                  3);
+    }
+    if (!(info = get_fields_info(Py_TYPE(self), self))) {
+        goto leave;
+    }
+    fieldc = FIELDS_COUNT(info);
+    if (PyTuple_GET_SIZE(values) < fieldc) {
+        fieldc = PyTuple_GET_SIZE(values);
+    }
+
+    /* Reserve room for the names and some short values up front so that the
+       buffer is not grown for every field. */
+    writer->min_length = writer->pos + PyUnicode_GET_LENGTH(typename) + 2;
+    for (n = 0;n < fieldc;++n) {
+        writer->min_length += PyUnicode_GET_LENGTH(FIELDS_NAME(info, n)) + 8;
+    }
+
+    if (_PyUnicodeWriter_WriteStr(writer, typename) ||
+        _PyUnicodeWriter_WriteChar(writer, '(')) {
+        goto error;
+    }
+    for (n = 0;n < fieldc;++n) {
+        if ((n && _PyUnicodeWriter_WriteASCIIString(writer, ", ", 2)) ||
+            _PyUnicodeWriter_WriteStr(writer, FIELDS_NAME(info, n)) ||
+            _PyUnicodeWriter_WriteChar(writer, '=')) {
+            goto error;
+        }
+        if (!(repr = PyObject_Repr(PyTuple_GET_ITEM(values, n)))) {
+            goto error;
+        }
+        err = _PyUnicodeWriter_WriteStr(writer, repr);
+        Py_DECREF(repr);
+        if (err) {
+            goto error;
+        }
+    }
+    if (_PyUnicodeWriter_WriteChar(writer, ')')) {
+        goto error;
+    }
+
+    Py_DECREF(info);
+    if (guard) {
+        Py_ReprLeave(self);
+    }
+    return 0;
+
+error:
+    Py_DECREF(info);
+leave:
+    if (guard) {
+        Py_ReprLeave(self);
+    }
+    return -1;
+}
+
+/* Format the repr of `self` whose field values are the tuple `values`.
+   return: A str in the format `{typename}({f_1}={v_1}, ..., {f_n}={v_n})`
+   or NULL in case of an exception. */
+static PyObject *
+format_repr(PyObject *self, PyObject *values)
+{
+    _PyUnicodeWriter writer;
+
+    _PyUnicodeWriter_Init(&writer);
+    writer.overallocate = 1;
+    if (write_repr(&writer, self, values)) {
+        _PyUnicodeWriter_Dealloc(&writer);
+        return NULL;
+    }
+    return _PyUnicodeWriter_Finish(&writer);
+}
+
+/* The `__repr__` for `namedtuple` objects.
+   return: A str in the format `{typename}({f_1}={v_1}, ..., {f_n}={v_n})`
+   or NULL in case of an exception. */
+static PyObject *
+namedtuple_repr(PyObject *self, PyObject *_)
+{
+    return format_repr(self, self);
+}
+
+/* Namedtuple class method for rendering the reprs of a sequence of instances
+   of this class into one string.
+   return: A new str or NULL in case of error. */
+static PyObject *
+namedtuple__repr_many(PyObject *cls, PyObject *args, PyObject *kwargs)
+{
+    const char * const argnames[] = {"records", "sep", NULL};
+    PyObject *records;
+    PyObject *sep = NULL;
+    PyObject *seq;
+    PyObject *record;
+    PyObject *repr;
+    _PyUnicodeWriter writer;
+    Py_ssize_t n;
+    int err;
+
+    if (!PyArg_ParseTupleAndKeywords(args,
+                                     kwargs,
+                                     "O|U:_repr_many",
+                                     (char**) argnames,
+                                     &records,
+                                     &sep)) {
+        return NULL;
+    }
+    if (!(seq = PySequence_Fast(records, "records must be iterable"))) {
+        return NULL;
+    }
+
+    _PyUnicodeWriter_Init(&writer);
+    writer.overallocate = 1;
+    for (n = 0;n < PySequence_Fast_GET_SIZE(seq);++n) {
+        record = PySequence_Fast_GET_ITEM(seq, n);
+        if (!PyObject_TypeCheck(record, (PyTypeObject*) cls)) {
+            PyErr_Format(PyExc_TypeError,
+                         "expected %s instance, got %s (record %zd)",
+                         ((PyTypeObject*) cls)->tp_name,
+                         Py_TYPE(record)->tp_name,
+                         n);
+            goto error;
+        }
+        if (n &&
+            (sep ?
+             _PyUnicodeWriter_WriteStr(&writer, sep) :
+             _PyUnicodeWriter_WriteChar(&writer, '\n'))) {
+            goto error;
+        }
+        if (Py_TYPE(record)->tp_repr == (reprfunc) namedtuple_repr) {
+            if (write_repr(&writer, record, record)) {
+                goto error;
+            }
+            continue;
+        }
+        /* A subclass with its own `__repr__`. */
+        if (!(repr = PyObject_Repr(record))) {
+            goto error;
+        }
+        err = _PyUnicodeWriter_WriteStr(&writer, repr);
+        Py_DECREF(repr);
+        if (err) {
+            goto error;
+        }
+    }
+
+    Py_DECREF(seq);
+    return _PyUnicodeWriter_Finish(&writer);
+
+error:
+    _PyUnicodeWriter_Dealloc(&writer);
+    Py_DECREF(seq);
+    return NULL;
+}
+
+/* Find the mapping type that `_asdict` builds for `cls`. A class may set
+   `__asdict__`, otherwise the module default is used.
+   return: A new reference. */
+static PyObject *
+asdict_factory(PyTypeObject *cls)
+{
+    PyObject *factory = type_lookup_ref(cls, asdict_str);
+    PyObject *module;
+
+    if (factory) {
+        return factory;
+    }
+    if (!(module = PyState_FindModule(&_namedtuplemodule))) {
+        /* The module is being torn down. */
+        factory = (PyObject*) &PyDict_Type;
+        Py_INCREF(factory);
+        return factory;
+    }
+    /* `set_asdict_factory` may release the default in another thread. */
+    Py_BEGIN_CRITICAL_SECTION(module);
+    factory = ((module_state*) PyModule_GetState(module))->asdict;
+    Py_INCREF(factory);
+    Py_END_CRITICAL_SECTION();
+    return factory;
+}
+
+/* Converts `self`, whose field values are the tuple `values`, into a mapping.
+   For `dict` and `OrderedDict` the fields are written into a presized dict
+   with their cached hashes, which `OrderedDict` is then built from. Any
+   other `factory` is called with a tuple of `(field, value)` pairs, like
+   `__asdict__` always has been. When `factory` is NULL, `asdict_factory`
+   picks it.
+   return: A new mapping or NULL in case of error. */
+static PyObject *
+make_asdict(PyObject *self, PyObject *values, PyObject *factory)
+{
+    Py_ssize_t n;
+    namedtuple_fields *info;
+    Py_ssize_t fieldc;
+    PyObject *ret;
+    PyObject *pair;
+
+    if (factory) {
+        Py_INCREF(factory);
+    }
+    else {
+        factory = asdict_factory(Py_TYPE(self));
+    }
+    if (!(info = get_fields_info(Py_TYPE(self), self))) {
+        Py_DECREF(factory);
+        return NULL;
+    }
+    fieldc = FIELDS_COUNT(info);
+    if (PyTuple_GET_SIZE(values) < fieldc) {
+        fieldc = PyTuple_GET_SIZE(values);
+    }
+
+    if (factory != (PyObject*) &PyDict_Type &&
+        factory != (PyObject*) &PyODict_Type) {
+        if (!(ret = PyTuple_New(fieldc))) {
+            Py_DECREF(info);
+            Py_DECREF(factory);
+            return NULL;
+        }
+        for (n = 0;n < fieldc;++n) {
+            if (!(pair = PyTuple_Pack(2,
+                                      FIELDS_NAME(info, n),
+                                      PyTuple_GET_ITEM(values, n)))) {
+                Py_DECREF(ret);
+                Py_DECREF(info);
+                Py_DECREF(factory);
+                return NULL;
+            }
+            PyTuple_SET_ITEM(ret, n, pair);
+        }
+        Py_DECREF(info);
+        Py_SETREF(ret, PyObject_CallFunctionObjArgs(factory, ret, NULL));
+        Py_DECREF(factory);
+        return ret;
+    }
+
+    if (!(ret = _PyDict_NewPresized(fieldc))) {
+        Py_DECREF(info);
+        Py_DECREF(factory);
+        return NULL;
+    }
+    for (n = 0;n < fieldc;++n) {
+#if PY_VERSION_HEX < 0x030D0000
+        if (_PyDict_SetItem_KnownHash(ret,
+                                      FIELDS_NAME(info, n),
+                                      PyTuple_GET_ITEM(values, n),
+                                      info->fi_hashes[n])) {
+#else
+        /* The known hash setter is internal, but str caches its hash. */
+        if (PyDict_SetItem(ret,
+                           FIELDS_NAME(info, n),
+                           PyTuple_GET_ITEM(values, n))) {
+#endif
+            Py_DECREF(ret);
+            Py_DECREF(info);
+            Py_DECREF(factory);
+            return NULL;
+        }
+    }
+    Py_DECREF(info);
+
+    if (factory != (PyObject*) &PyDict_Type) {
+        Py_SETREF(ret, PyObject_CallFunctionObjArgs(factory, ret, NULL));
+    }
+    Py_DECREF(factory);
+    return ret;
+}
+
+/* Unpack the arguments to `_asdict(factory=None)`.
+   return: Zero on succes, nonzero on failure. */
+static int
+parse_asdict_args(PyObject *const *args,
+                  Py_ssize_t nargs,
+                  PyObject *kwnames,
+                  PyObject **factory)
+{
+    Py_ssize_t nkwargs = (kwnames) ? PyTuple_GET_SIZE(kwnames) : 0;
+
+    if (nargs + nkwargs > 1) {
+        PyErr_Format(PyExc_TypeError,
+                     "_asdict() takes at most 1 argument (%zd given)",
+                     nargs + nkwargs);
+        return -1;
+    }
+    if (nkwargs &&
+        PyUnicode_CompareWithASCIIString(PyTuple_GET_ITEM(kwnames, 0),
+                                         "factory")) {
+        PyErr_Format(PyExc_TypeError,
+                     "'%U' is an invalid keyword argument for _asdict()",
+                     PyTuple_GET_ITEM(kwnames, 0));
+        return -1;
+    }
+    *factory = (nargs + nkwargs && args[0] != Py_None) ? args[0] : NULL;
+    return 0;
+}
+
+/* Converts self into a mapping.
+   return: A new mapping or NULL in case of error. */
+PyObject *
+namedtuple__asdict(PyObject *self,
+                   PyObject *const *args,
+                   Py_ssize_t nargs,
+                   PyObject *kwnames)
+{
+    PyObject *factory;
+
+    if (parse_asdict_args(args, nargs, kwnames, &factory)) {
+        return NULL;
+    }
+    return make_asdict(self, self, factory);
+}
+
+/* A read-only mapping view over the fields of a namedtuple instance. Keys are
+   looked up through the field index of the record's type and no dict is
+   built. */
+typedef struct{
+    PyObject_HEAD
+    PyObject *nm_record;        /* The viewed instance. */
+    namedtuple_fields *nm_info; /* The field metadata of the instance. */
+}namedtuple_mapping;
+
+PyTypeObject namedtuple_mapping_type;
+
+/* return: A new reference to the value of field `ix` or NULL in case of
+   error. */
+static PyObject *
+namedtuple_mapping_value(namedtuple_mapping *self, Py_ssize_t ix)
+{
+    PyObject *ret;
+
+    if (PyTuple_Check(self->nm_record) &&
+        ix < PyTuple_GET_SIZE(self->nm_record)) {
+        ret = PyTuple_GET_ITEM(self->nm_record, ix);
+        Py_INCREF(ret);
+        return ret;
+    }
+    /* Typed namedtuples box the field on access. A tuple that is shorter
+       than a reassigned `_fields` raises an `IndexError`. */
+    return PySequence_GetItem(self->nm_record, ix);
+}
+
+static int
+namedtuple_mapping_traverse(namedtuple_mapping *self,
+                            visitproc visit,
+                            void *arg)
+{
+    Py_VISIT(self->nm_record);
+    return 0;
+}
+
+static void
+namedtuple_mapping_dealloc(namedtuple_mapping *self)
+{
+    PyObject_GC_UnTrack(self);
+    Py_CLEAR(self->nm_record);
+    Py_CLEAR(self->nm_info);
+    PyObject_GC_Del(self);
+}
+
+static Py_ssize_t
+namedtuple_mapping_length(namedtuple_mapping *self)
+{
+    return FIELDS_COUNT(self->nm_info);
+}
+
+/* Look up `key` in the fields, raising a `KeyError` if it is missing. */
+static PyObject *
+namedtuple_mapping_subscript(namedtuple_mapping *self, PyObject *key)
+{
+    Py_ssize_t ix;
+
+    if ((ix = find_field(self->nm_info, key)) == -2) {
+        return NULL;
+    }
+    if (ix == -1) {
+        PyErr_SetObject(PyExc_KeyError, key);
+        return NULL;
+    }
+    return namedtuple_mapping_value(self, ix);
+}
+
+static int
+namedtuple_mapping_contains(namedtuple_mapping *self, PyObject *key)
+{
+    Py_ssize_t ix = find_field(self->nm_info, key);
+
+    return (ix == -2) ? -1 : (ix >= 0);
+}
+
+static PyObject *
+namedtuple_mapping_iter(namedtuple_mapping *self)
+{
+    return PyObject_GetIter(self->nm_info->fi_fields);
+}
+
+static PyObject *
+namedtuple_mapping_repr(namedtuple_mapping *self)
+{
+    return PyUnicode_FromFormat("%s(%R)",
+                                Py_TYPE(self)->tp_name,
+                                self->nm_record);
+}
+
+/* Compare against dicts and other views like `Mapping` does. */
+static PyObject *
+namedtuple_mapping_richcompare(namedtuple_mapping *self,
+                               PyObject *other,
+                               int op)
+{
+    PyObject *lhs;
+    PyObject *rhs;
+    PyObject *ret;
+
+    if ((op != Py_EQ && op != Py_NE) ||
+        !(PyDict_Check(other) ||
+          Py_TYPE(other) == &namedtuple_mapping_type)) {
+        Py_RETURN_NOTIMPLEMENTED;
+    }
+
+    if (!(lhs = PyDict_New())) {
+        return NULL;
+    }
+    if (PyDict_Merge(lhs, (PyObject*) self, 1)) {
+        Py_DECREF(lhs);
+        return NULL;
+    }
+    if (PyDict_Check(other)) {
+        rhs = other;
+        Py_INCREF(rhs);
+    }
+    else if (!(rhs = PyDict_New()) || PyDict_Merge(rhs, other, 1)) {
+        Py_XDECREF(rhs);
+        Py_DECREF(lhs);
+        return NULL;
+    }
+    ret = PyObject_RichCompare(lhs, rhs, op);
+    Py_DECREF(lhs);
+    Py_DECREF(rhs);
+    return ret;
+}
+
+static PyObject *
+namedtuple_mapping_get(namedtuple_mapping *self,
+                       PyObject *const *args,
+                       Py_ssize_t nargs)
+{
+    Py_ssize_t ix;
+    PyObject *ret;
+
+    if (nargs < 1 || nargs > 2) {
+        PyErr_Format(PyExc_TypeError,
+                     "get expected 1 or 2 arguments, got %zd",
+                     nargs);
+        return NULL;
+    }
+    if ((ix = find_field(self->nm_info, args[0])) == -2) {
+        return NULL;
+    }
+    if (ix >= 0) {
+        return namedtuple_mapping_value(self, ix);
+    }
+    ret = (nargs == 2) ? args[1] : Py_None;
+    Py_INCREF(ret);
+    return ret;
+}
+
+/* The views of `Mapping` read the fields back through the view, so they are
+   as lazy as the view itself.
+   return: A new `collections.abc.<name>` of `self` or NULL in case of
+   error. */
+static PyObject *
+namedtuple_mapping_abc_view(namedtuple_mapping *self, const char *name)
+{
+    PyObject *abc;
+    PyObject *ret;
+
+    if (!(abc = PyImport_ImportModule("collections.abc"))) {
+        return NULL;
+    }
+    ret = PyObject_CallMethod(abc, name, "O", self);
+    Py_DECREF(abc);
+    return ret;
+}
+
+static PyObject *
+namedtuple_mapping_keys(namedtuple_mapping *self, PyObject *_)
+{
+    return namedtuple_mapping_abc_view(self, "KeysView");
+}
+
+static PyObject *
+namedtuple_mapping_values(namedtuple_mapping *self, PyObject *_)
+{
+    return namedtuple_mapping_abc_view(self, "ValuesView");
+}
+
+static PyObject *
+namedtuple_mapping_items(namedtuple_mapping *self, PyObject *_)
+{
+    return namedtuple_mapping_abc_view(self, "ItemsView");
+}
+
+PyDoc_STRVAR(namedtuple_mapping_get_doc,
+"get(key, default=None) -> value\n\n"
+"Return the value of the field 'key' or 'default' if it is not a field.");
+
+PyDoc_STRVAR(namedtuple_mapping_keys_doc,
+"keys() -> KeysView\n\n"
+"Return a set-like view of the field names.");
+
+PyDoc_STRVAR(namedtuple_mapping_values_doc,
+"values() -> ValuesView\n\n"
+"Return a view of the field values.");
+
+PyDoc_STRVAR(namedtuple_mapping_items_doc,
+"items() -> ItemsView\n\n"
+"Return a set-like view of the (field, value) pairs.");
+
+PyMethodDef namedtuple_mapping_methods[] = {
+    {"get",
+     (PyCFunction) namedtuple_mapping_get,
+     METH_FASTCALL,
+     namedtuple_mapping_get_doc},
+    {"keys",
+     (PyCFunction) namedtuple_mapping_keys,
+     METH_NOARGS,
+     namedtuple_mapping_keys_doc},
+    {"values",
+     (PyCFunction) namedtuple_mapping_values,
+     METH_NOARGS,
+     namedtuple_mapping_values_doc},
+    {"items",
+     (PyCFunction) namedtuple_mapping_items,
+     METH_NOARGS,
+     namedtuple_mapping_items_doc},
+    {NULL},
+};
+
+PySequenceMethods namedtuple_mapping_as_sequence = {
+    0,                                          /* sq_length */
+    0,                                          /* sq_concat */
+    0,                                          /* sq_repeat */
+    0,                                          /* sq_item */
+    0,                                          /* was_sq_slice */
+    0,                                          /* sq_ass_item */
+    0,                                          /* was_sq_ass_slice */
+    (objobjproc) namedtuple_mapping_contains,   /* sq_contains */
+};
+
+PyMappingMethods namedtuple_mapping_as_mapping = {
+    (lenfunc) namedtuple_mapping_length,        /* mp_length */
+    (binaryfunc) namedtuple_mapping_subscript,  /* mp_subscript */
+};
+
+PyDoc_STRVAR(namedtuple_mapping_doc,
+"A read-only mapping view of the fields of a namedtuple instance. Created\n"
+"with '_asmapping()'.");
+
+PyTypeObject namedtuple_mapping_type = {
+    PyVarObject_HEAD_INIT(&PyType_Type, 0)
+    "_collections.NamedTupleMapping",           /* tp_name */
+    sizeof(namedtuple_mapping),                 /* tp_basicsize */
+    0,                                          /* tp_itemsize */
+    (destructor) namedtuple_mapping_dealloc,    /* tp_dealloc */
+    0,                                          /* tp_print */
+    0,                                          /* tp_getattr */
+    0,                                          /* tp_setattr */
+    0,                                          /* tp_reserved */
+    (reprfunc) namedtuple_mapping_repr,         /* tp_repr */
+    0,                                          /* tp_as_number */
+    &namedtuple_mapping_as_sequence,            /* tp_as_sequence */
+    &namedtuple_mapping_as_mapping,             /* tp_as_mapping */
+    PyObject_HashNotImplemented,                /* tp_hash */
+    0,                                          /* tp_call */
+    0,                                          /* tp_str */
+    PyObject_GenericGetAttr,                    /* tp_getattro */
+    0,                                          /* tp_setattro */
+    0,                                          /* tp_as_buffer */
+    Py_TPFLAGS_DEFAULT | Py_TPFLAGS_HAVE_GC,    /* tp_flags */
+    namedtuple_mapping_doc,                     /* tp_doc */
+    (traverseproc) namedtuple_mapping_traverse, /* tp_traverse */
+    0,                                          /* tp_clear */
+    (richcmpfunc) namedtuple_mapping_richcompare, /* tp_richcompare */
+    0,                                          /* tp_weaklistoffset */
+    (getiterfunc) namedtuple_mapping_iter,      /* tp_iter */
+    0,                                          /* tp_iternext */
+    namedtuple_mapping_methods,                 /* tp_methods */
+};
+
+/* Wrap `self` in a read-only mapping view.
+   return: A new view or NULL in case of error. */
+static PyObject *
+namedtuple__asmapping(PyObject *self, PyObject *_)
+{
+    namedtuple_mapping *ret;
+    namedtuple_fields *info;
+
+    if (!(info = get_fields_info(Py_TYPE(self), self))) {
+        return NULL;
+    }
+    if (!(ret = PyObject_GC_New(namedtuple_mapping,
+                                &namedtuple_mapping_type))) {
+        Py_DECREF(info);
+        return NULL;
+    }
+    Py_INCREF(self);
+    ret->nm_record = self;
+    ret->nm_info = info;
+    PyObject_GC_Track(ret);
+    return (PyObject*) ret;
+}
+
+/* Pickle and copy protocol.
+   return: self as a plain tuple or NULL in case of error. */
+static PyObject *
+namedtuple_getnewargs(PyObject *self, PyObject *_)
+{
+    return PySequence_Tuple(self);
+}
+
+/* Pass function for the pickle and copy protocol.
+   return: Py_None. */
+static PyObject *
+namedtuple_getstate(PyObject *self, PyObject *_)
+{
+    Py_RETURN_NONE;
+}
+
+/* Pickle protocol for extension types.
+   return: A tuple `(type(self),tuple(self))` or NULL in case of an error. */
+static PyObject *
+namedtuple_reduce_ex(PyObject *self,PyObject *_)
+{
+    PyObject *astuple = PySequence_Tuple(self);
+    PyObject *ret;
+
+    if (!astuple) {
+        return NULL;
+    }
+
+    ret = PyTuple_Pack(2, self->ob_type, astuple);
+    Py_DECREF(astuple);
+    return ret;
+}
+
+static int
+namedtuple_traverse(PyTupleObject *self, visitproc visit, void *arg)
+{
+    Py_ssize_t n;
+
+    for (n = PyTuple_GET_SIZE(self);--n >= 0;) {
+        Py_VISIT(PyTuple_GET_ITEM(self, n));
+    }
+    return 0;
+}
+
+/* The `__dict__` of namedtuple types is the `__asdict__` type holding all
+   of the fields.
+   return: A new dict or NULL in case of error. */
+static PyObject *
+namedtuple_get_dict(PyObject *self, void *_)
+{
+    return make_asdict(self, self, NULL);
+}
+
+PyDoc_STRVAR(_make_doc,
+"_make(iterable) -> namedtuple\n\n"
+"Create an instance of this class from an iterable.");
+
+PyDoc_STRVAR(_make_many_doc,
+"_make_many(rows) -> list of namedtuple\n\n"
+"Create a list of instances of this class from an iterable of rows.");
+
+PyDoc_STRVAR(_from_columns_doc,
+"_from_columns(*columns, **named_columns) -> list of namedtuple\n\n"
+"Create a list of instances of this class from one column per field.\n"
+"Columns are matched to fields by position or by name and must all have\n"
+"the same length.");
+
+PyDoc_STRVAR(_to_columns_doc,
+"_to_columns(records, fields=None) -> tuple of lists\n\n"
+"Split a sequence of instances of this class into one list per field.\n"
+"'fields' selects and orders the columns, it defaults to '_fields'.");
+
+PyDoc_STRVAR(_pluck_doc,
+"_pluck(records, field) -> list\n\n"
+"Read one field out of every instance in a sequence of instances of this\n"
+"class.");
+
+PyDoc_STRVAR(_sort_doc,
+"_sort(records, by=None, inplace=False) -> list or None\n\n"
+"Stably sort instances of this class by the fields named in 'by', which\n"
+"defaults to '_fields'. A name starting with '-' sorts that field in\n"
+"descending order. With 'inplace' the list 'records' is sorted and None is\n"
+"returned, otherwise a new sorted list is returned.");
+
+PyDoc_STRVAR(_key_doc,
+"_key(*fields) -> key function\n\n"
+"Return a key function for 'sorted', 'heapq' or 'bisect' which reads\n"
+"'fields' of an instance of this class. The key is the field itself for\n"
+"one field or a tuple of the fields otherwise.");
+
+PyDoc_STRVAR(_getter_doc,
+"_getter(*fields, as_type=False) -> getter\n\n"
+"Return a callable which reads 'fields' of an instance of this class into\n"
+"a tuple. With 'as_type' it builds instances of the namedtuple type\n"
+"'<typename>_<field>_<field>...' instead, which is created once and\n"
+"cached. 'getter.map(records)' applies the getter to every record.");
+
+PyDoc_STRVAR(_index_doc,
+"_index(records, *fields, unique=False) -> dict\n\n"
+"Map the key read from 'fields' of each instance of this class in\n"
+"'records' to the instance. The key is the field itself for one field or a\n"
+"tuple of the fields otherwise. Later records replace earlier ones with the\n"
+"same key, unless 'unique' is set which makes a repeated key an error.");
+
+PyDoc_STRVAR(_groupby_doc,
+"_groupby(records, *fields) -> dict of lists\n\n"
+"Map the key read from 'fields' of each instance of this class in\n"
+"'records' to a list of the instances with that key, in order. The key is\n"
+"the field itself for one field or a tuple of the fields otherwise.");
+
+PyDoc_STRVAR(_where_doc,
+"_where(records, **conditions) -> list\n\n"
+"Return the instances of this class in 'records' whose fields equal the\n"
+"values given for them by name, in order.");
+
+PyDoc_STRVAR(_array_doc,
+"_array(capacity=0) -> array\n\n"
+"Create an empty growable array of records of this class. The fields of\n"
+"the records are stored in one block and instances are only created when\n"
+"a record is read. Arrays support 'append', 'extend', 'column', 'tolist',\n"
+"'len', indexing and slicing.");
+
+PyDoc_STRVAR(_repr_many_doc,
+"_repr_many(records, sep='\\n') -> str\n\n"
+"Render the reprs of a sequence of instances of this class into one\n"
+"string, separated by 'sep'.");
+
+PyDoc_STRVAR(_pack_doc,
+"_pack(records) -> bytes\n\n"
+"Pack a sequence of instances of this class into a compact binary format.\n"
+"The fields are written once in a header, followed by the values of each\n"
+"record. None, bool, int, float, str and bytes are encoded directly and\n"
+"other values are pickled.");
+
+PyDoc_STRVAR(_unpack_many_doc,
+"_unpack_many(buf) -> list of namedtuple\n\n"
+"Rebuild the instances of this class from the output of '_pack'. 'buf' may\n"
+"be any object supporting the buffer protocol and is read in place.");
+
+PyDoc_STRVAR(_batch_doc,
+"_batch(records) -> batch\n\n"
+"Pack a sequence of instances of this class into a batch. Pickling the\n"
+"batch with protocol 5 passes the packed records as an out-of-band buffer.");
+
+PyDoc_STRVAR(_dump_doc,
+"_dump(records, path) -> None\n\n"
+"Write a sequence of instances of this class to a file, column by column.\n"
+"Columns of ints or floats are stored as fixed width arrays, other columns\n"
+"use the value encoding of '_pack'.");
+
+PyDoc_STRVAR(_open_doc,
+"_open(path) -> file\n\n"
+"Map a file written by '_dump'. The result is a read only sequence of\n"
+"instances of this class which decodes a record only when it is read.");
+
+PyDoc_STRVAR(_read_csv_doc,
+"_read_csv(fileobj, header=True, delimiter=',', converters=None)\n"
+"    -> list of namedtuple\n\n"
+"Read instances of this class from a text file of delimited records, quoted\n"
+"like 'csv.excel'. If 'header' is true the first record names the column\n"
+"of each field, in any order. 'header' may also be a mapping from column\n"
+"names to field names. If 'header' is false the columns are in field\n"
+"order. 'converters' maps field names to callables applied to the text of\n"
+"that field; 'int' and 'float' are applied without calling them.");
+
+PyDoc_STRVAR(_replace_doc,
+"_replace(field=new_value, ...) -> new namedtuple\n\n"
+"Returns a new namedtuple with the specified fields replaced.");
+
+PyDoc_STRVAR(_asdict_doc,
+"_asdict(factory=None) -> mapping\n\n"
+"Converts this namedtuple into a dictionary that maps fields to values.\n"
+"'factory' is called with a tuple of (field, value) pairs to build the\n"
+"result. 'dict' and 'OrderedDict' are built from a presized dict instead,\n"
+"and with 'dict' that dict is returned as is. It defaults to the class's\n"
+"'__asdict__' or the module default, see 'set_asdict_factory'.");
+
+PyDoc_STRVAR(_asmapping_doc,
+"_asmapping() -> mapping\n\n"
+"Returns a read-only mapping view of the fields of this namedtuple. Keys\n"
+"are looked up by field name without building a dict.");
+
+PyDoc_STRVAR(__getnewargs___doc,
+"__getnewargs__() -> tuple\n\n"
+"Return self as a plain tuple. Used by copy and pickle.");
+
+PyDoc_STRVAR(__getstate___doc,
+"__getstate__() -> None\n\n"
+"Exclude the OrderedDict from pickling.");
+
+PyDoc_STRVAR(__reduce_ex___doc,
+"__reduce_ex__() -> (type(self), tuple(self))\n\n"
+"Returns the pair of the type of the instance with the instance cast to\n"
+"a tuple.");
+
+PyMethodDef namedtuple_methods[] = {
+    {"_make",
+     (PyCFunction) namedtuple__make,
+     METH_CLASS | METH_FASTCALL | METH_KEYWORDS,
+     _make_doc},
+    {"_make_many",
+     (PyCFunction) namedtuple__make_many,
+     METH_CLASS | METH_O,
+     _make_many_doc},
+    {"_from_columns",
+     (PyCFunction) namedtuple__from_columns,
+     METH_CLASS | METH_VARARGS | METH_KEYWORDS,
+     _from_columns_doc},
+    {"_to_columns",
+     (PyCFunction) namedtuple__to_columns,
+     METH_CLASS | METH_VARARGS | METH_KEYWORDS,
+     _to_columns_doc},
+    {"_pluck",
+     (PyCFunction) namedtuple__pluck,
+     METH_CLASS | METH_VARARGS | METH_KEYWORDS,
+     _pluck_doc},
+    {"_sort",
+     (PyCFunction) namedtuple__sort,
+     METH_CLASS | METH_VARARGS | METH_KEYWORDS,
+     _sort_doc},
+    {"_key",
+     (PyCFunction) namedtuple__key,
+     METH_CLASS | METH_VARARGS,
+     _key_doc},
+    {"_getter",
+     (PyCFunction) namedtuple__getter,
+     METH_CLASS | METH_VARARGS | METH_KEYWORDS,
+     _getter_doc},
+    {"_index",
+     (PyCFunction) namedtuple__index,
+     METH_CLASS | METH_VARARGS | METH_KEYWORDS,
+     _index_doc},
+    {"_groupby",
+     (PyCFunction) namedtuple__groupby,
+     METH_CLASS | METH_VARARGS,
+     _groupby_doc},
+    {"_where",
+     (PyCFunction) namedtuple__where,
+     METH_CLASS | METH_VARARGS | METH_KEYWORDS,
+     _where_doc},
+    {"_array",
+     (PyCFunction) namedtuple__array,
+     METH_CLASS | METH_VARARGS | METH_KEYWORDS,
+     _array_doc},
+    {"_repr_many",
+     (PyCFunction) namedtuple__repr_many,
+     METH_CLASS | METH_VARARGS | METH_KEYWORDS,
+     _repr_many_doc},
+    {"_pack",
+     (PyCFunction) namedtuple__pack,
+     METH_CLASS | METH_O,
+     _pack_doc},
+    {"_unpack_many",
+     (PyCFunction) namedtuple__unpack_many,
+     METH_CLASS | METH_O,
+     _unpack_many_doc},
+    {"_batch",
+     (PyCFunction) namedtuple__batch,
+     METH_CLASS | METH_O,
+     _batch_doc},
+    {"_dump",
+     (PyCFunction) namedtuple__dump,
+     METH_CLASS | METH_VARARGS,
+     _dump_doc},
+    {"_open",
+     (PyCFunction) namedtuple__open,
+     METH_CLASS | METH_O,
+     _open_doc},
+    {"_read_csv",
+     (PyCFunction) namedtuple__read_csv,
+     METH_CLASS | METH_VARARGS | METH_KEYWORDS,
+     _read_csv_doc},
+    {"_replace",
+     (PyCFunction) namedtuple__replace,
+     METH_FASTCALL | METH_KEYWORDS,
+     _replace_doc},
+    {"_asdict",
+     (PyCFunction) namedtuple__asdict,
+     METH_FASTCALL | METH_KEYWORDS,
+     _asdict_doc},
+    {"_asmapping",
+     (PyCFunction) namedtuple__asmapping,
+     METH_NOARGS,
+     _asmapping_doc},
+    {"__getnewargs__",
+     (PyCFunction) namedtuple_getnewargs,
+     METH_NOARGS,
+     __getnewargs___doc},
+    {"__getstate__",
+     namedtuple_getstate,
+     METH_NOARGS,
+     __getstate___doc},
+    {"__reduce_ex__",
+     namedtuple_reduce_ex,
+     METH_O,
+     __reduce_ex___doc},
+    {NULL},
+};
+
+/* A type to indicate the results of checking a field or type name */
+typedef enum{
+    CHECKFIELD_VALID      = 0,
+    CHECKFIELD_EMPTY      = 1,
+    CHECKFIELD_DIGIT      = 2,
+    CHECKFIELD_UNDERSCORE = 3,
+    CHECKFIELD_NONALNUM   = 4,
+    CHECKFIELD_KEYWORD    = 5,
+    CHECKFIELD_NOTREADY   = 6,
+}nt_checkfield;
+
+/* The keywords of `keyword.kwlist`, placed at `keyword_hash` of the keyword.
+   The hash was chosen to be perfect over this set. */
+static const char * const keywords[128] = {
+    [0] = "break",
+#if PY_VERSION_HEX >= 0x03090000 && PY_VERSION_HEX < 0x030A0000
+    [2] = "__peg_parser__",
+#endif
+    [11] = "del",
+    [17] = "global",
+    [25] = "from",
+    [26] = "nonlocal",
+    [29] = "lambda",
+    [32] = "finally",
+    [34] = "False",
+    [37] = "in",
+#if PY_VERSION_HEX >= 0x03070000
+    [39] = "async",
+#endif
+    [41] = "None",
+    [42] = "try",
+    [47] = "True",
+    [48] = "and",
+    [50] = "return",
+    [64] = "else",
+    [66] = "continue",
+    [73] = "def",
+    [74] = "yield",
+    [75] = "elif",
+    [77] = "if",
+    [78] = "raise",
+    [79] = "for",
+    [83] = "while",
+    [84] = "as",
+    [87] = "or",
+    [89] = "class",
+    [92] = "is",
+#if PY_VERSION_HEX >= 0x03070000
+    [98] = "await",
+#endif
+    [99] = "assert",
+    [101] = "pass",
+    [103] = "except",
+    [107] = "import",
+    [109] = "not",
+    [115] = "with",
+};
+
+/* The length of the longest keyword. */
+#if PY_VERSION_HEX >= 0x03090000 && PY_VERSION_HEX < 0x030A0000
+#define KEYWORD_MAXLEN 14
+#else
+#define KEYWORD_MAXLEN 8
+#endif
+
+#define keyword_hash(name, len)                                         \
+    (((name)[0] + 11 * (name)[(len) - 1] + (len)) & 127)
+
+/* return: Nonzero if the ASCII `name` of `len` characters is a keyword. */
+static int
+is_keyword(const unsigned char *name, Py_ssize_t len)
+{
+    const char *kw;
+
+    if (len < 2 || len > KEYWORD_MAXLEN) {
+        return 0;
+    }
+    kw = keywords[keyword_hash(name, len)];
+    return kw && !strncmp(kw, (const char*) name, len) && !kw[len];
+}
+
+/* Checks the field against the various rules for invalid names. ASCII names
+   are checked without the unicode database.
+   return: An `nt_checkfield` indicating the result. */
+static nt_checkfield
+checkfield(PyObject *field)
+{
+    const unsigned char *ascii;
+    void      *data;
+    int        kind;
+    Py_UCS4    ch;
+    Py_ssize_t len;
+    Py_ssize_t idx;
+
+    if (PyUnicode_READY(field)) {
+        return CHECKFIELD_NOTREADY;
+    }
+
+    if (!(len = PyUnicode_GET_LENGTH(field))) {
+        /* Empty name. */
+        return CHECKFIELD_EMPTY;
+    }
+
+    if (PyUnicode_IS_ASCII(field)) {
+        ascii = PyUnicode_1BYTE_DATA(field);
+        if (Py_ISDIGIT(ascii[0])) {
+            return CHECKFIELD_DIGIT;
+        }
+        for (idx = 0;idx < len;++idx) {
+            if (!(Py_ISALNUM(ascii[idx]) || ascii[idx] == '_')) {
+                return (ascii[0] == '_') ?
+                    CHECKFIELD_UNDERSCORE :
+                    CHECKFIELD_NONALNUM;
+            }
+        }
+        /* Keywords are checked first so that a keyword with a leading
+           underscore is not accepted as a type name. */
+        if (is_keyword(ascii, len)) {
+            return CHECKFIELD_KEYWORD;
+        }
+        return (ascii[0] == '_') ?
+            CHECKFIELD_UNDERSCORE :
+            CHECKFIELD_VALID;
+    }
+
+    kind = PyUnicode_KIND(field);
+    data = PyUnicode_DATA(field);
+    ch = PyUnicode_READ(kind, data, 0);
+
+    if (Py_UNICODE_ISDIGIT(ch)) {
+        /* Cannot start with digit. */
+        return CHECKFIELD_DIGIT;
+    }
+    else if (ch == (Py_UCS4) '_') {
+        /* Cannot start with '_'. */
+        return CHECKFIELD_UNDERSCORE;
+    }
+
+    idx = len;
+    while (idx--) {
+        ch = PyUnicode_READ(kind, data, idx);
+        if (!(Py_UNICODE_ISALNUM(ch) || ch == (Py_UCS4) '_')) {
+            /* Must be all alphanumeric characters or underscores. */
+            return CHECKFIELD_NONALNUM;
+        }
+    }
+
+    /* All of the keywords are ASCII. */
+    return CHECKFIELD_VALID;
+}
+
+/* Check if the interned `field` repeats one of the first `n` names in
+   `fields`. Short tuples are scanned and longer ones use the set `seen`,
+   which `field` is added to.
+   return: 1 if it does, 0 if not or -1 in case of error. */
+static int
+is_duplicate_field(PyObject *fields,
+                   Py_ssize_t n,
+                   PyObject *field,
+                   PyObject *seen)
+{
+    PyObject *prev;
+    int ret;
+
+    if (!seen) {
+        while (n--) {
+            prev = PyTuple_GET_ITEM(fields, n);
+            /* Only `str` subclasses are not interned. */
+            if (prev == field ||
+                ((!PyUnicode_CHECK_INTERNED(prev) ||
+                  !PyUnicode_CHECK_INTERNED(field)) &&
+                 !PyUnicode_Compare(prev, field))) {
+                return 1;
+            }
+        }
+        return 0;
+    }
+    if ((ret = PySet_Contains(seen, field))) {
+        return ret;
+    }
+    return PySet_Add(seen, field);
+}
+
+/* Process the `typename` and `field_names` for a `namedtuple`.
+   After this function is called (and no errors occur),
+   `field_names` will point to a new reference to a tuple of field names
+   that have been properly renamed and checked. Each name is checked, and
+   renamed if `rename` is nonzero, in one pass.
+   return: Zero on succes, nonzero on failure. */
+static int
+validate_field_names(PyObject *typename,
+                     PyObject **field_names,
+                     int rename)
 {
     const char * const nonalnum_fmt =
         "Type names and field names can only contain alphanumeric characters "
@@ -871,314 +6544,1207 @@ validate_field_names(PyObject *typename,
     PyObject *field;
     Py_ssize_t fieldc;
     Py_ssize_t n;
-    PyObject *seen;
+    PyObject *seen = NULL;
+    nt_checkfield check;
+    int duplicate;
 
     if (!(fields = build_fields(*field_names))) {
         return -1;
     }
 
-    if (rename) {
-        if (rename_fields(iskeyword, fields)) {
-            Py_DECREF(fields);
-            return -1;
-        }
-    }
-
-    switch(checkfield(iskeyword, typename)) {
+    switch(checkfield(typename)) {
     case CHECKFIELD_UNDERSCORE:  /* typenames may begin with '_'. */
     case CHECKFIELD_VALID:
         break;
     case CHECKFIELD_NONALNUM:
         PyErr_Format(PyExc_ValueError,nonalnum_fmt,typename);
-        Py_DECREF(fields);
-        return -1;
+        goto error;
     case CHECKFIELD_KEYWORD:
         PyErr_Format(PyExc_ValueError,keyword_fmt,typename);
-        Py_DECREF(fields);
-        return -1;
+        goto error;
     case CHECKFIELD_DIGIT:
         PyErr_Format(PyExc_ValueError,digit_fmt,typename);
-        Py_DECREF(fields);
-        return -1;
+        goto error;
     case CHECKFIELD_EMPTY:
         PyErr_SetString(PyExc_ValueError,empty_type_fmt);
-        Py_DECREF(fields);
-        return -1;
+        goto error;
     case CHECKFIELD_NOTREADY:
         PyErr_SetString(PyExc_ValueError,notready_fmt);
+        goto error;
+    }
+
+    fieldc = PyTuple_GET_SIZE(fields);
+    if (fieldc > FIELDS_LINEAR_MAX && !(seen = PySet_New(NULL))) {
         Py_DECREF(fields);
         return -1;
     }
 
-    if (!(seen = PySet_New(NULL))) {
-        Py_DECREF(fields);
-        return 1;
+    for (n = 0;n < fieldc;++n) {
+        /* Intern the names so that keyword arguments can usually be matched
+           by identity, and so that duplicates are usually identical. */
+        field = PyTuple_GET_ITEM(fields, n);
+        PyUnicode_InternInPlace(&field);
+        PyTuple_SET_ITEM(fields, n, field);
+
+        duplicate = 0;
+        if ((check = checkfield(field)) == CHECKFIELD_VALID &&
+            (duplicate = is_duplicate_field(fields, n, field, seen)) < 0) {
+            goto error;
+        }
+
+        if (rename && (check != CHECKFIELD_VALID || duplicate)) {
+            /* The new name cannot be repeated: it is the only one with this
+               index and no valid name starts with '_'. */
+            if (!(field = PyUnicode_FromFormat("_%zd", n))) {
+                goto error;
+            }
+            PyUnicode_InternInPlace(&field);
+            Py_SETREF(PyTuple_GET_ITEM(fields, n), field);
+            continue;
+        }
+
+        switch(check) {
+        case CHECKFIELD_VALID:
+            break;
+        case CHECKFIELD_UNDERSCORE:
+            PyErr_Format(PyExc_ValueError, underscore_fmt, field);
+            goto error;
+        case CHECKFIELD_NONALNUM:
+            PyErr_Format(PyExc_ValueError, nonalnum_fmt, field);
+            goto error;
+        case CHECKFIELD_KEYWORD:
+            PyErr_Format(PyExc_ValueError, keyword_fmt, field);
+            goto error;
+        case CHECKFIELD_DIGIT:
+            PyErr_Format(PyExc_ValueError, digit_fmt, field);
+            goto error;
+        case CHECKFIELD_EMPTY:
+            PyErr_Format(PyExc_ValueError, empty_field_fmt, n);
+            goto error;
+        case CHECKFIELD_NOTREADY:
+            PyErr_SetString(PyExc_ValueError, notready_fmt);
+            goto error;
+        }
+        if (duplicate) {
+            PyErr_Format(PyExc_ValueError, seen_fmt, field);
+            goto error;
+        }
+    }
+
+    Py_XDECREF(seen);
+    *field_names = fields;
+    return 0;
+
+error:
+    Py_XDECREF(seen);
+    Py_DECREF(fields);
+    return -1;
+}
+
+/* Free lists for namedtuple instances, one per field count, like the ones
+   `tuple` keeps for itself. Every type we create shares the tuple layout, so
+   a block freed by one type may be reused by any type with the same number of
+   fields. Subclasses created with `class` use the default allocator.
+
+   Without the GIL the lists would be shared by every thread, so they are
+   left out and the limit stays at zero. */
+#define FREELIST_MAXFIELDS 20
+#ifdef Py_GIL_DISABLED
+#define FREELIST_DEFAULT_LIMIT 0
+#else
+#define FREELIST_DEFAULT_LIMIT 2000
+#endif
+
+/* The blocks are chained through their first item. */
+static PyObject *free_list[FREELIST_MAXFIELDS];
+static Py_ssize_t numfree[FREELIST_MAXFIELDS];
+static Py_ssize_t freelist_limit = FREELIST_DEFAULT_LIMIT;
+
+#ifndef Py_GIL_DISABLED
+/* `tp_alloc` for namedtuple types.
+   return: A new zeroed and tracked instance or NULL in case of error. */
+static PyObject *
+namedtuple_alloc(PyTypeObject *cls, Py_ssize_t nitems)
+{
+    PyObject *self;
+
+    if (nitems <= 0 ||
+        nitems > FREELIST_MAXFIELDS ||
+        !(self = free_list[nitems - 1])) {
+        return PyType_GenericAlloc(cls, nitems);
+    }
+    free_list[nitems - 1] = PyTuple_GET_ITEM(self, 0);
+    --numfree[nitems - 1];
+
+    memset(self, 0, _PyObject_VAR_SIZE(cls, nitems));
+#if PY_VERSION_HEX < 0x03080000
+    /* `PyObject_INIT` only takes a reference to heap types since 3.8. */
+    Py_INCREF(cls);
+#endif
+    (void) PyObject_INIT_VAR(self, cls, nitems);
+    PyObject_GC_Track(self);
+    return self;
+}
+
+/* `tp_free` for namedtuple types. `tuple`'s dealloc has already cleared and
+   untracked the instance. */
+static void
+namedtuple_free(void *self)
+{
+    Py_ssize_t nitems = Py_SIZE(self);
+
+    if (nitems > 0 &&
+        nitems <= FREELIST_MAXFIELDS &&
+        numfree[nitems - 1] < freelist_limit) {
+        /* The type may be freed before the block is reused or released and
+           `PyObject_GC_Del` reads the type to find the start of the block. */
+        ((PyObject*) self)->ob_type = &PyTuple_Type;
+        PyTuple_SET_ITEM(self, 0, free_list[nitems - 1]);
+        free_list[nitems - 1] = self;
+        ++numfree[nitems - 1];
+        return;
+    }
+    PyObject_GC_Del(self);
+}
+#endif
+
+/* Release blocks until each free list holds at most `keep` blocks.
+   return: The number of blocks released. */
+static Py_ssize_t
+freelist_trim(Py_ssize_t keep)
+{
+    Py_ssize_t freed = 0;
+    PyObject *block;
+    Py_ssize_t n;
+
+    for (n = 0;n < FREELIST_MAXFIELDS;++n) {
+        while (numfree[n] > keep) {
+            block = free_list[n];
+            free_list[n] = PyTuple_GET_ITEM(block, 0);
+            --numfree[n];
+            PyObject_GC_Del(block);
+            ++freed;
+        }
+    }
+    return freed;
+}
+
+PyGetSetDef namedtuple_getsets[] = {
+    {"__dict__",
+     namedtuple_get_dict,
+     NULL,
+     NULL},
+    {NULL},
+};
+
+PyType_Slot namedtuple_slots[] = {
+    {Py_tp_new,
+     namedtuple_new},
+    {Py_tp_methods,
+     namedtuple_methods},
+    {Py_tp_repr,
+     namedtuple_repr},
+    {Py_tp_traverse,
+     namedtuple_traverse},
+    {Py_tp_getset,
+     namedtuple_getsets},
+#ifndef Py_GIL_DISABLED
+    {Py_tp_alloc,
+     namedtuple_alloc},
+    {Py_tp_free,
+     namedtuple_free},
+#endif
+    {Py_tp_base,
+     &PyTuple_Type},
+    {0, NULL},
+};
+
+PyType_Spec namedtuple_spec = {
+    "",  /* placeholder */
+    0,
+    0,
+    Py_TPFLAGS_HAVE_GC
+    | Py_TPFLAGS_TUPLE_SUBCLASS
+    | Py_TPFLAGS_HEAPTYPE
+    | Py_TPFLAGS_BASETYPE
+    | Py_TPFLAGS_DEFAULT,
+    namedtuple_slots,
+};
+
+/* Types created with `cache_hash=True` store the hash of each instance
+   after its items, like the `__dict__` pointer of a tuple subclass. A stored
+   zero means the hash has not been computed and a hash of zero is stored as
+   -1, which is never a valid hash. */
+#define CACHED_HASH(self)                                               \
+    (*(Py_hash_t*) (((PyTupleObject*) (self))->ob_item + Py_SIZE(self)))
+
+/* Threads may compute the hash of a shared instance at the same time. They
+   store the same value, but without the GIL the accesses must be atomic. */
+#ifdef Py_GIL_DISABLED
+#define LOAD_CACHED_HASH(self)                                          \
+    _Py_atomic_load_ssize_relaxed(&CACHED_HASH(self))
+#define STORE_CACHED_HASH(self, hash)                                   \
+    _Py_atomic_store_ssize_relaxed(&CACHED_HASH(self), hash)
+#else
+#define LOAD_CACHED_HASH(self) CACHED_HASH(self)
+#define STORE_CACHED_HASH(self, hash) (CACHED_HASH(self) = (hash))
+#endif
+
+/* `tp_hash` for `cache_hash=True` types.
+   return: `hash(tuple(self))` or -1 in case of error. */
+static Py_hash_t
+namedtuple_cached_hash(PyObject *self)
+{
+    Py_hash_t hash = LOAD_CACHED_HASH(self);
+
+    if (hash) {
+        return (hash == -1) ? 0 : hash;
+    }
+    if ((hash = PyTuple_Type.tp_hash(self)) == -1) {
+        return -1;
+    }
+    STORE_CACHED_HASH(self, hash ? hash : -1);
+    return hash;
+}
+
+/* `tp_richcompare` for `cache_hash=True` types. Instances of the same type
+   whose hashes have both been computed and differ cannot be equal.
+   return: The result of the comparison or NULL in case of error. */
+static PyObject *
+namedtuple_cached_richcompare(PyObject *self, PyObject *other, int op)
+{
+    if ((op == Py_EQ || op == Py_NE) && Py_TYPE(other) == Py_TYPE(self)) {
+        Py_hash_t self_hash = LOAD_CACHED_HASH(self);
+        Py_hash_t other_hash = LOAD_CACHED_HASH(other);
+
+        if (self == other) {
+            return PyBool_FromLong(op == Py_EQ);
+        }
+        if (self_hash && other_hash && self_hash != other_hash) {
+            return PyBool_FromLong(op == Py_NE);
+        }
+    }
+    return PyTuple_Type.tp_richcompare(self, other, op);
+}
+
+/* These types do not use the free lists, which only hold blocks of the plain
+   layout. */
+PyType_Slot namedtuple_cached_hash_slots[] = {
+    {Py_tp_new,
+     namedtuple_new},
+    {Py_tp_methods,
+     namedtuple_methods},
+    {Py_tp_repr,
+     namedtuple_repr},
+    {Py_tp_traverse,
+     namedtuple_traverse},
+    {Py_tp_getset,
+     namedtuple_getsets},
+    {Py_tp_hash,
+     namedtuple_cached_hash},
+    {Py_tp_richcompare,
+     namedtuple_cached_richcompare},
+    {Py_tp_base,
+     &PyTuple_Type},
+    {0, NULL},
+};
+
+PyType_Spec namedtuple_cached_hash_spec = {
+    "",  /* placeholder */
+    sizeof(PyTupleObject) - sizeof(PyObject*) + sizeof(Py_hash_t),
+    0,
+    Py_TPFLAGS_HAVE_GC
+    | Py_TPFLAGS_TUPLE_SUBCLASS
+    | Py_TPFLAGS_HEAPTYPE
+    | Py_TPFLAGS_BASETYPE
+    | Py_TPFLAGS_DEFAULT,
+    namedtuple_cached_hash_slots,
+};
+
+/* Typed namedtuples.
+
+   `namedtuple(typename, field_names, types=...)` creates a type whose
+   instances store their fields unboxed, laid out like a C struct described by
+   a struct module format. The fields are boxed when they are read and the raw
+   bytes are exported through the buffer protocol. These types are not tuple
+   subclasses, but they are sequences that compare and hash like the tuple of
+   their fields. */
+
+/* Helper structs to find the native alignment of each type, this is the same
+   approach the struct module uses. */
+typedef struct{char c; short x;}align_short;
+typedef struct{char c; int x;}align_int;
+typedef struct{char c; long x;}align_long;
+typedef struct{char c; long long x;}align_long_long;
+typedef struct{char c; Py_ssize_t x;}align_ssize_t;
+typedef struct{char c; float x;}align_float;
+typedef struct{char c; double x;}align_double;
+
+#define ALIGNOF(T) (offsetof(align_ ## T, x))
+
+/* The description of a struct module format character that may be used for a
+   typed field. */
+typedef struct{
+    char       tc_code;    /* The struct module format character. */
+    int        tc_member;  /* The `T_*` member type that boxes the field. */
+    Py_ssize_t tc_size;    /* The size of the field in bytes. */
+    Py_ssize_t tc_align;   /* The native alignment of the field. */
+}typed_code;
+
+static const typed_code typed_codes[] = {
+    {'b', T_BYTE, sizeof(char), 1},
+    {'B', T_UBYTE, sizeof(char), 1},
+    {'?', T_BOOL, sizeof(char), 1},
+    {'h', T_SHORT, sizeof(short), ALIGNOF(short)},
+    {'H', T_USHORT, sizeof(short), ALIGNOF(short)},
+    {'i', T_INT, sizeof(int), ALIGNOF(int)},
+    {'I', T_UINT, sizeof(int), ALIGNOF(int)},
+    {'l', T_LONG, sizeof(long), ALIGNOF(long)},
+    {'L', T_ULONG, sizeof(long), ALIGNOF(long)},
+    {'q', T_LONGLONG, sizeof(long long), ALIGNOF(long_long)},
+    {'Q', T_ULONGLONG, sizeof(long long), ALIGNOF(long_long)},
+    {'n', T_PYSSIZET, sizeof(Py_ssize_t), ALIGNOF(ssize_t)},
+    {'f', T_FLOAT, sizeof(float), ALIGNOF(float)},
+    {'d', T_DOUBLE, sizeof(double), ALIGNOF(double)},
+    {'\0'},
+};
+
+/* Look up the description of a format character.
+   return: The description or NULL if `code` cannot be used for a field. */
+static const typed_code *
+find_typed_code(Py_UCS4 code)
+{
+    const typed_code *tc;
+
+    for (tc = typed_codes;tc->tc_code;++tc) {
+        if ((Py_UCS4) tc->tc_code == code) {
+            return tc;
+        }
+    }
+    return NULL;
+}
+
+/* The data of a typed namedtuple starts right after the object header. */
+#define TYPED_DATA_OFFSET (sizeof(PyObject))
+
+/* Convert `value` to the C type for `code` and store it at `addr`. Unlike
+   `PyMember_SetOne`, integers that do not fit raise an `OverflowError` instead
+   of being truncated.
+   return: Zero on succes, nonzero on failure. */
+static int
+typed_store(char *addr, char code, PyObject *value)
+{
+    PyObject *index;
+    long long sv = 0;
+    unsigned long long uv = 0;
+    double dv;
+    int truth;
+
+    switch (code) {
+    case 'd':
+    case 'f':
+        if ((dv = PyFloat_AsDouble(value)) == -1.0 && PyErr_Occurred()) {
+            return -1;
+        }
+        if (code == 'd') {
+            *(double*) addr = dv;
+            return 0;
+        }
+        if (Py_IS_FINITE(dv) && (dv > FLT_MAX || dv < -FLT_MAX)) {
+            PyErr_SetString(PyExc_OverflowError,
+                            "float too large to store in a 'f' field");
+            return -1;
+        }
+        *(float*) addr = (float) dv;
+        return 0;
+    case '?':
+        if ((truth = PyObject_IsTrue(value)) < 0) {
+            return -1;
+        }
+        *addr = (char) truth;
+        return 0;
+    }
+
+    if (!(index = PyNumber_Index(value))) {
+        return -1;
+    }
+    if (code == 'B' || code == 'H' || code == 'I' || code == 'L' ||
+        code == 'Q') {
+        uv = PyLong_AsUnsignedLongLong(index);
+        Py_DECREF(index);
+        if (uv == (unsigned long long) -1 && PyErr_Occurred()) {
+            return -1;
+        }
+    }
+    else {
+        sv = PyLong_AsLongLong(index);
+        Py_DECREF(index);
+        if (sv == -1 && PyErr_Occurred()) {
+            return -1;
+        }
+    }
+
+    switch (code) {
+    case 'b':
+        if (sv < SCHAR_MIN || sv > SCHAR_MAX) goto overflow;
+        *(signed char*) addr = (signed char) sv;
+        return 0;
+    case 'B':
+        if (uv > UCHAR_MAX) goto overflow;
+        *(unsigned char*) addr = (unsigned char) uv;
+        return 0;
+    case 'h':
+        if (sv < SHRT_MIN || sv > SHRT_MAX) goto overflow;
+        *(short*) addr = (short) sv;
+        return 0;
+    case 'H':
+        if (uv > USHRT_MAX) goto overflow;
+        *(unsigned short*) addr = (unsigned short) uv;
+        return 0;
+    case 'i':
+        if (sv < INT_MIN || sv > INT_MAX) goto overflow;
+        *(int*) addr = (int) sv;
+        return 0;
+    case 'I':
+        if (uv > UINT_MAX) goto overflow;
+        *(unsigned int*) addr = (unsigned int) uv;
+        return 0;
+    case 'l':
+        if (sv < LONG_MIN || sv > LONG_MAX) goto overflow;
+        *(long*) addr = (long) sv;
+        return 0;
+    case 'L':
+        if (uv > ULONG_MAX) goto overflow;
+        *(unsigned long*) addr = (unsigned long) uv;
+        return 0;
+    case 'q':
+        *(long long*) addr = sv;
+        return 0;
+    case 'Q':
+        *(unsigned long long*) addr = uv;
+        return 0;
+    case 'n':
+        if (sv < PY_SSIZE_T_MIN || sv > PY_SSIZE_T_MAX) goto overflow;
+        *(Py_ssize_t*) addr = (Py_ssize_t) sv;
+        return 0;
+    }
+
+    PyErr_Format(PyExc_SystemError, "unknown typed field code '%c'", code);
+    return -1;
+
+overflow:
+    PyErr_Format(PyExc_OverflowError,
+                 "%R is out of range for a '%c' field",
+                 value,
+                 code);
+    return -1;
+}
+
+/* Gets the field metadata for a typed namedtuple type.
+   return: A borrowed reference or NULL with an exception set. */
+static namedtuple_fields *
+typed_info(PyTypeObject *cls)
+{
+    PyObject *descr = _PyType_Lookup(cls, fields_str);
+
+    if (!descr ||
+        Py_TYPE(descr) != &namedtuple_fields_type ||
+        !((namedtuple_fields*) descr)->fi_format) {
+        PyErr_Format(PyExc_TypeError,
+                     "%s does not have the fields of a typed namedtuple",
+                     cls->tp_name);
+        return NULL;
+    }
+    return (namedtuple_fields*) descr;
+}
+
+/* Store `n` values into the typed namedtuple `self`.
+   return: Zero on succes, nonzero on failure. */
+static int
+typed_fill(PyObject *self,
+           namedtuple_fields *info,
+           PyObject *const *values,
+           Py_ssize_t n)
+{
+    const char *format = PyBytes_AS_STRING(info->fi_format);
+    Py_ssize_t ix;
+
+    for (ix = 0;ix < n;++ix) {
+        if (typed_store((char*) self + info->fi_members[ix].offset,
+                        format[ix],
+                        values[ix])) {
+            return -1;
+        }
+    }
+    return 0;
+}
+
+/* Box the fields of a typed namedtuple into a plain tuple.
+   return: A new tuple or NULL in case of error. */
+static PyObject *
+typed_astuple(PyObject *self)
+{
+    namedtuple_fields *info;
+    Py_ssize_t fieldc;
+    PyObject *ret;
+    PyObject *item;
+    Py_ssize_t n;
+
+    if (!(info = typed_info(Py_TYPE(self)))) {
+        return NULL;
+    }
+    fieldc = FIELDS_COUNT(info);
+
+    if (!(ret = PyTuple_New(fieldc))) {
+        return NULL;
+    }
+    for (n = 0;n < fieldc;++n) {
+        if (!(item = PyMember_GetOne((const char*) self,
+                                     &info->fi_members[n]))) {
+            Py_DECREF(ret);
+            return NULL;
+        }
+        PyTuple_SET_ITEM(ret, n, item);
+    }
+    return ret;
+}
+
+/* `__new__` for typed namedtuple types. The arguments are bound to the fields
+   like they are for `namedtuple_new` and then stored unboxed.
+   return: A new instance or NULL in case of error. */
+static PyObject *
+typed_new(PyTypeObject *cls, PyObject *args, PyObject *kwargs)
+{
+    namedtuple_fields *info;
+    Py_ssize_t fieldc;
+    Py_ssize_t nargs = PyTuple_GET_SIZE(args);
+    PyObject **values;
+    PyObject *self = NULL;
+    Py_ssize_t pos = 0;
+    PyObject *key;
+    PyObject *value;
+    Py_ssize_t ix;
+
+    if (!(info = typed_info(cls))) {
+        return NULL;
+    }
+    fieldc = FIELDS_COUNT(info);
+
+    if (nargs + ((kwargs) ? PyDict_Size(kwargs) : 0) > fieldc) {
+        PyErr_Format(PyExc_TypeError,
+                     "%U takes at most %zd argument%s (%zd given)",
+                     ((PyHeapTypeObject*) cls)->ht_name,
+                     fieldc,
+                     (fieldc == 1) ? "" : "s",
+                     nargs + ((kwargs) ? PyDict_Size(kwargs) : 0));
+        return NULL;
     }
 
-    fieldc = PyTuple_GET_SIZE(fields);
-    for (n = 0;n < fieldc;++n) {
-        field = PyTuple_GET_ITEM(fields, n);
+    if (!(values = PyMem_Calloc(fieldc + 1, sizeof(PyObject*)))) {
+        PyErr_NoMemory();
+        return NULL;
+    }
+    for (ix = 0;ix < nargs;++ix) {
+        values[ix] = PyTuple_GET_ITEM(args, ix);
+    }
 
-        switch(checkfield(iskeyword, field)) {
-        case CHECKFIELD_VALID:
-            break;
-        case CHECKFIELD_UNDERSCORE:
-            if (!rename) {
-                PyErr_Format(PyExc_ValueError, underscore_fmt, field);
-                Py_DECREF(fields);
-                Py_DECREF(seen);
-                return -1;
-            }
-            break;
-        case CHECKFIELD_NONALNUM:
-            PyErr_Format(PyExc_ValueError, nonalnum_fmt, field);
-            Py_DECREF(fields);
-            Py_DECREF(seen);
-            return -1;
-        case CHECKFIELD_KEYWORD:
-            PyErr_Format(PyExc_ValueError, keyword_fmt, field);
-            Py_DECREF(fields);
-            Py_DECREF(seen);
-            return -1;
-        case CHECKFIELD_DIGIT:
-            PyErr_Format(PyExc_ValueError, digit_fmt, field);
-            Py_DECREF(fields);
-            Py_DECREF(seen);
-            return -1;
-        case CHECKFIELD_EMPTY:
-            PyErr_Format(PyExc_ValueError, empty_field_fmt, n);
-            Py_DECREF(fields);
-            Py_DECREF(seen);
-            return -1;
-        case CHECKFIELD_NOTREADY:
-            PyErr_SetString(PyExc_ValueError, notready_fmt);
-            Py_DECREF(fields);
-            Py_DECREF(seen);
-            return -1;
+    while (kwargs && PyDict_Next(kwargs, &pos, &key, &value)) {
+        if ((ix = find_field(info, key)) == -2) {
+            goto done;
         }
-
-        switch(PySet_Contains(seen, field)) {
-        case 1:
-            PyErr_Format(PyExc_ValueError, seen_fmt, field);
-            /* fallthrough */
-        case -1:
-            Py_DECREF(fields);
-            Py_DECREF(seen);
-            return -1;
+        if (ix == -1) {
+            PyErr_Format(PyExc_TypeError,
+                         "%R is an invalid keyword argument for this "
+                         "function",
+                         key);
+            goto done;
+        }
+        if (values[ix]) {
+            PyErr_Format(PyExc_TypeError,
+                         "Argument given by name ('%U') and position (%zd)",
+                         key,
+                         ix + 1);
+            goto done;
         }
+        values[ix] = value;
+    }
 
-        if (PySet_Add(seen, field)) {
-            Py_DECREF(fields);
-            Py_DECREF(seen);
-            return -1;
+    for (ix = nargs;ix < fieldc;++ix) {
+        if (!values[ix]) {
+            PyErr_Format(PyExc_TypeError,
+                         "Required argument '%U' (pos %zd) not found",
+                         FIELDS_NAME(info, ix),
+                         ix + 1);
+            goto done;
         }
     }
 
-    Py_DECREF(seen);
-    *field_names = fields;
-    return 0;
+    if ((self = cls->tp_alloc(cls, 0)) &&
+        typed_fill(self, info, values, fieldc)) {
+        Py_CLEAR(self);
+    }
+
+done:
+    PyMem_Free(values);
+    return self;
 }
 
-/* Adds a `namedtuple_indexer` for each field in `fields`.
-   return: Zero on succes, nonzero on failure. */
-static int
-add_indexers(PyObject *dict_, PyObject *fields)
+static Py_ssize_t
+typed_length(PyObject *self)
 {
-    Py_ssize_t fieldc = PyTuple_GET_SIZE(fields);
-    Py_ssize_t n;
-    namedtuple_indexer *indexer;
+    namedtuple_fields *info = typed_info(Py_TYPE(self));
 
-    for (n = 0;n < fieldc;++n) {
-        if (!(indexer = PyObject_New(namedtuple_indexer,
-                                     &namedtuple_indexer_type))) {
-            return -1;
-        }
+    return (info) ? FIELDS_COUNT(info) : -1;
+}
 
-        indexer->id_idx = n;
-        if (PyDict_SetItem(dict_,
-                           PyTuple_GET_ITEM(fields, n),
-                           (PyObject*) indexer)) {
-            return -1;
+/* Box the field at index `ix`. */
+static PyObject *
+typed_item(PyObject *self, Py_ssize_t ix)
+{
+    namedtuple_fields *info;
+
+    if (!(info = typed_info(Py_TYPE(self)))) {
+        return NULL;
+    }
+    if (ix < 0 || ix >= FIELDS_COUNT(info)) {
+        PyErr_SetString(PyExc_IndexError, "tuple index out of range");
+        return NULL;
+    }
+    return PyMember_GetOne((const char*) self, &info->fi_members[ix]);
+}
+
+/* Index with an integer or slice like a tuple. */
+static PyObject *
+typed_subscript(PyObject *self, PyObject *key)
+{
+    PyObject *astuple;
+    PyObject *ret;
+    Py_ssize_t ix;
+
+    if (PyIndex_Check(key)) {
+        if ((ix = PyNumber_AsSsize_t(key, PyExc_IndexError)) == -1 &&
+            PyErr_Occurred()) {
+            return NULL;
+        }
+        if (ix < 0) {
+            ix += typed_length(self);
         }
-        Py_DECREF(indexer);
+        return typed_item(self, ix);
     }
 
-    return 0;
+    if (!(astuple = typed_astuple(self))) {
+        return NULL;
+    }
+    ret = PyObject_GetItem(astuple, key);
+    Py_DECREF(astuple);
+    return ret;
 }
 
-/* Cache the repr format string so we don't need to do this every time we call
-   `namedtuple_repr`.
-   return: Zero on succes, nonzero on failure. */
-static int
-cache_repr_fmt(PyObject *dict_, PyObject *fields)
+/* Typed namedtuples hash like the tuple of their fields so that they can be
+   used interchangeably as keys. */
+static Py_hash_t
+typed_hash(PyObject *self)
 {
-    Py_ssize_t fieldc = PyTuple_GET_SIZE(fields);
-    PyObject *field_fmts;
-    PyObject *sep;
-    PyObject *joined;
-    Py_ssize_t n;
-    PyObject *field_fmt;
-    PyObject *reprfmt = NULL;
-    int ret;
+    PyObject *astuple;
+    Py_hash_t ret;
 
-    /* Allocate a tuple strings representing each field's format, */
-    if (!(field_fmts = PyTuple_New(fieldc))) {
+    if (!(astuple = typed_astuple(self))) {
         return -1;
     }
+    ret = PyObject_Hash(astuple);
+    Py_DECREF(astuple);
+    return ret;
+}
 
-    for (n = 0;n < fieldc;++n) {
-        if (!(field_fmt = PyUnicode_FromFormat("%U=%%r",
-                                               PyTuple_GET_ITEM(fields, n)))) {
-            Py_DECREF(field_fmts);
-            return -1;
+/* Compare like the tuple of the fields against tuples and other typed
+   namedtuples. */
+static PyObject *
+typed_richcompare(PyObject *self, PyObject *other, int op)
+{
+    PyObject *lhs;
+    PyObject *rhs;
+    PyObject *ret;
+
+    if (PyTuple_Check(other)) {
+        rhs = other;
+        Py_INCREF(rhs);
+    }
+    else if (Py_TYPE(other)->tp_richcompare == typed_richcompare) {
+        if (!(rhs = typed_astuple(other))) {
+            return NULL;
         }
-        PyTuple_SET_ITEM(field_fmts, n, field_fmt);
+    }
+    else {
+        Py_RETURN_NOTIMPLEMENTED;
     }
 
-    if (!(sep = PyUnicode_FromString(", "))) {
-        Py_DECREF(field_fmts);
-        return -1;
+    if (!(lhs = typed_astuple(self))) {
+        Py_DECREF(rhs);
+        return NULL;
     }
-    joined = PyUnicode_Join(sep, field_fmts);
-    Py_DECREF(sep);
-    Py_DECREF(field_fmts);
-    if (!joined) {
+    ret = PyObject_RichCompare(lhs, rhs, op);
+    Py_DECREF(lhs);
+    Py_DECREF(rhs);
+    return ret;
+}
+
+static PyObject *
+typed_repr(PyObject *self)
+{
+    PyObject *astuple;
+    PyObject *ret;
+
+    if (!(astuple = typed_astuple(self))) {
+        return NULL;
+    }
+    ret = format_repr(self, astuple);
+    Py_DECREF(astuple);
+    return ret;
+}
+
+/* return: The number of bytes used by the unboxed fields, this matches
+   `struct.calcsize(format)`. */
+static Py_ssize_t
+typed_size(namedtuple_fields *info)
+{
+    Py_ssize_t last = FIELDS_COUNT(info) - 1;
+
+    if (last < 0) {
+        return 0;
+    }
+    return info->fi_members[last].offset - TYPED_DATA_OFFSET +
+        find_typed_code(PyBytes_AS_STRING(info->fi_format)[last])->tc_size;
+}
+
+/* Export the unboxed fields. Consumers that ask for a format get a single
+   item described by the struct format of the fields, everyone else gets the
+   raw bytes. */
+static int
+typed_getbuffer(PyObject *self, Py_buffer *view, int flags)
+{
+    namedtuple_fields *info;
+    Py_ssize_t len;
+
+    if (!(info = typed_info(Py_TYPE(self)))) {
         return -1;
     }
-    reprfmt = PyUnicode_FromFormat("%%s(%U)", joined);
-    Py_DECREF(joined);
-    if (!reprfmt) {
+    len = typed_size(info);
+
+    if (PyBuffer_FillInfo(view,
+                          self,
+                          (char*) self + TYPED_DATA_OFFSET,
+                          len,
+                          1,
+                          flags)) {
         return -1;
     }
+    if (flags & PyBUF_FORMAT) {
+        view->format = PyBytes_AS_STRING(info->fi_format);
+        view->itemsize = len;
+        view->ndim = 0;
+        view->shape = NULL;
+        view->strides = NULL;
+    }
+    return 0;
+}
+
+/* Namedtuple class method for creating a typed instance from an iterable. */
+static PyObject *
+typed__make(PyObject *cls, PyObject *iterable)
+{
+    PyObject *args;
+    PyObject *ret;
 
-    ret = PyDict_SetItemString(dict_, "__reprfmt__", reprfmt);
-    Py_DECREF(reprfmt);
+    if (!(args = PySequence_Tuple(iterable))) {
+        return NULL;
+    }
+    ret = ((PyTypeObject*) cls)->tp_new((PyTypeObject*) cls, args, NULL);
+    Py_DECREF(args);
     return ret;
 }
 
-PyGetSetDef namedtuple_getsets[] = {
-    {"__dict__",
-     namedtuple_get_dict,
-     NULL,
-     NULL},
-    {NULL},
-};
+/* return: A new instance of `type(self)` with the kwargs swapped out. */
+static PyObject *
+typed__replace(PyObject *self, PyObject *args, PyObject *kwargs)
+{
+    namedtuple_fields *info;
+    PyObject *values;
+    Py_ssize_t pos = 0;
+    PyObject *key;
+    PyObject *value;
+    Py_ssize_t ix;
+    PyObject *ret;
 
-PyType_Slot namedtuple_slots[] = {
-    {Py_tp_new,
-     namedtuple_new},
-    {Py_tp_methods,
-     namedtuple_methods},
-    {Py_tp_repr,
-     namedtuple_repr},
-    {Py_tp_traverse,
-     namedtuple_traverse},
-    {Py_tp_getset,
-     namedtuple_getsets},
-    {Py_tp_base,
-     &PyTuple_Type},
-    {0, NULL},
-};
+    if (PyTuple_GET_SIZE(args)) {
+        PyErr_Format(PyExc_TypeError,
+                     "_replace takes no positional arguments (%zd given)",
+                     PyTuple_GET_SIZE(args));
+        return NULL;
+    }
+    if (!(info = typed_info(Py_TYPE(self)))) {
+        return NULL;
+    }
+    if (!(values = typed_astuple(self))) {
+        return NULL;
+    }
 
-PyType_Spec namedtuple_spec = {
-    "",  /* placeholder */
-    0,
-    0,
-    Py_TPFLAGS_HAVE_GC
-    | Py_TPFLAGS_TUPLE_SUBCLASS
-    | Py_TPFLAGS_HEAPTYPE
-    | Py_TPFLAGS_BASETYPE
-    | Py_TPFLAGS_DEFAULT,
-    namedtuple_slots,
-};
+    while (kwargs && PyDict_Next(kwargs, &pos, &key, &value)) {
+        if ((ix = find_field(info, key)) < 0) {
+            if (ix == -1) {
+                PyErr_Format(PyExc_ValueError,
+                             "Got unexpected field name: %R",
+                             key);
+            }
+            Py_DECREF(values);
+            return NULL;
+        }
+        Py_INCREF(value);
+        Py_SETREF(PyTuple_GET_ITEM(values, ix), value);
+    }
+
+    ret = Py_TYPE(self)->tp_new(Py_TYPE(self), values, NULL);
+    Py_DECREF(values);
+    return ret;
+}
 
-/* namedtuple factory function.
-   return: A new reference to a new namedtuple type or NULL on failure. */
 static PyObject *
-namedtuple_factory(PyObject *self,PyObject *args,PyObject *kwargs)
+typed__asdict(PyObject *self,
+              PyObject *const *args,
+              Py_ssize_t nargs,
+              PyObject *kwnames)
 {
-    const char *const argnames[] = {
-        "typename",
-        "field_names",
-        "rename",
-        NULL,
+    PyObject *factory;
+    PyObject *astuple;
+    PyObject *ret;
+
+    if (parse_asdict_args(args, nargs, kwnames, &factory) ||
+        !(astuple = typed_astuple(self))) {
+        return NULL;
+    }
+    ret = make_asdict(self, astuple, factory);
+    Py_DECREF(astuple);
+    return ret;
+}
+
+/* Pickle protocol for typed namedtuples.
+   return: A tuple `(type(self), tuple(self))` or NULL in case of an error. */
+static PyObject *
+typed_reduce(PyObject *self, PyObject *_)
+{
+    PyObject *astuple;
+    PyObject *ret;
+
+    if (!(astuple = typed_astuple(self))) {
+        return NULL;
+    }
+    ret = PyTuple_Pack(2, Py_TYPE(self), astuple);
+    Py_DECREF(astuple);
+    return ret;
+}
+
+PyDoc_STRVAR(__reduce___doc,
+"__reduce__() -> (type(self), tuple(self))\n\n"
+"Returns the pair of the type of the instance with the fields as a tuple.");
+
+PyMethodDef typed_methods[] = {
+    {"_make",
+     (PyCFunction) typed__make,
+     METH_CLASS | METH_O,
+     _make_doc},
+    {"_replace",
+     (PyCFunction) typed__replace,
+     METH_VARARGS | METH_KEYWORDS,
+     _replace_doc},
+    {"_key",
+     (PyCFunction) namedtuple__key,
+     METH_CLASS | METH_VARARGS,
+     _key_doc},
+    {"_getter",
+     (PyCFunction) namedtuple__getter,
+     METH_CLASS | METH_VARARGS | METH_KEYWORDS,
+     _getter_doc},
+    {"_asdict",
+     (PyCFunction) typed__asdict,
+     METH_FASTCALL | METH_KEYWORDS,
+     _asdict_doc},
+    {"_asmapping",
+     (PyCFunction) namedtuple__asmapping,
+     METH_NOARGS,
+     _asmapping_doc},
+    {"__reduce__",
+     (PyCFunction) typed_reduce,
+     METH_NOARGS,
+     __reduce___doc},
+    {NULL},
+};
+
+#if PY_VERSION_HEX < 0x03080000
+static void
+members_capsule_destructor(PyObject *capsule)
+{
+    PyMem_Free(PyCapsule_GetPointer(capsule, NULL));
+}
+
+/* `PyType_FromSpec` only copies the members into the type since 3.8. Before
+   that the type points at `members`, which must live as long as the type and
+   not as long as anything user code can remove, like the `_fields`
+   descriptor. They are held by a capsule in the otherwise unused `tp_cache`,
+   which `type` releases when the type is freed.
+   return: Zero on success, nonzero on failure. */
+static int
+keep_members(PyTypeObject *type, PyMemberDef *members)
+{
+    assert(!type->tp_cache);
+    if (!(type->tp_cache = PyCapsule_New(members,
+                                         NULL,
+                                         members_capsule_destructor))) {
+        return -1;
+    }
+    return 0;
+}
+#endif
+
+/* Create the heap type for a typed namedtuple. The fields are laid out with
+   native alignment in the order given, matching the struct module.
+   return: A new reference to the type or NULL on failure. On success,
+   `*format` is set to a new reference to the struct format as bytes. */
+static PyTypeObject *
+typed_type_from_spec(const char *name,
+                     PyObject *fields,
+                     PyObject *types,
+                     PyObject **format)
+{
+    Py_ssize_t fieldc = PyTuple_GET_SIZE(fields);
+    PyMemberDef *members;
+    const typed_code *tc;
+    Py_ssize_t offset = 0;
+    Py_ssize_t align = sizeof(PyObject*);
+    Py_ssize_t n;
+    PyTypeObject *newtype = NULL;
+    PyType_Slot slots[] = {
+        {Py_tp_new, typed_new},
+        {Py_tp_methods, typed_methods},
+        {Py_tp_members, NULL},  /* filled in below */
+        {Py_tp_repr, typed_repr},
+        {Py_tp_hash, typed_hash},
+        {Py_tp_richcompare, typed_richcompare},
+        {Py_sq_length, typed_length},
+        {Py_sq_item, typed_item},
+        {Py_mp_subscript, typed_subscript},
+#if PY_VERSION_HEX >= 0x03090000
+        {Py_bf_getbuffer, typed_getbuffer},
+#endif
+        {0, NULL},
+    };
+    PyType_Spec spec = {
+        name,
+        0,  /* filled in below */
+        0,
+        Py_TPFLAGS_BASETYPE | Py_TPFLAGS_DEFAULT,
+        slots,
     };
-    module_state *st = PyModule_GetState(self);
-    PyObject *typename = NULL;
-    PyObject *field_names = NULL;
-    int rename = 0;
-    PyTypeObject *newtype;
-    PyObject *globals;
-    PyObject *module_name;
-    PyObject *qualname;
-    namedtuple_descr_wrapper *descr;
-    PyObject *dict_;
-    int err;
 
-    if (!st) {
-        PyErr_SetString(PyExc_AssertionError, "module state is NULL");
+    if (!PyUnicode_Check(types) ||
+        PyUnicode_READY(types) ||
+        PyUnicode_GET_LENGTH(types) != fieldc) {
+        PyErr_Format(PyExc_ValueError,
+                     "types must be a str with one struct format character "
+                     "per field (%zd), got %R",
+                     fieldc,
+                     types);
         return NULL;
     }
 
-    if (!PyArg_ParseTupleAndKeywords(args,
-                                     kwargs,
-                                     "OO|p:namedtuple",
-                                     (char**) argnames,
-                                     &typename,
-                                     &field_names,
-                                     &rename)) {
+    if (!(*format = PyBytes_FromStringAndSize(NULL, fieldc))) {
+        return NULL;
+    }
+    if (!(members = PyMem_Calloc(fieldc + 1, sizeof(PyMemberDef)))) {
+        Py_CLEAR(*format);
+        PyErr_NoMemory();
         return NULL;
     }
 
-    if (!(typename = PyObject_Str(typename))) {
-        /* Typename cannot be converted to `str`. */
+    for (n = 0;n < fieldc;++n) {
+        if (!(tc = find_typed_code(PyUnicode_READ_CHAR(types, n)))) {
+            PyErr_Format(PyExc_ValueError,
+                         "unsupported type for field %R: '%c'",
+                         PyTuple_GET_ITEM(fields, n),
+                         (int) PyUnicode_READ_CHAR(types, n));
+            goto done;
+        }
+        /* The names share a lifetime with the `_fields` tuple, which is
+           owned by the type. */
+        if (!(members[n].name = PyUnicode_AsUTF8(PyTuple_GET_ITEM(fields,
+                                                                  n)))) {
+            goto done;
+        }
+        offset = (offset + tc->tc_align - 1) / tc->tc_align * tc->tc_align;
+        if (tc->tc_align > align) {
+            align = tc->tc_align;
+        }
+        members[n].type = tc->tc_member;
+        members[n].offset = TYPED_DATA_OFFSET + offset;
+        members[n].flags = READONLY;
+        offset += tc->tc_size;
+        PyBytes_AS_STRING(*format)[n] = tc->tc_code;
+    }
+
+    slots[2].pfunc = members;
+    /* Pad the size like a struct so that the allocator, and any subclass
+       that adds a `__dict__` or slots after the data, stays aligned. */
+    offset = (offset + align - 1) / align * align;
+    spec.basicsize = TYPED_DATA_OFFSET + offset;
+    newtype = (PyTypeObject*) PyType_FromSpec(&spec);
+#if PY_VERSION_HEX < 0x03090000
+    /* There is no buffer slot for `PyType_FromSpec` before 3.9. */
+    if (newtype) {
+        newtype->tp_as_buffer->bf_getbuffer = typed_getbuffer;
+    }
+#endif
+
+done:
+#if PY_VERSION_HEX < 0x03080000
+    if (newtype && keep_members(newtype, members)) {
+        Py_CLEAR(newtype);
+    }
+    if (!newtype) {
+        PyMem_Free(members);
+    }
+#else
+    PyMem_Free(members);
+#endif
+    if (!newtype) {
+        Py_CLEAR(*format);
+    }
+    return newtype;
+}
+
+/* The most slots in the spec of a tuple namedtuple type. */
+#define TUPLE_SPEC_MAX_SLOTS 16
+
+/* Create a tuple namedtuple type named `name` from `spec` with a read-only
+   member for each of `fields` that reads the item at the same index. The
+   specializing interpreter inlines reads of members holding objects, which it
+   cannot do for a custom descriptor. `spec` is copied, never changed, so
+   types may be created from several threads at once.
+   return: A new reference to the type or NULL on failure. */
+static PyTypeObject *
+tuple_type_from_spec(const PyType_Spec *spec,
+                     const char *name,
+                     PyObject *fields)
+{
+    Py_ssize_t fieldc = PyTuple_GET_SIZE(fields);
+    PyType_Slot slots[TUPLE_SPEC_MAX_SLOTS + 2];
+    PyType_Spec members_spec = *spec;
+    PyMemberDef *members;
+    PyTypeObject *newtype = NULL;
+    Py_ssize_t nslots;
+    Py_ssize_t n;
+
+    for (nslots = 0;spec->slots[nslots].slot;++nslots) {
+        assert(nslots < TUPLE_SPEC_MAX_SLOTS);
+        slots[nslots] = spec->slots[nslots];
+    }
+
+    if (!(members = PyMem_Calloc(fieldc + 1, sizeof(PyMemberDef)))) {
+        PyErr_NoMemory();
         return NULL;
     }
+    for (n = 0;n < fieldc;++n) {
+        /* The names share a lifetime with the `_fields` tuple, which is
+           owned by the type. */
+        if (!(members[n].name = PyUnicode_AsUTF8(PyTuple_GET_ITEM(fields,
+                                                                  n)))) {
+            goto done;
+        }
+        members[n].type = T_OBJECT_EX;
+        members[n].offset = offsetof(PyTupleObject, ob_item) +
+                            n * sizeof(PyObject*);
+        members[n].flags = READONLY;
+    }
+
+    slots[nslots].slot = Py_tp_members;
+    slots[nslots].pfunc = members;
+    slots[nslots + 1].slot = 0;
+    slots[nslots + 1].pfunc = NULL;
+    members_spec.name = name;
+    members_spec.slots = slots;
+    newtype = (PyTypeObject*) PyType_FromSpec(&members_spec);
+
+done:
+#if PY_VERSION_HEX < 0x03080000
+    if (newtype && keep_members(newtype, members)) {
+        Py_CLEAR(newtype);
+    }
+    if (!newtype) {
+        PyMem_Free(members);
+    }
+#else
+    PyMem_Free(members);
+#endif
+    return newtype;
+}
+
+/* Build a new namedtuple type from an unvalidated `field_names`. If `types`
+   is not NULL, the type stores its fields unboxed as described by `types`.
+   If `cache_hash` is nonzero, instances store their hash.
+   return: A new reference to a new namedtuple type or NULL on failure. */
+static PyObject *
+make_namedtuple_type(module_state *st,
+                     PyObject *typename,
+                     PyObject *field_names,
+                     int rename,
+                     PyObject *module_name,
+                     PyObject *types,
+                     int cache_hash)
+{
+    const PyType_Spec *spec = (cache_hash) ?
+        &namedtuple_cached_hash_spec :
+        &namedtuple_spec;
+    PyTypeObject *newtype;
+    PyObject *format = NULL;
+    PyObject *qualname;
+    const char *name;
+    namedtuple_descr_wrapper *descr;
+    namedtuple_fields *info;
+    PyObject *dict_;
+    int err;
 
     /* Validate and rename the `typename` and `field_names`. After this
        function, field_names` will point to a tuple of strings that is the
        split and renamed fields (if there are no errors). */
-    if (validate_field_names(typename, &field_names, rename, st->iskeyword)) {
-        /* Invalid `field_names` or `typename`. */
-        Py_DECREF(typename);
+    if (types && cache_hash) {
+        PyErr_SetString(PyExc_ValueError,
+                        "cache_hash cannot be used with types");
         return NULL;
     }
 
-    /* Lookup the module where this type was defined and store it as
-       `__module__` in the dict */
-    if ((globals = PyEval_GetGlobals()) &&
-        (module_name = PyDict_GetItemString(globals, "__name__"))) {
-        Py_INCREF(module_name);
-    }
-    /* Not defining a module is deprecated in >=3.5. We will set it to
-       "cnamedtuple.no_module" if we cannot find the module we are in. */
-    else if (!(module_name =
-               PyUnicode_InternFromString("cnamedtuple.no_module"))){
-        Py_DECREF(typename);
-        Py_DECREF(field_names);
+    if (validate_field_names(typename, &field_names, rename)) {
+        /* Invalid `field_names` or `typename`. */
         return NULL;
     }
 
     qualname = PyUnicode_FromFormat("%S.%U", module_name, typename);
-    Py_DECREF(typename);
-    Py_DECREF(module_name);
     if (!qualname) {
         Py_DECREF(field_names);
         return NULL;
     }
 
-     /* We need to play with the memory around namedtuple_spec.name because
-       PyType_FromSpec assumes that the name is statically allocated.
-       Here we will point the name at the data for our qualname unicode object.
-       The name field now shares a lifetime with qualname because it points to
-       the same data. */
-    if (!(namedtuple_spec.name = PyUnicode_AsUTF8(qualname))) {
+    /* PyType_FromSpec assumes that the name is statically allocated, so the
+       spec is given the data of our qualname unicode object and the type's
+       tp_name is pointed at its own copy below. The shared specs keep their
+       placeholder name. */
+    if (!(name = PyUnicode_AsUTF8(qualname))) {
         Py_DECREF(qualname);
         Py_DECREF(field_names);
         return NULL;
     }
-    newtype = (PyTypeObject*) PyType_FromSpec(&namedtuple_spec);
-    namedtuple_spec.name = "";  /* set back to our sentinel */
+    if (types) {
+        newtype = typed_type_from_spec(name, field_names, types, &format);
+    }
+    else {
+        newtype = tuple_type_from_spec(spec, name, field_names);
+    }
     Py_DECREF(qualname);  /* kill the qualname */
     if (!newtype) {
         Py_DECREF(field_names);
@@ -1188,6 +7754,7 @@ namedtuple_factory(PyObject *self,PyObject *args,PyObject *kwargs)
        shares a lifetime with the ht_name field. */
     if (!(newtype->tp_name =
           PyUnicode_AsUTF8(((PyHeapTypeObject*) newtype)->ht_name))) {
+        Py_XDECREF(format);
         Py_DECREF(field_names);
         Py_DECREF(newtype);
         return NULL;
@@ -1195,24 +7762,38 @@ namedtuple_factory(PyObject *self,PyObject *args,PyObject *kwargs)
 
     dict_ = newtype->tp_dict;
 
-    /* Add indexers for each name. */
-    if (add_indexers(dict_, field_names)) {
+    if (!types) {
+#if PY_VERSION_HEX >= 0x03090000
+        /* Calls to the type skip `type.__call__` and go straight to the
+           fields. This is not inherited, so subclasses still go through
+           `tp_new` and `tp_init` normally. */
+        newtype->tp_vectorcall = namedtuple_vectorcall;
+#endif
+    }
+    else if (PyDict_SetItemString(dict_, "_types", types)) {
+        Py_DECREF(format);
         Py_DECREF(field_names);
         Py_DECREF(newtype);
         return NULL;
     }
 
-    /* Add the field descriptor. */
-    if (!(descr = PyObject_New(namedtuple_descr_wrapper,
-                               &namedtuple_descr_wrapper_type))) {
+    /* Add the field descriptor. This also carries the field metadata that
+       the instance methods read. */
+    if (!(info = namedtuple_fields_new(field_names))) {
+        Py_XDECREF(format);
         Py_DECREF(field_names);
         Py_DECREF(newtype);
         return NULL;
     }
-    descr->wr_wrapped = field_names;
-    err = PyDict_SetItemString(dict_, "_fields", (PyObject*) descr);
-    Py_DECREF(descr);
+    /* The members were copied into the type by `PyType_FromSpec`, or are
+       held by the type's `tp_cache` before 3.8. */
+    info->fi_format = format;
+    info->fi_owner = newtype;
+    info->fi_members = newtype->tp_members;
+    err = PyDict_SetItem(dict_, fields_str, (PyObject*) info);
+    Py_DECREF(info);
     if (err) {
+        Py_DECREF(field_names);
         Py_DECREF(newtype);
         return NULL;
     }
@@ -1220,47 +7801,360 @@ namedtuple_factory(PyObject *self,PyObject *args,PyObject *kwargs)
     /* Add an empty '__slots__' */
     if (!(descr = PyObject_New(namedtuple_descr_wrapper,
                                &namedtuple_descr_wrapper_type))) {
+        Py_DECREF(field_names);
         Py_DECREF(newtype);
         return NULL;
     }
     if (!(descr->wr_wrapped = PyTuple_New(0))) {
+        Py_DECREF(field_names);
         Py_DECREF(newtype);
         return NULL;
     }
     err = PyDict_SetItemString(dict_, "__slots__", (PyObject*) descr);
     Py_DECREF(descr);
     if (err) {
+        Py_DECREF(field_names);
         Py_DECREF(newtype);
         return NULL;
     }
 
-    /* Add the `__reprfmt__` and `tp_doc`.*/
-    if (cache_repr_fmt(dict_, field_names)) {
-        Py_DECREF(newtype);
+    Py_DECREF(field_names);
+    PyType_Modified(newtype);
+    return (PyObject*) newtype;
+}
+
+/* Store `*type` in the type cache under `key`, evicting the oldest entry if
+   the cache is full. If another thread stored a type under `key` since it was
+   looked up, `*type` is replaced with that one so that every caller gets the
+   same type. The caller holds the critical section of the cache.
+   return: Zero on succes, nonzero on failure. */
+static int
+type_cache_insert(module_state *st, PyObject *key, PyObject **type)
+{
+    Py_ssize_t pos = 0;
+    PyObject *oldest;
+    PyObject *value;
+
+    if ((value = PyDict_GetItemWithError(st->type_cache, key))) {
+        Py_INCREF(value);
+        Py_SETREF(*type, value);
+        return 0;
+    }
+    if (PyErr_Occurred()) {
+        return -1;
+    }
+    if (PyDict_GET_SIZE(st->type_cache) >= TYPE_CACHE_SIZE &&
+        PyDict_Next(st->type_cache, &pos, &oldest, &value) &&
+        PyDict_DelItem(st->type_cache, oldest)) {
+        return -1;
+    }
+    return PyDict_SetItem(st->type_cache, key, *type);
+}
+
+/* Unpack the arguments to `namedtuple` into
+   `argv = {typename, field_names, rename, cache, types, cache_hash}`. This is
+   done by hand because `PyArg_ParseTupleAndKeywords` has to build a str for
+   every keyword it looks for, which is most of the cost of a cached call.
+   return: Zero on succes, nonzero on failure. */
+static int
+parse_factory_args(PyObject *args, PyObject *kwargs, PyObject **argv)
+{
+    const char *const argnames[] = {
+        "typename",
+        "field_names",
+        "rename",
+        "cache",
+        "types",
+        "cache_hash",
+    };
+    Py_ssize_t nargs = PyTuple_GET_SIZE(args);
+    Py_ssize_t pos = 0;
+    Py_ssize_t n;
+    PyObject *key;
+    PyObject *value;
+
+    if (nargs > 3) {
+        PyErr_Format(PyExc_TypeError,
+                     "namedtuple() takes at most 3 positional arguments "
+                     "(%zd given)",
+                     nargs);
+        return -1;
+    }
+    for (n = 0;n < nargs;++n) {
+        argv[n] = PyTuple_GET_ITEM(args, n);
+    }
+
+    while (kwargs && PyDict_Next(kwargs, &pos, &key, &value)) {
+        if (!PyUnicode_Check(key)) {
+            PyErr_SetString(PyExc_TypeError, "keywords must be strings");
+            return -1;
+        }
+        for (n = 0;n < 6;++n) {
+            if (!PyUnicode_CompareWithASCIIString(key, argnames[n])) {
+                break;
+            }
+        }
+        if (n == 6) {
+            PyErr_Format(PyExc_TypeError,
+                         "'%U' is an invalid keyword argument for "
+                         "namedtuple()",
+                         key);
+            return -1;
+        }
+        if (argv[n]) {
+            PyErr_Format(PyExc_TypeError,
+                         "Argument given by name ('%s') and position (%zd)",
+                         argnames[n],
+                         n + 1);
+            return -1;
+        }
+        argv[n] = value;
+    }
+
+    for (n = 0;n < 2;++n) {
+        if (!argv[n]) {
+            PyErr_Format(PyExc_TypeError,
+                         "Required argument '%s' (pos %zd) not found",
+                         argnames[n],
+                         n + 1);
+            return -1;
+        }
+    }
+    return 0;
+}
+
+/* Build a namedtuple type like `make_namedtuple_type`. If `cache` is
+   nonzero the type is looked up in, or added to, the type cache first.
+   return: A new reference to a namedtuple type or NULL on failure. */
+static PyObject *
+cached_namedtuple_type(module_state *st,
+                       PyObject *typename,
+                       PyObject *field_names,
+                       int rename,
+                       PyObject *module_name,
+                       PyObject *types,
+                       int cache,
+                       int cache_hash)
+{
+    PyObject *fields = NULL;
+    PyObject *key = NULL;
+    PyObject *ret = NULL;
+    int err;
+
+    if (cache) {
+        /* Key on the split names so that every spelling of the same fields,
+           like `'a b'`, `'a,b'` and `['a', 'b']`, finds the same type. The
+           iterable is only read once. */
+        if (!(field_names = fields = build_fields(field_names))) {
+            return NULL;
+        }
+        if (!(key = PyTuple_Pack(6,
+                                 module_name,
+                                 typename,
+                                 field_names,
+                                 rename ? Py_True : Py_False,
+                                 types ? types : Py_None,
+                                 cache_hash ? Py_True : Py_False))) {
+            goto done;
+        }
+        /* The cache is shared by every thread. Its entries are borrowed, so
+           without the GIL they must be taken while the cache is locked. */
+        Py_BEGIN_CRITICAL_SECTION(st->type_cache);
+        if ((ret = PyDict_GetItemWithError(st->type_cache, key))) {
+            ++st->cache_hits;
+            Py_INCREF(ret);
+        }
+        else if (!PyErr_Occurred()) {
+            ++st->cache_misses;
+        }
+        Py_END_CRITICAL_SECTION();
+        if (ret || PyErr_Occurred()) {
+            goto done;
+        }
+    }
+
+    ret = make_namedtuple_type(st,
+                               typename,
+                               field_names,
+                               rename,
+                               module_name,
+                               types,
+                               cache_hash);
+
+    if (ret && key) {
+        Py_BEGIN_CRITICAL_SECTION(st->type_cache);
+        err = type_cache_insert(st, key, &ret);
+        Py_END_CRITICAL_SECTION();
+        if (err) {
+            Py_CLEAR(ret);
+        }
+    }
+
+done:
+    Py_XDECREF(key);
+    Py_XDECREF(fields);
+    return ret;
+}
+
+/* namedtuple factory function.
+   return: A new reference to a new namedtuple type or NULL on failure. */
+static PyObject *
+namedtuple_factory(PyObject *self,PyObject *args,PyObject *kwargs)
+{
+    module_state *st = PyModule_GetState(self);
+    PyObject *argv[6] = {NULL, NULL, NULL, NULL, NULL, NULL};
+    PyObject *typename;
+    PyObject *field_names;
+    PyObject *types;
+    int rename = 0;
+    int cache = 0;
+    int cache_hash = 0;
+    PyObject *globals;
+    PyObject *module_name;
+    PyObject *ret;
+
+    if (!st) {
+        PyErr_SetString(PyExc_AssertionError, "module state is NULL");
         return NULL;
     }
 
-    /* set the asdict constructor */
-    if (PyDict_SetItemString(dict_, "__asdict__", st->asdict)) {
-        Py_DECREF(newtype);
+    if (parse_factory_args(args, kwargs, argv)) {
+        return NULL;
+    }
+    typename = argv[0];
+    field_names = argv[1];
+    types = (argv[4] == Py_None) ? NULL : argv[4];
+    if ((argv[2] && (rename = PyObject_IsTrue(argv[2])) < 0) ||
+        (argv[3] && (cache = PyObject_IsTrue(argv[3])) < 0) ||
+        (argv[5] && (cache_hash = PyObject_IsTrue(argv[5])) < 0)) {
         return NULL;
     }
 
-    return (PyObject*) newtype;
+    if (!(typename = PyObject_Str(typename))) {
+        /* Typename cannot be converted to `str`. */
+        return NULL;
+    }
+
+    /* Lookup the module where this type was defined and store it as
+       `__module__` in the dict */
+    if ((globals = PyEval_GetGlobals()) &&
+        (module_name = PyDict_GetItemString(globals, "__name__"))) {
+        Py_INCREF(module_name);
+    }
+    /* Not defining a module is deprecated in >=3.5. We will set it to
+       "cnamedtuple.no_module" if we cannot find the module we are in. */
+    else if (!(module_name =
+               PyUnicode_InternFromString("cnamedtuple.no_module"))){
+        Py_DECREF(typename);
+        return NULL;
+    }
+
+    ret = cached_namedtuple_type(st,
+                                 typename,
+                                 field_names,
+                                 rename,
+                                 module_name,
+                                 types,
+                                 cache,
+                                 cache_hash);
+    Py_DECREF(typename);
+    Py_DECREF(module_name);
+    return ret;
 }
 
 static PyObject *
-_register_asdict(PyObject *self, PyObject *asdict)
+_type_cache_info(PyObject *self, PyObject *_)
+{
+    module_state *st = PyModule_GetState(self);
+    PyObject *ret;
+
+    Py_BEGIN_CRITICAL_SECTION(st->type_cache);
+    ret = Py_BuildValue("(nnnn)",
+                        st->cache_hits,
+                        st->cache_misses,
+                        (Py_ssize_t) TYPE_CACHE_SIZE,
+                        PyDict_GET_SIZE(st->type_cache));
+    Py_END_CRITICAL_SECTION();
+    return ret;
+}
+
+static PyObject *
+type_cache_clear(PyObject *self, PyObject *_)
 {
     module_state *st = PyModule_GetState(self);
 
-    Py_DECREF(st->asdict);
-    Py_INCREF(asdict);
-    st->asdict = asdict;
+    Py_BEGIN_CRITICAL_SECTION(st->type_cache);
+    PyDict_Clear(st->type_cache);
+    st->cache_hits = 0;
+    st->cache_misses = 0;
+    Py_END_CRITICAL_SECTION();
+    Py_RETURN_NONE;
+}
+
+static PyObject *
+set_freelist_limit(PyObject *self, PyObject *limit)
+{
+    Py_ssize_t new_limit;
+    Py_ssize_t old_limit = freelist_limit;
+
+    if ((new_limit = PyNumber_AsSsize_t(limit, PyExc_OverflowError)) == -1 &&
+        PyErr_Occurred()) {
+        return NULL;
+    }
+    if (new_limit < 0) {
+        PyErr_SetString(PyExc_ValueError, "limit must be non-negative");
+        return NULL;
+    }
+#ifndef Py_GIL_DISABLED
+    freelist_limit = new_limit;
+    freelist_trim(new_limit);
+#endif
+    return PyLong_FromSsize_t(old_limit);
+}
+
+static PyObject *
+freelist_clear(PyObject *self, PyObject *_)
+{
+    return PyLong_FromSsize_t(freelist_trim(0));
+}
+
+static PyObject *
+set_asdict_factory(PyObject *self, PyObject *factory)
+{
+    module_state *st = PyModule_GetState(self);
+    PyObject *previous;
+
+    Py_INCREF(factory);
+    Py_BEGIN_CRITICAL_SECTION(self);
+    previous = st->asdict;
+    st->asdict = factory;
+    Py_END_CRITICAL_SECTION();
+    return previous;
+}
 
+static PyObject *
+_register_asdict(PyObject *self, PyObject *asdict)
+{
+    Py_XDECREF(set_asdict_factory(self, asdict));
     Py_RETURN_NONE;
 }
 
+static PyObject *
+_batch_from_buffer(PyObject *self, PyObject *args)
+{
+    PyObject *cls;
+    PyObject *data;
+
+    if (!PyArg_ParseTuple(args,
+                          "O!O:_batch_from_buffer",
+                          &PyType_Type,
+                          &cls,
+                          &data)) {
+        return NULL;
+    }
+    return namedtuple_batch_new((PyTypeObject*) cls, data);
+}
+
 PyDoc_STRVAR(namedtuple_doc,
 "Returns a new subclass of tuple with named fields.\n"
 "\n"
@@ -1280,7 +8174,60 @@ PyDoc_STRVAR(namedtuple_doc,
 "    >>> Point(**d)           # convert from a dictionary\n"
 "    Point(x=11, y=22)\n"
 "    >>> p._replace(x=100)    # _replace() is like str.replace() but targets named fields\n"
-"    Point(x=100, y=22)\n");
+"    Point(x=100, y=22)\n"
+"\n"
+"If 'types' is given, it is a str with one struct module format character\n"
+"per field (one of 'bBhHiIlLqQnfd?'). The fields are stored unboxed with\n"
+"native alignment and the raw bytes are exported through the buffer\n"
+"protocol. These types are read-only sequences which compare and hash like\n"
+"the tuple of their fields but are not tuple subclasses.\n"
+"\n"
+"    >>> Tick = namedtuple('Tick', 'ts px qty', types='qdd')\n"
+"    >>> struct.unpack(Tick._types, memoryview(Tick(1, 2.5, 3)))\n"
+"    (1, 2.5, 3.0)\n"
+"\n"
+"If 'cache_hash' is true, each instance computes its hash once and stores\n"
+"it, which speeds up using the instances as dict keys or set members. The\n"
+"hash is still equal to the hash of the tuple of the fields and instances\n"
+"of the same type whose stored hashes differ compare unequal without\n"
+"comparing their fields.\n"
+"\n"
+"If 'cache' is true, calls with the same module, typename, field_names,\n"
+"rename, types and cache_hash return the same type object. The cache holds the most\n"
+"recently created types and can be inspected with 'type_cache_info()'.\n");
+
+PyDoc_STRVAR(_type_cache_info_doc,
+"_type_cache_info() -> (hits, misses, maxsize, currsize)\n\n"
+"Report the statistics of the cache used by 'namedtuple(..., cache=True)'.");
+
+PyDoc_STRVAR(type_cache_clear_doc,
+"type_cache_clear() -> None\n\n"
+"Drop every type held by the cache used by 'namedtuple(..., cache=True)'\n"
+"and reset its statistics.");
+
+PyDoc_STRVAR(set_freelist_limit_doc,
+"set_freelist_limit(limit) -> int\n\n"
+"Set the number of freed instances kept for reuse for each field count and\n"
+"return the previous limit. Instances with more than 20 fields are never\n"
+"kept. A limit of 0 disables the free lists. Free-threaded builds have no\n"
+"free lists and the limit stays 0.");
+
+PyDoc_STRVAR(freelist_clear_doc,
+"freelist_clear() -> int\n\n"
+"Release the memory held by the namedtuple free lists and return the\n"
+"number of blocks released.");
+
+PyDoc_STRVAR(set_asdict_factory_doc,
+"set_asdict_factory(factory) -> previous factory\n\n"
+"Set the mapping type built by '_asdict' and '__dict__' for namedtuple\n"
+"classes that do not set '__asdict__'. With 'dict' or 'OrderedDict' the\n"
+"fields are written into a presized dict without building any\n"
+"intermediate pairs.");
+
+PyDoc_STRVAR(_batch_from_buffer_doc,
+"_batch_from_buffer(cls, buffer) -> batch\n\n"
+"Wrap the output of 'cls._pack' in a batch without copying it. This is\n"
+"used to unpickle batches.");
 
 PyDoc_STRVAR(_register_asdict_doc,
 "_register_asdict(type) -> None\n\n"
@@ -1309,8 +8256,8 @@ module_traverse(PyObject *self,visitproc visit,void *arg)
     if (!st) {
         return 1;
     }
-    Py_VISIT(st->iskeyword);
     Py_VISIT(st->asdict);
+    Py_VISIT(st->type_cache);
     return 0;
 }
 
@@ -1321,8 +8268,8 @@ module_clear(PyObject *self) {
     if (!st) {
         return 1;
     }
-    Py_CLEAR(st->iskeyword);
     Py_CLEAR(st->asdict);
+    Py_CLEAR(st->type_cache);
     return 0;
 }
 
@@ -1334,8 +8281,8 @@ module_free(PyObject *self) {
         return;
     }
 
-    Py_XDECREF(st->iskeyword);
     Py_XDECREF(st->asdict);
+    Py_XDECREF(st->type_cache);
 }
 
 PyDoc_STRVAR(module_doc,
@@ -1353,6 +8300,30 @@ static struct PyMethodDef module_functions[] = {
      .ml_meth=_register_asdict,
      .ml_flags=METH_O,
      .ml_doc=_register_asdict_doc},
+    {.ml_name="_type_cache_info",
+     .ml_meth=_type_cache_info,
+     .ml_flags=METH_NOARGS,
+     .ml_doc=_type_cache_info_doc},
+    {.ml_name="type_cache_clear",
+     .ml_meth=type_cache_clear,
+     .ml_flags=METH_NOARGS,
+     .ml_doc=type_cache_clear_doc},
+    {.ml_name="set_asdict_factory",
+     .ml_meth=set_asdict_factory,
+     .ml_flags=METH_O,
+     .ml_doc=set_asdict_factory_doc},
+    {.ml_name="set_freelist_limit",
+     .ml_meth=set_freelist_limit,
+     .ml_flags=METH_O,
+     .ml_doc=set_freelist_limit_doc},
+    {.ml_name="freelist_clear",
+     .ml_meth=freelist_clear,
+     .ml_flags=METH_NOARGS,
+     .ml_doc=freelist_clear_doc},
+    {.ml_name="_batch_from_buffer",
+     .ml_meth=_batch_from_buffer,
+     .ml_flags=METH_VARARGS,
+     .ml_doc=_batch_from_buffer_doc},
     {NULL},
 };
 
@@ -1372,13 +8343,34 @@ PyMODINIT_FUNC
 PyInit__namedtuple(void)
 {
     PyObject *m;
-    PyObject *keyword_mod;
     module_state *st;
 
-    if (PyType_Ready(&namedtuple_indexer_type) < 0) {
+    if (PyType_Ready(&namedtuple_descr_wrapper_type) < 0) {
         return NULL;
     }
-    if (PyType_Ready(&namedtuple_descr_wrapper_type) < 0) {
+    if (PyType_Ready(&namedtuple_fields_type) < 0) {
+        return NULL;
+    }
+    if (PyType_Ready(&namedtuple_getter_type) < 0) {
+        return NULL;
+    }
+    if (PyType_Ready(&namedtuple_array_type) < 0) {
+        return NULL;
+    }
+    if (PyType_Ready(&namedtuple_mapping_type) < 0) {
+        return NULL;
+    }
+    if (PyType_Ready(&namedtuple_batch_type) < 0) {
+        return NULL;
+    }
+    if (PyType_Ready(&namedtuple_file_type) < 0) {
+        return NULL;
+    }
+    if (!fields_str && !(fields_str = PyUnicode_InternFromString("_fields"))) {
+        return NULL;
+    }
+    if (!asdict_str &&
+        !(asdict_str = PyUnicode_InternFromString("__asdict__"))) {
         return NULL;
     }
 
@@ -1395,16 +8387,21 @@ PyInit__namedtuple(void)
     st->asdict = (PyObject*) &PyDict_Type;
     Py_INCREF(st->asdict);
 
-    if (!(keyword_mod = PyImport_ImportModule("keyword"))) {
+    if (!(st->type_cache = PyDict_New())) {
         Py_DECREF(m);
         return NULL;
     }
-    st->iskeyword = PyObject_GetAttrString(keyword_mod, "iskeyword");
-    Py_DECREF(keyword_mod);
-    if (!st->iskeyword) {
+
+#ifdef Py_GIL_DISABLED
+    /* The shared state, arrays and record files are guarded by critical
+       sections and the free lists are left out, so the module does not need
+       the GIL. This is the single-phase spelling of the `Py_mod_gil` slot,
+       which `PyState_FindModule` rules out. */
+    if (PyUnstable_Module_SetGIL(m, Py_MOD_GIL_NOT_USED)) {
         Py_DECREF(m);
         return NULL;
     }
+#endif
 
     return m;
 }
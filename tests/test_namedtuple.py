@@ -4,17 +4,68 @@
 # This file is taken from the CPython test suite and modified to test
 # cnamedtuple instead of collections.namedtuple
 from collections import OrderedDict
+from collections.abc import Mapping
 import copy
+import gc
+import io
+import keyword
+import os
 import pickle
 from random import choice
 import string
+import struct
 import sys
+import sysconfig
+import tempfile
+import threading
 import unittest
 
-from cnamedtuple import namedtuple
+from cnamedtuple import (
+    freelist_clear,
+    namedtuple,
+    set_asdict_factory,
+    set_freelist_limit,
+    type_cache_clear,
+    type_cache_info,
+)
 
 
 TestNT = namedtuple('TestNT', 'x y z')    # type used for pickle tests
+TestTick = namedtuple('TestTick', 'ts px qty', types='qdd')
+
+
+def _close_file():
+    try:
+        CloseOnLoad.files[-1].close()
+    except BufferError:
+        return 'busy'
+    return 'closed'
+
+
+class ClearOnPickle:
+    """Empties a list when it is pickled and loads as an empty list."""
+
+    def __init__(self, target):
+        self.target = target
+
+    def __reduce__(self):
+        self.target.clear()
+        return list, ()
+
+    @classmethod
+    def records(cls, type_, n=3):
+        """Build ``n`` records of ``type_`` that clear the list they are in."""
+        records = []
+        records.extend(type_(m, cls(records), m) for m in range(n))
+        return records
+
+
+class CloseOnLoad:
+    """Pickles as a call that closes the record file being read."""
+    files = []
+
+    def __reduce__(self):
+        return _close_file, ()
 
 
 class TestNamedTuple(unittest.TestCase):
@@ -60,6 +111,35 @@ class TestNamedTuple(unittest.TestCase):
         ]:
             self.assertEqual(namedtuple('NT', spec, rename=True)._fields, renamed)
 
+    def test_keywords_and_separators(self):
+        for kw in keyword.kwlist:
+            self.assertRaises(ValueError, namedtuple, kw, 'a')
+            self.assertRaises(ValueError, namedtuple, 'NT', ['a', kw])
+            self.assertEqual(namedtuple('NT', ['a', kw], rename=True)._fields,
+                             ('a', '_1'))
+            # Names close to keywords are fine.
+            if not kw.startswith('_'):
+                namedtuple('NT', [kw + 's', kw[:-1] + 'x', kw.upper()])
+        namedtuple('NT', 'match case type')     # soft keywords
+
+        # The compiled-in table matches ``keyword.kwlist`` of this version,
+        # including the words that are only keywords on some versions.
+        for name in ('async', 'await', '__peg_parser__', 'print', 'exec',
+                     'nonlocal', 'match', 'case', '_', 'type'):
+            if keyword.iskeyword(name):
+                self.assertRaises(ValueError, namedtuple, name, 'a')
+            else:
+                namedtuple(name, 'a')
+
+        self.assertEqual(namedtuple('NT', ' a,b\t,, c\u3000d\n')._fields,
+                         ('a', 'b', 'c', 'd'))
+        self.assertEqual(namedtuple('NT', ['a', 1], rename=True)._fields,
+                         ('a', '_1'))
+        wide = ['f%d' % n for n in range(100)]
+        self.assertEqual(namedtuple('NT', wide + ['f1'], rename=True)._fields,
+                         tuple(wide + ['_100']))
+        self.assertRaises(ValueError, namedtuple, 'NT', wide + ['f99'])
+
     def test_instance(self):
         Point = namedtuple('Point', 'x y')
         p = Point(11, 22)
@@ -96,6 +176,626 @@ class TestNamedTuple(unittest.TestCase):
         p = Point(x=11, y=22)
         self.assertEqual(repr(p), 'Point(x=11, y=22)')
 
+    def test_call_arities(self):
+        for n in range(10):
+            names = ['f%d' % i for i in range(n)]
+            NT = namedtuple('NT', names)
+            values = tuple(range(n))
+            self.assertEqual(NT(*values), values)
+            self.assertEqual(NT(**dict(zip(names, values))), values)
+            if n:
+                self.assertEqual(NT(*values[:-1], **{names[-1]: n - 1}),
+                                 values)
+                self.assertRaises(TypeError, NT, *values[:-1])
+            self.assertRaises(TypeError, NT, *values, None)
+
+        Point = namedtuple('Point', 'x y')
+        with self.assertRaises(TypeError):
+            Point(1, x=2)                                                   # given by name and position
+        with self.assertRaises(TypeError):
+            Point(1, z=2)                                                   # unknown keyword
+        self.assertEqual(Point(**{''.join(['x']): 1, 'y': 2}), (1, 2))      # non-interned keyword
+
+        class Sub(Point):
+            def __init__(self, *args, **kwargs):
+                self.called = True
+
+        s = Sub(1, y=2)
+        self.assertEqual(s, (1, 2))
+        self.assertTrue(s.called)
+
+    def test_wide_keywords(self):
+        names = ['f%d' % n for n in range(300)]
+        Wide = namedtuple('Wide', names)
+        kwargs = {name: n for n, name in enumerate(names)}
+        expected = tuple(range(300))
+        self.assertEqual(Wide(**kwargs), expected)
+        self.assertEqual(Wide.__new__(Wide, **kwargs), expected)
+        self.assertEqual(Wide(*expected[:-1], f299=299), expected)
+
+        class Key(str):
+            pass
+
+        self.assertEqual(Wide(**{Key(k): v for k, v in kwargs.items()}),
+                         expected)
+        del kwargs['f150']
+        with self.assertRaisesRegex(TypeError, r"'f150' \(pos 151\)"):
+            Wide(**kwargs)
+        with self.assertRaisesRegex(TypeError, r"'f150' \(pos 151\)"):
+            Wide.__new__(Wide, **kwargs)
+        kwargs['g'] = 0
+        with self.assertRaisesRegex(TypeError, "'g' is an invalid keyword"):
+            Wide.__new__(Wide, **kwargs)
+        with self.assertRaisesRegex(TypeError, r"'f0'\) and position"):
+            Wide.__new__(Wide, 0, f0=0)
+
+    def test_replace_and_make(self):
+        Point = namedtuple('Point', 'x y z')
+        p = Point(1, 2, 3)
+        kwargs = {'y': 20}
+        self.assertEqual(Point._replace(p, **kwargs), (1, 20, 3))
+        self.assertEqual(kwargs, {'y': 20})
+        self.assertIs(type(p._replace()), Point)
+        self.assertIsNot(p._replace(), p)
+        with self.assertRaisesRegex(ValueError, r"\['w', 'v'\]"):
+            p._replace(w=1, x=2, v=3)
+        self.assertRaises(TypeError, p._replace, 1)
+
+        self.assertEqual(Point._make((1, 2, 3)), p)
+        self.assertEqual(Point._make([1, 2, 3]), p)
+        self.assertEqual(Point._make(iterable=iter([1, 2, 3])), p)
+        self.assertRaises(TypeError, Point._make, [1, 2])
+        self.assertRaises(TypeError, Point._make)
+        self.assertRaises(TypeError, Point._make, seq=[1, 2, 3])
+
+        class Scaled(Point):
+            def __new__(cls, x, y, z):
+                return super().__new__(cls, x, y, z * 10)
+
+        self.assertEqual(Scaled._make([1, 2, 3]), (1, 2, 30))
+        self.assertEqual(Scaled(1, 2, 3)._replace(x=0), (0, 2, 300))
+
+    def test_asdict_factory(self):
+        Point = namedtuple('Point', 'x y')
+        p = Point(1, 2)
+        self.assertIs(type(p._asdict()), OrderedDict)
+        self.assertIs(type(p._asdict(dict)), dict)
+        self.assertEqual(p._asdict(factory=dict), {'x': 1, 'y': 2})
+        # Other factories get the (field, value) pairs.
+        self.assertEqual(p._asdict(factory=list), [('x', 1), ('y', 2)])
+        self.assertIs(type(TestTick(1, 2, 3)._asdict(factory=dict)), dict)
+        self.assertRaises(TypeError, p._asdict, dict, dict)
+        self.assertRaises(TypeError, p._asdict, mapping=dict)
+
+        previous = set_asdict_factory(dict)
+        try:
+            self.assertIs(previous, OrderedDict)
+            self.assertIs(type(p._asdict()), dict)
+            self.assertIs(type(p.__dict__), dict)
+
+            class Ordered(Point):
+                __asdict__ = OrderedDict
+
+            self.assertIs(type(Ordered(1, 2)._asdict()), OrderedDict)
+
+            class Pairs(Point):
+                __asdict__ = list
+
+            self.assertEqual(Pairs(1, 2)._asdict(), [('x', 1), ('y', 2)])
+        finally:
+            set_asdict_factory(previous)
+
+        # Widening `_fields` past the tuple stops at the last value.
+        P = namedtuple('P', 'x y')
+        p = P(1, 2)
+        P._fields = ('x', 'y', 'z')
+        self.assertEqual(p._asdict(), {'x': 1, 'y': 2})
+        self.assertEqual(p.__dict__, {'x': 1, 'y': 2})
+        self.assertEqual(p._asdict(factory=list), [('x', 1), ('y', 2)])
+
+    def test_asmapping(self):
+        Point = namedtuple('Point', 'x y z')
+        p = Point(1, 2, 3)
+        m = p._asmapping()
+        self.assertIsInstance(m, Mapping)
+        self.assertEqual((m['x'], m['z'], len(m)), (1, 3, 3))
+        self.assertEqual(list(m), ['x', 'y', 'z'])
+        self.assertEqual(m.keys(), {'x', 'y', 'z'})
+        self.assertEqual(m.keys() & {'x', 'w'}, {'x'})
+        self.assertEqual(list(m.keys()), ['x', 'y', 'z'])
+        self.assertEqual(list(m.values()), [1, 2, 3])
+        self.assertEqual(list(m.items()), [('x', 1), ('y', 2), ('z', 3)])
+        self.assertIn(('y', 2), m.items())
+        self.assertEqual(m.keys(), {'x': 0, 'y': 0, 'z': 0}.keys())
+        self.assertEqual((m.get('y'), m.get('w'), m.get('w', 0)), (2, None, 0))
+        self.assertTrue('y' in m)
+        self.assertFalse('w' in m)
+        self.assertEqual(m, {'x': 1, 'y': 2, 'z': 3})
+        self.assertEqual(m, p._asmapping())
+        self.assertNotEqual(m, {'x': 1})
+        self.assertEqual('{x}-{z}'.format_map(m), '1-3')
+        self.assertEqual(dict(m), p._asdict())
+        self.assertRaises(KeyError, m.__getitem__, 'w')
+        with self.assertRaises(TypeError):
+            m['x'] = 0
+        self.assertEqual(TestTick(1, 2, 3)._asmapping()['px'], 2.0)
+
+        # Widening `_fields` past the tuple raises instead of reading past it.
+        P = namedtuple('P', 'x y')
+        p = P(1, 2)
+        P._fields = ('x', 'y', 'z')
+        m = p._asmapping()
+        self.assertEqual(m['y'], 2)
+        self.assertRaises(IndexError, m.__getitem__, 'z')
+        self.assertRaises(IndexError, dict, m)
+        self.assertRaises(IndexError, list, m.items())
+
+    def test_fields_override(self):
+        Point = namedtuple('Point', 'x y')
+
+        class Renamed(Point):
+            _fields = ('a', 'b')
+
+        r = Renamed(a=1, b=2)
+        self.assertEqual(r, (1, 2))
+        self.assertEqual(r._asdict(), {'a': 1, 'b': 2})
+        self.assertEqual(r._replace(b=3), (1, 3))
+        self.assertEqual(Point(1, 2)._asdict(), {'x': 1, 'y': 2})
+
+        class Bad(Point):
+            _fields = ['x', 'y']
+
+        self.assertRaises(TypeError, Bad, 1, 2)
+
+        # The fields of the base are read at fixed offsets, so instances may
+        # not be shorter than any namedtuple base.
+        class Short(Point):
+            _fields = ('x',)
+
+        self.assertRaises(TypeError, Short, 1)
+
+        class Both(namedtuple('Pair', 'a b'), namedtuple('Triple', 'x y z')):
+            pass
+
+        self.assertRaises(TypeError, Both, 1, 2)
+        self.assertRaises(AttributeError, setattr, Point(1, 2), 'x', 3)
+
+        # Replacing `_fields` on the type itself does not shrink the layout
+        # either.
+        P = namedtuple('P', 'x y z')
+        P._fields = ('x',)
+        self.assertRaises(TypeError, P, 1)
+        self.assertRaises(TypeError, P._make, [1])
+        P._fields = Point.__dict__['_fields']
+        self.assertRaises(TypeError, P, 1, 2)
+
+    def test_type_cache(self):
+        type_cache_clear()
+        Point = namedtuple('Point', 'x y', cache=True)
+        self.assertIs(namedtuple('Point', 'x y', cache=True), Point)
+        # Every spelling of the same arguments shares an entry.
+        self.assertIs(namedtuple('Point', iter(['x', 'y']), cache=True),
+                      Point)
+        self.assertIs(namedtuple('Point', ['x', 'y'], cache=True), Point)
+        self.assertIs(namedtuple('Point', ' x,y ', rename=0, cache=True),
+                      Point)
+        self.assertIs(namedtuple('Point', 'x y', rename=False, cache=1),
+                      Point)
+        self.assertIsNot(namedtuple('Point', 'x y'), Point)               # opt-in only
+        self.assertIsNot(namedtuple('Point', 'x z', cache=True), Point)
+        self.assertIsNot(namedtuple('Point', 'x y', rename=True, cache=True),
+                         Point)
+        self.assertEqual(Point(1, 2), (1, 2))
+        self.assertEqual(Point.__module__, __name__)
+
+        info = type_cache_info()
+        self.assertEqual(info.hits, 5)
+        self.assertEqual(info.misses, 3)
+        self.assertEqual(info.currsize, 3)
+
+        for n in range(info.maxsize + 1):
+            namedtuple('T%d' % n, 'a', cache=True)
+        self.assertEqual(type_cache_info().currsize, info.maxsize)
+        self.assertIsNot(namedtuple('Point', 'x y', cache=True), Point)   # evicted
+
+        type_cache_clear()
+        self.assertEqual(type_cache_info(), (0, 0, info.maxsize, 0))
+        self.assertRaises(ValueError, namedtuple, 'Point', 'x x', cache=True)
+
+    def test_make_many(self):
+        Point = namedtuple('Point', 'x y')
+        rows = [(1, 2), [3, 4], range(5, 7), 'ab']
+        self.assertEqual(Point._make_many(rows), list(map(Point._make, rows)))
+        self.assertEqual(Point._make_many([iter((7, 8))]), [(7, 8)])
+        self.assertEqual(Point._make_many(iter([])), [])
+        self.assertEqual(Point._make_many(r for r in [(1, 2)]), [(1, 2)])
+        self.assertTrue(all(type(p) is Point for p in Point._make_many(rows)))
+
+        class BadHint:
+            def __iter__(self):
+                return iter([(1, 2)] * 3)
+
+            def __length_hint__(self):
+                return 10
+
+        self.assertEqual(Point._make_many(BadHint()), [(1, 2)] * 3)
+
+        self.assertRaises(TypeError, Point._make_many, [(1, 2), (1,)])      # catch too few args
+        self.assertRaises(TypeError, Point._make_many, [(1, 2, 3)])         # catch too many args
+        self.assertRaises(TypeError, Point._make_many, [1])                 # rows must be iterable
+        self.assertRaises(TypeError, Point._make_many, 1)
+
+        class Sub(Point):
+            def __new__(cls, x, y):
+                return super().__new__(cls, x * 10, y)
+
+        self.assertEqual(Sub._make_many([(1, 2)]), [(10, 2)])
+        self.assertIs(type(Sub._make_many([(1, 2)])[0]), Sub)
+
+    def test_from_columns(self):
+        Point = namedtuple('Point', 'x y')
+        xs = [1, 2, 3]
+        ys = (4, 5, 6)
+        expected = list(map(Point._make, zip(xs, ys)))
+        self.assertEqual(Point._from_columns(xs, ys), expected)
+        self.assertEqual(Point._from_columns(xs, y=ys), expected)
+        self.assertEqual(Point._from_columns(**{'y': ys, 'x': xs}), expected)
+        self.assertEqual(Point._from_columns(range(1, 4), iter(ys)), expected)
+        self.assertEqual(Point._from_columns([], []), [])
+        self.assertTrue(all(type(p) is Point for p in Point._from_columns(xs, ys)))
+
+        self.assertRaises(ValueError, Point._from_columns, xs, ys[:-1])     # mismatched lengths
+        self.assertRaises(TypeError, Point._from_columns, xs)               # missing column
+        self.assertRaises(TypeError, Point._from_columns, xs, ys, xs)       # too many columns
+        self.assertRaises(TypeError, Point._from_columns, xs, z=ys)         # unknown column
+        self.assertRaises(TypeError, Point._from_columns, xs, 1)            # column must be iterable
+
+        class Sub(Point):
+            def __new__(cls, x, y):
+                return super().__new__(cls, x, -y)
+
+        self.assertEqual(Sub._from_columns([1], [2]), [(1, -2)])
+
+        class Shrink(Point):
+            def __new__(cls, x, y):
+                xs.clear()
+                return super().__new__(cls, x, y)
+
+        self.assertRaises(RuntimeError, Shrink._from_columns, xs, ys)
+
+    def test_to_columns(self):
+        Point = namedtuple('Point', 'x y z')
+        records = [Point(1, 2, 3), Point(4, 5, 6)]
+        self.assertEqual(Point._to_columns(records), ([1, 4], [2, 5], [3, 6]))
+        self.assertEqual(Point._to_columns(iter(records), fields=['z', 'x']),
+                         ([3, 6], [1, 4]))
+        self.assertEqual(Point._to_columns(records, 'y, x'), ([2, 5], [1, 4]))
+        self.assertEqual(Point._to_columns([]), ([], [], []))
+        self.assertEqual(Point._from_columns(*Point._to_columns(records)),
+                         records)
+        self.assertEqual(Point._pluck(records, 'y'), [2, 5])
+        self.assertEqual(Point._pluck(records, field='z'), [3, 6])
+
+        class Sub(Point):
+            pass
+
+        self.assertEqual(Point._pluck([Sub(1, 2, 3)], 'x'), [1])
+        self.assertRaises(TypeError, Sub._pluck, records, 'x')             # not a Sub
+        self.assertRaises(TypeError, Point._pluck, [(1, 2, 3)], 'x')        # plain tuple
+        self.assertRaises(ValueError, Point._pluck, records, 'w')           # not a field
+        self.assertRaises(ValueError, Point._to_columns, records, ['x', 'w'])
+
+    def test_sort(self):
+        Row = namedtuple('Row', 'name score big ix')
+        names = ['a', 'b', 'c', 'é']
+        records = [
+            Row(choice(names), choice([1, 2, 3.5, 2.0]), choice([1, 2]) << 70,
+                n)
+            for n in range(500)
+        ]
+        self.assertEqual(Row._sort(records, by=('score', 'name')),
+                         sorted(records, key=lambda r: (r.score, r.name)))
+        # Equal keys keep their order, also for descending fields.
+        self.assertEqual(
+            Row._sort(records, by='-name big'),
+            sorted(sorted(records, key=lambda r: r.big),
+                   key=lambda r: r.name,
+                   reverse=True),
+        )
+        self.assertEqual(Row._sort(iter(records)), sorted(records))
+        self.assertEqual(Row._sort(records, by='-ix'), records[::-1])
+        floats = [TestNT(n * 0.5 % 7, n, None) for n in range(100)]
+        self.assertEqual(TestNT._sort(floats, by='x -y'),
+                         sorted(floats, key=lambda r: (r.x, -r.y)))
+        self.assertEqual(Row._sort(records, by=()), records)
+
+        copied = list(records)
+        self.assertIsNone(Row._sort(copied, by=['-score'], inplace=True))
+        self.assertEqual(copied, sorted(records, key=lambda r: -r.score))
+        self.assertRaises(TypeError, Row._sort, tuple(records), inplace=True)
+
+        self.assertRaises(ValueError, Row._sort, records, by='-w')
+        self.assertRaises(TypeError, Row._sort, records + [(1, 2, 3, 4)])
+        self.assertRaises(TypeError, Row._sort, [Row(1, 0, 0, 0)] * 20 +
+                          [Row('a', 0, 0, 0)], by='name')
+
+        key = Row._key('score', 'ix')
+        self.assertEqual(repr(key), "Row._key('score', 'ix')")
+        self.assertEqual(sorted(records, key=key),
+                         sorted(records, key=lambda r: (r.score, r.ix)))
+        self.assertEqual(key(records[0]), (records[0].score, 0))
+        self.assertEqual(Row._key('name')(records[0]), records[0].name)
+        self.assertEqual(TestTick._key('px', 'ts')(TestTick(1, 2, 3)),
+                         (2.0, 1))
+        self.assertRaises(TypeError, key)
+        self.assertRaises(TypeError, key, records[0], records[1])
+        self.assertRaises(TypeError, key, record=records[0])
+        self.assertRaises(IndexError, key, (1,))
+        self.assertRaises(TypeError, Row._key)
+        self.assertRaises(ValueError, Row._key, '-score')
+
+    def test_getter(self):
+        Row = namedtuple('Row', 'a b c d')
+        records = [Row(n, -n, str(n), None) for n in range(10)]
+        get = Row._getter('a', 'c')
+        self.assertEqual(repr(get), "Row._getter('a', 'c')")
+        self.assertIsNone(get.type)
+        self.assertEqual(get(records[3]), (3, '3'))
+        self.assertIs(type(get(records[3])), tuple)
+        self.assertEqual(Row._getter('b')(records[3]), (-3,))
+        self.assertEqual(get.map(records), [(r.a, r.c) for r in records])
+        self.assertEqual(get.map(iter(records)), get.map(records))
+
+        proj = Row._getter('a', 'c', as_type=True)
+        self.assertEqual(repr(proj), "Row._getter('a', 'c', as_type=True)")
+        Row_a_c = proj.type
+        self.assertEqual(Row_a_c.__name__, 'Row_a_c')
+        self.assertEqual(Row_a_c._fields, ('a', 'c'))
+        self.assertIs(Row._getter('a', 'c', as_type=True).type, Row_a_c)
+        self.assertEqual(proj(records[3]), Row_a_c(3, '3'))
+        self.assertIs(type(proj(records[3])), Row_a_c)
+        self.assertEqual(proj.map(records),
+                         [Row_a_c(r.a, r.c) for r in records])
+        self.assertEqual(TestTick._getter('qty', 'ts', as_type=True)(
+            TestTick(1, 2, 3)), (3.0, 1))
+
+        self.assertRaises(TypeError, get)
+        self.assertRaises(TypeError, proj.map, 1)
+        self.assertRaises(IndexError, get, (1,))
+        self.assertRaises(TypeError, Row._getter)
+        self.assertRaises(TypeError, Row._getter, 'a', as_type=True, x=1)
+        self.assertRaises(ValueError, Row._getter, 'w')
+
+    def test_index_groupby_where(self):
+        Row = namedtuple('Row', 'id k1 k2 v')
+        records = [Row(n, n % 3, n % 2, str(n)) for n in range(12)]
+        self.assertEqual(Row._index(records, 'id'), {r.id: r for r in records})
+        self.assertEqual(Row._index(records, 'id', unique=True),
+                         {r.id: r for r in records})
+        self.assertEqual(Row._index(records, 'k1', 'k2'),
+                         {(r.k1, r.k2): r for r in records})
+        self.assertRaises(ValueError, Row._index, records, 'k1', unique=True)
+
+        groups = {}
+        for r in records:
+            groups.setdefault((r.k1, r.k2), []).append(r)
+        self.assertEqual(Row._groupby(records, 'k1', 'k2'), groups)
+        self.assertEqual(list(Row._groupby(iter(records), 'k2')), [0, 1])
+        self.assertEqual(Row._groupby([], 'k1'), {})
+
+        self.assertEqual(Row._where(records, k1=1, k2=0),
+                         [r for r in records if r.k1 == 1 and r.k2 == 0])
+        self.assertEqual(Row._where(records, v='3'), [records[3]])
+        self.assertEqual(Row._where(iter(records)), records)
+
+        self.assertRaises(TypeError, Row._index)
+        self.assertRaises(TypeError, Row._index, records)
+        self.assertRaises(TypeError, Row._groupby, records)
+        self.assertRaises(TypeError, Row._where)
+        self.assertRaises(TypeError, Row._where, records, records)
+        self.assertRaises(ValueError, Row._groupby, records, 'w')
+        self.assertRaises(ValueError, Row._where, records, w=1)
+        self.assertRaises(TypeError, Row._index, records + [(1, 2, 3, 4)],
+                          'id')
+        self.assertRaises(TypeError, Row._groupby, [Row([], 0, 0, 0)], 'id')
+
+    def test_array(self):
+        Point = namedtuple('Point', 'x y z')
+        records = [Point(1, 2, 3), Point(4, 5, 6), Point(7, 8, 9)]
+        arr = Point._array(2)
+        self.assertEqual(len(arr), 0)
+        self.assertEqual(arr.capacity, 2)
+        self.assertIs(arr.type, Point)
+        arr.append(records[0])
+        arr.extend(records[1:])
+        self.assertEqual(len(arr), 3)
+        self.assertGreaterEqual(arr.capacity, 3)
+        self.assertEqual(arr.tolist(), records)
+        self.assertEqual(list(arr), records)
+        self.assertEqual((arr[0], arr[-1]), (records[0], records[-1]))
+        self.assertIs(type(arr[1]), Point)
+        self.assertEqual(arr[1:].tolist(), records[1:])
+        self.assertEqual(arr[::-2].tolist(), records[::-2])
+        self.assertEqual(arr.column('y'), [2, 5, 8])
+
+        arr.append([10, 11, 12])                # any row sequence
+        arr.extend(arr)
+        self.assertEqual(arr.tolist(), (records + [(10, 11, 12)]) * 2)
+
+        self.assertRaises(IndexError, arr.__getitem__, 8)
+        self.assertRaises(TypeError, arr.append, (1, 2))
+        self.assertRaises(ValueError, arr.column, 'w')
+        self.assertRaises(ValueError, Point._array, -1)
+        self.assertRaises(MemoryError, Point._array, sys.maxsize)
+
+        # The garbage collector may run a callback that grows the array while
+        # a record is being read.
+        grown = Point._array()
+        grown.extend((n, n, n) for n in range(4))
+
+        def grow(phase, info):
+            if phase == 'start' and len(grown) < 10000:
+                grown.extend((n, n, n) for n in range(len(grown)))
+
+        threshold = gc.get_threshold()
+        limit = set_freelist_limit(0)       # allocate through the collector
+        gc.set_threshold(1, 1, 1)
+        gc.callbacks.append(grow)
+        try:
+            for m in range(200):
+                for n in range(4):
+                    self.assertEqual(grown[n], (n, n, n))
+        finally:
+            gc.callbacks.remove(grow)
+            gc.set_threshold(*threshold)
+            set_freelist_limit(limit)
+
+        # A failed resize keeps the records.
+        class Huge:
+            def __init__(self, hint):
+                self.hint = hint
+
+            def __iter__(self):
+                return iter(())
+
+            def __length_hint__(self):
+                return self.hint
+
+        for hint in (sys.maxsize // 2, sys.maxsize):
+            self.assertRaises(MemoryError, arr.extend, Huge(hint))
+            self.assertEqual(arr.tolist(), (records + [(10, 11, 12)]) * 2)
+
+    def test_typed_fields(self):
+        t = TestTick(1, 2.5, qty=3)
+        self.assertEqual((t.ts, t.px, t.qty), (1, 2.5, 3.0))
+        self.assertIsInstance(t.qty, float)
+        self.assertEqual((t[0], t[-1], t[:2], len(t)), (1, 3.0, (1, 2.5), 3))
+        self.assertEqual(t, (1, 2.5, 3.0))
+        self.assertEqual(hash(t), hash((1, 2.5, 3.0)))
+        self.assertEqual(repr(t), 'TestTick(ts=1, px=2.5, qty=3.0)')
+        self.assertEqual(TestTick._fields, ('ts', 'px', 'qty'))
+        self.assertEqual(TestTick._types, 'qdd')
+        # The instance size is padded like a struct.
+        pointer = struct.calcsize('P')
+        for types in ('bH?', 'b', 'qb', 'bd', 'i' * 5):
+            P = namedtuple('P', ['f%d' % n for n in range(len(types))],
+                           types=types)
+            align = max([pointer] + [
+                struct.calcsize('b' + code) - struct.calcsize(code)
+                for code in types
+            ])
+            self.assertEqual(P.__basicsize__ % align, 0, types)
+            self.assertGreaterEqual(P.__basicsize__ - object.__basicsize__,
+                                    struct.calcsize(types))
+        self.assertNotIsInstance(t, tuple)
+        self.assertEqual(t._replace(px=4), (1, 4.0, 3.0))
+        self.assertEqual(t._asdict(), OrderedDict(ts=1, px=2.5, qty=3.0))
+        self.assertEqual(TestTick._make([4, 5, 6]), (4, 5.0, 6.0))
+        with self.assertRaises(AttributeError):
+            t.ts = 2
+
+        view = memoryview(t)
+        self.assertTrue(view.readonly)
+        self.assertEqual(view.format, 'qdd')
+        self.assertEqual(view.nbytes, struct.calcsize('qdd'))
+        self.assertEqual(struct.unpack('qdd', view), (1, 2.5, 3.0))
+        Packed = namedtuple('Packed', 'a b c', types='bH?')
+        self.assertEqual(bytes(Packed(-1, 2, 'x')),
+                         struct.pack('bH?', -1, 2, True))
+
+        for proto in range(pickle.HIGHEST_PROTOCOL + 1):
+            self.assertEqual(pickle.loads(pickle.dumps(t, proto)), t)
+        self.assertLess(sys.getsizeof(t),
+                        sys.getsizeof(TestNT(1, 2.5, 3.0)))
+
+        self.assertRaises(OverflowError, TestTick, 2 ** 63, 0, 0)
+        self.assertRaises(OverflowError, Packed, 0, -1, 0)
+        self.assertRaises(TypeError, TestTick, 1.5, 0, 0)
+        self.assertRaises(TypeError, TestTick, 1, 2)
+        self.assertRaises(ValueError, namedtuple, 'T', 'a b', types='q')
+        self.assertRaises(ValueError, namedtuple, 'T', 'a b', types='qs')
+
+        # The members live as long as the type, not as long as `_fields`.
+        P = namedtuple('P', 'a b c', types='qdd')
+        p = P(1, 2.0, 3.0)
+        del P._fields
+        junk = [bytes(64) for _ in range(1000)]
+        self.assertEqual((p.a, p.b, p.c), (1, 2.0, 3.0))
+        del junk
+
+    @unittest.skipIf(sysconfig.get_config_var('Py_GIL_DISABLED'),
+                     'free lists are left out without the GIL')
+    def test_freelist(self):
+        A = namedtuple('A', 'x y')
+        B = namedtuple('B', 'p q')
+        previous = set_freelist_limit(10)
+        try:
+            freelist_clear()
+            records = [A(n, n) for n in range(20)]
+            del records
+            self.assertEqual(freelist_clear(), 10)
+            records = [A(n, n) for n in range(5)]
+            del records
+            b = B(1, 2)                         # reuses a block freed by A
+            self.assertEqual((type(b), b.p, b.q), (B, 1, 2))
+            self.assertEqual(set_freelist_limit(0), 10)
+            self.assertEqual(freelist_clear(), 0)
+            self.assertRaises(ValueError, set_freelist_limit, -1)
+        finally:
+            set_freelist_limit(previous)
+
+    def test_threads(self):
+        # Types created at the same time get their own names and fields, and
+        # a cached type is shared.
+        barrier = threading.Barrier(8)
+        errors = []
+
+        def work(n):
+            barrier.wait()
+            try:
+                for m in range(200):
+                    NT = namedtuple('T%d' % n, ['f%d' % n, 'g'])
+                    self.assertEqual(NT.__name__, 'T%d' % n)
+                    self.assertEqual(NT._fields, ('f%d' % n, 'g'))
+                    self.assertEqual(NT(m, g=n)._asdict(),
+                                     {'f%d' % n: m, 'g': n})
+                    self.assertIs(namedtuple('C', 'a b', cache=True),
+                                  namedtuple('C', 'a b', cache=True))
+            except Exception as e:
+                errors.append(e)
+
+        threads = [threading.Thread(target=work, args=(n,)) for n in range(8)]
+        for thread in threads:
+            thread.start()
+        for thread in threads:
+            thread.join()
+        self.assertEqual(errors, [])
+
+        # An array shared between threads keeps every record while it grows.
+        Point = namedtuple('Point', 'x y')
+        arr = Point._array()
+        arr.extend([(-1, 0), (-1, 1)])
+
+        def fill(n):
+            barrier.wait()
+            try:
+                for m in range(500):
+                    arr.append((n, m))
+                    arr.extend(arr[-2:])
+                    arr[len(arr) // 2]
+                    arr.column('x')
+            except Exception as e:
+                errors.append(e)
+
+        threads = [threading.Thread(target=fill, args=(n,)) for n in range(8)]
+        for thread in threads:
+            thread.start()
+        for thread in threads:
+            thread.join()
+        self.assertEqual(errors, [])
+        self.assertEqual(len(arr), 2 + 8 * 500 * 3)
+        self.assertEqual(len(arr.tolist()), len(arr))
+
     def test_tupleness(self):
         Point = namedtuple('Point', 'x y')
         p = Point(11, 22)
@@ -188,7 +888,208 @@ class TestNamedTuple(unittest.TestCase):
         class B(A):
             pass
         self.assertEqual(repr(B(1)), 'B(x=1)')
+        cycle = []
+        a = A(cycle)
+        cycle.append(a)
+        self.assertEqual(repr(a), 'A(x=[...])')
+        self.assertEqual(repr(cycle), '[A(x=[...])]')
+
+    def test_repr_many(self):
+        A = namedtuple('A', 'x y')
+
+        class B(A):
+            def __repr__(self):
+                return 'B!'
+
+        records = [A(1, 'a'), A(2, None), B(3, 4)]
+        self.assertEqual(A._repr_many(records),
+                         "A(x=1, y='a')\nA(x=2, y=None)\nB!")
+        self.assertEqual(A._repr_many(iter(records[:2]), sep='; '),
+                         "A(x=1, y='a'); A(x=2, y=None)")
+        self.assertEqual(A._repr_many([]), '')
+        self.assertRaises(TypeError, A._repr_many, [(1, 2)])
+        self.assertRaises(TypeError, B._repr_many, records)
+
+    def test_pack(self):
+        A = namedtuple('A', 'x y z')
+        records = [
+            A(1, 2.5, 'abc'),
+            A(None, True, False),
+            A(b'\x00raw', -2 ** 63, '\u2603'),
+            A(2 ** 100, [1, 2], '\udc80'),
+        ]
+        packed = A._pack(records)
+        self.assertIsInstance(packed, bytes)
+        unpacked = A._unpack_many(packed)
+        self.assertEqual(unpacked, records)
+        self.assertTrue(all(type(r) is A for r in unpacked))
+        self.assertIs(unpacked[1].y, True)
+        self.assertEqual(A._unpack_many(memoryview(packed)), records)
+        self.assertEqual(A._unpack_many(A._pack([])), [])
+
+        B = namedtuple('B', 'x y w')
+        self.assertRaises(ValueError, B._unpack_many, packed)
+        self.assertRaises(ValueError, A._unpack_many, packed[:-1])
+        self.assertRaises(ValueError, A._unpack_many, packed + b'\x00')
+        self.assertRaises(ValueError, A._unpack_many, b'junk' * 10)
+        self.assertRaises(TypeError, A._pack, [(1, 2, 3)])
+
+        # Pickling a value may change the list being packed.
+        expected = [A(n, [], n) for n in range(3)]
+        self.assertEqual(A._unpack_many(A._pack(ClearOnPickle.records(A))),
+                         expected)
+        self.assertEqual(A._batch(ClearOnPickle.records(A)).tolist(),
+                         expected)
+
+    def test_batch(self):
+        records = [TestNT(1, 'a', None), TestNT(2.5, b'b', [3])]
+        batch = TestNT._batch(records)
+        self.assertEqual(len(batch), 2)
+        self.assertIs(batch.type, TestNT)
+        self.assertEqual(batch.tolist(), records)
+        self.assertEqual(list(batch), records)
+
+        for protocol in range(pickle.HIGHEST_PROTOCOL + 1):
+            loaded = pickle.loads(pickle.dumps(batch, protocol))
+            self.assertEqual(loaded.tolist(), records)
+
+        if pickle.HIGHEST_PROTOCOL >= 5:
+            buffers = []
+            data = pickle.dumps(batch, 5, buffer_callback=buffers.append)
+            self.assertEqual(len(buffers), 1)
+            self.assertNotIn(batch.data, data)
+            shared = memoryview(bytearray(buffers[0].raw()))
+            loaded = pickle.loads(data, buffers=[shared])
+            self.assertIs(memoryview(loaded.data).obj, shared.obj)
+            self.assertEqual(loaded.tolist(), records)
+
+        B = namedtuple('B', 'a b c')
+        rebuild = batch.__reduce_ex__(2)[0]
+        self.assertRaises(ValueError, rebuild, B, batch.data)
+
+    def test_dump_open(self):
+        A = namedtuple('A', 'i f s o')
+        records = [A(n, n / 2, 's%d' % n, [n] if n % 3 else None)
+                   for n in range(100)]
+        with tempfile.TemporaryDirectory() as d:
+            path = os.path.join(d, 'records')
+            A._dump(records, path)
+
+            with A._open(path) as f:
+                self.assertEqual(f.encodings, ('q', 'd', 'v', 'v'))
+                self.assertEqual(len(f), 100)
+                self.assertEqual(f[42], records[42])
+                self.assertEqual(f[-1], records[-1])
+                self.assertIs(type(f[0]), A)
+                self.assertEqual(list(f), records)
+                self.assertEqual(f.column('s'), [r.s for r in records])
+                self.assertRaises(IndexError, f.__getitem__, 100)
+                self.assertRaises(ValueError, f.column, 'x')
+            self.assertTrue(f.closed)
+            self.assertRaises(ValueError, f.__getitem__, 0)
+
+            B = namedtuple('B', 'i f s x')
+            self.assertRaises(ValueError, B._open, path)
+            with open(path, 'rb') as fp:
+                data = fp.read()
+            with open(path, 'wb') as fp:
+                fp.write(data[:-1])
+            with A._open(path) as f:
+                self.assertEqual(f[0], records[0])
+                self.assertRaises(ValueError, f.__getitem__, -1)
+            with open(path, 'wb') as fp:
+                fp.write(data[:40])
+            self.assertRaises(ValueError, A._open, path)
+
+    def test_dump_mutated_while_pickling(self):
+        A = namedtuple('A', 'a b c')
+        with tempfile.TemporaryDirectory() as d:
+            path = os.path.join(d, 'records')
+            A._dump(ClearOnPickle.records(A), path)
+            with A._open(path) as f:
+                self.assertEqual(list(f), [A(n, [], n) for n in range(3)])
+
+    def test_dump_open_close_while_reading(self):
+        A = namedtuple('A', 'a b')
+        with tempfile.TemporaryDirectory() as d:
+            path = os.path.join(d, 'records')
+            A._dump([A(n, CloseOnLoad()) for n in range(3)], path)
+            with A._open(path) as f:
+                CloseOnLoad.files.append(f)
+                try:
+                    self.assertEqual(f[1], A(1, 'busy'))
+                    self.assertEqual(f.column('b'), ['busy'] * 3)
+                    self.assertEqual(list(f), [A(n, 'busy') for n in range(3)])
+                finally:
+                    CloseOnLoad.files.pop()
+            self.assertTrue(f.closed)
+
+    def test_read_csv(self):
+        A = namedtuple('A', 'a b c')
+        text = 'c,a,b\r\n1,2,3\n\n"x,\ny",4,"say ""hi"""\n5,,6'
+        self.assertEqual(A._read_csv(io.StringIO(text)), [
+            A('2', '3', '1'),
+            A('4', 'say "hi"', 'x,\ny'),
+            A('', '6', '5'),
+        ])
+        self.assertEqual(
+            A._read_csv(io.StringIO('1;2;3\n'),
+                        header=False,
+                        delimiter=';',
+                        converters={'a': int, 'b': float, 'c': list}),
+            [A(1, 2.0, ['3'])],
+        )
+        self.assertEqual(
+            A._read_csv(io.StringIO('X,a,b\n1,2,3'), header={'X': 'c'}),
+            [A('2', '3', '1')],
+        )
+
+        for bad in ('a,b\n', 'a,b,b\n', 'a,b,c,d\n', 'a,b,c\n1,2\n',
+                    'a,b,c\n1,2,3,4\n', 'a,b,c\n"1,2,3', ''):
+            self.assertRaises(ValueError, A._read_csv, io.StringIO(bad))
+        self.assertRaises(ValueError,
+                          A._read_csv,
+                          io.StringIO('a,b,c\nx,2,3'),
+                          converters={'a': int})
+        self.assertRaises(TypeError, A._read_csv, io.BytesIO(b'a,b,c'))
+
+    def test_cache_hash(self):
+        A = namedtuple('A', 'a b c', cache_hash=True)
+        a = A(1, 'x', (2, 3))
+        self.assertEqual(hash(a), hash((1, 'x', (2, 3))))
+        self.assertEqual(hash(a), hash(a))
+        self.assertEqual(hash(A(0, 0, 0)), hash((0, 0, 0)))
+        self.assertEqual(a, A(1, 'x', (2, 3)))
+        self.assertEqual(a, (1, 'x', (2, 3)))
+        b = A(1, 'x', (2, 4))
+        hash(b)
+        self.assertNotEqual(a, b)
+        self.assertFalse(a == b)
+        self.assertRaises(TypeError, hash, A(1, [], 3))
+        nan = float('nan')
+        c = A(nan, 0, 0)
+        self.assertEqual(c, c)
+
+        self.assertEqual({a: 1}[A(1, 'x', (2, 3))], 1)
+        self.assertEqual(hash(a._replace(a=5)), hash((5, 'x', (2, 3))))
+        self.assertEqual(copy.copy(a), a)
+
+        class B(A):
+            pass
+
+        b = B(1, 2, 3)
+        b.w = 4
+        self.assertEqual(hash(b), hash((1, 2, 3)))
+        self.assertEqual(b.__dict__, {'w': 4})
 
+        self.assertIsNot(namedtuple('A', 'a b c', cache=True),
+                         namedtuple('A', 'a b c', cache=True, cache_hash=True))
+        self.assertRaises(ValueError,
+                          namedtuple,
+                          'T',
+                          'a b',
+                          types='qq',
+                          cache_hash=True)
 
     def test_namedtuple_subclass_issue_24931(self):
         class Point(namedtuple('_Point', ['x', 'y'])):